@@ -0,0 +1,592 @@
+#include "BeliefLog.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr char LOG_MAGIC[8]      = { 'M', 'P', 'P', 'B', 'L', 'O', 'G', '\0' };
+    constexpr char SNAPSHOT_MAGIC[8] = { 'M', 'P', 'P', 'B', 'S', 'N', 'P', '\0' };
+
+    constexpr size_t WRITE_AHEAD = 1 << 20;   // pending bytes written before sync()
+
+    // CRC32 (IEEE), table-driven
+    constexpr std::array<uint32_t, 256> CRC_TABLE = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k)
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+
+    uint32_t crc32(uint32_t crc, const void* data, size_t n)
+    {
+        const auto* p = static_cast<const unsigned char*>(data);
+        crc = ~crc;
+        while (n--)
+            crc = CRC_TABLE[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    // the record after its crc field, then its strings
+    uint32_t record_crc(const BeliefLogRecord& r, const char* strings, size_t n)
+    {
+        const uint32_t c = crc32(0, reinterpret_cast<const char*>(&r) + sizeof(r.crc),
+                                 sizeof(r) - sizeof(r.crc));
+        return crc32(c, strings, n);
+    }
+
+    // a read-only mapping of a whole file
+    struct Mapped {
+        const char* data = nullptr;
+        size_t      size = 0;
+
+        ~Mapped()
+        {
+            if (data && size)
+                munmap(const_cast<char*>(data), size);
+        }
+
+        bool map(const std::string& path, std::string& error)
+        {
+            const int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                error = path + ": " + std::strerror(errno);
+                return false;
+            }
+            struct stat st{};
+            if (fstat(fd, &st) < 0) {
+                error = path + ": " + std::strerror(errno);
+                ::close(fd);
+                return false;
+            }
+            size = static_cast<size_t>(st.st_size);
+            if (size) {
+                void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p == MAP_FAILED) {
+                    error = path + ": " + std::strerror(errno);
+                    size = 0;
+                    ::close(fd);
+                    return false;
+                }
+                madvise(p, size, MADV_SEQUENTIAL);
+                data = static_cast<const char*>(p);
+            }
+            ::close(fd);
+            return true;
+        }
+    };
+
+    // <prefix><revision><suffix> in dir, sorted by revision
+    std::vector<uint64_t> list(const std::string& dir, std::string_view prefix,
+                               std::string_view suffix)
+    {
+        std::vector<uint64_t> out;
+        DIR* d = opendir(dir.c_str());
+        if (!d)
+            return out;
+
+        while (const dirent* e = readdir(d)) {
+            const std::string_view name(e->d_name);
+            if (name.size() <= prefix.size() + suffix.size() ||
+                !name.starts_with(prefix) || !name.ends_with(suffix))
+                continue;
+
+            const std::string digits(name.substr(prefix.size(),
+                                                 name.size() - prefix.size() - suffix.size()));
+            char* end = nullptr;
+            const uint64_t n = std::strtoull(digits.c_str(), &end, 10);
+            if (end && *end == '\0')
+                out.push_back(n);
+        }
+        closedir(d);
+
+        std::sort(out.begin(), out.end());
+        return out;
+    }
+
+    // a mapped snapshot's header, checked against its size, records and CRC
+    bool check_snapshot(const Mapped& m, const std::string& path, BeliefSnapshotHeader& h,
+                        std::string& error)
+    {
+        if (m.size < sizeof(BeliefSnapshotHeader)) {
+            error = path + ": not a belief snapshot";
+            return false;
+        }
+
+        std::memcpy(&h, m.data, sizeof(h));
+        if (std::memcmp(h.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+            h.version != 2 || h.record_size != sizeof(BeliefSnapshotRecord))
+            return error = path + ": not a belief snapshot", false;
+        if (h.file_size != m.size ||
+            h.count > (m.size - sizeof(h)) / sizeof(BeliefSnapshotRecord))
+            return error = path + ": truncated snapshot", false;
+
+        BeliefSnapshotHeader unsigned_h = h;
+        unsigned_h.crc = 0;
+        const uint32_t crc = crc32(crc32(0, m.data + sizeof(h), m.size - sizeof(h)),
+                                   &unsigned_h, sizeof(unsigned_h));
+        if (crc != h.crc)
+            return error = path + ": snapshot CRC mismatch", false;
+
+        const auto* records = reinterpret_cast<const BeliefSnapshotRecord*>(m.data + sizeof(h));
+        const uint64_t pool_size = m.size - sizeof(h) - h.count * sizeof(BeliefSnapshotRecord);
+        for (uint64_t i = 0; i < h.count; ++i) {
+            const auto& r = records[i];
+            const uint64_t n = uint64_t(r.subject_len) + r.component_len + r.context_len;
+            if (r.offset > pool_size || n > pool_size - r.offset || r.revision > h.revision)
+                return error = path + ": corrupt record " + std::to_string(i), false;
+        }
+        return true;
+    }
+}
+
+std::string BeliefLog::snapshot_path(uint64_t revision) const
+{
+    char name[64];
+    std::snprintf(name, sizeof(name), "/snapshot-%020" PRIu64 ".mppbs", revision);
+    return dir_ + name;
+}
+
+std::string BeliefLog::segment_path(uint64_t base) const
+{
+    char name[64];
+    std::snprintf(name, sizeof(name), "/log-%020" PRIu64 ".mppbl", base);
+    return dir_ + name;
+}
+
+void BeliefLog::sync_dir()
+{
+    const int fd = ::open(dir_.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd >= 0) {
+        fsync(fd);
+        ::close(fd);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Recovery
+// -----------------------------------------------------------------------------
+bool BeliefLog::open(const std::string& dir, BeliefStore& store, std::string& error)
+{
+    close();
+
+    const auto t0 = std::chrono::steady_clock::now();
+    dir_ = dir;
+    recovery_ = {};
+
+    if (mkdir(dir_.c_str(), 0755) < 0 && errno != EEXIST) {
+        error = dir_ + ": " + std::strerror(errno);
+        return false;
+    }
+
+    // newest snapshot that loads; a bad one falls back to the one before
+    const std::vector<uint64_t> snapshots = list(dir_, "snapshot-", ".mppbs");
+    for (auto it = snapshots.rbegin(); it != snapshots.rend(); ++it) {
+        std::string why;
+        if (load_snapshot(snapshot_path(*it), store, why))
+            break;
+        std::fprintf(stderr, "[BLS] %s, skipped\n", why.c_str());
+    }
+
+    // Then the segments, applying only what continues the store. One the
+    // next segment starts at or before the store's revision holds nothing
+    // new (it is kept behind the snapshot before the newest).
+    const std::vector<uint64_t> segments = list(dir_, "log-", ".mppbl");
+    bool last_usable = false;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        const bool last = i + 1 == segments.size();
+        if (!last && segments[i + 1] <= store.revision())
+            continue;
+
+        const std::string path = segment_path(segments[i]);
+        if (segments[i] > store.revision()) {
+            error = path + ": revisions " + std::to_string(store.revision() + 1) + ".." +
+                    std::to_string(segments[i]) + " are missing";
+            return false;
+        }
+
+        uint64_t good = 0;
+        switch (replay_segment(path, store, good, error)) {
+        case Replay::intact:
+            last_usable = last;
+            continue;
+        case Replay::gap:
+        case Replay::unreadable:
+            return false;
+        case Replay::torn:
+            break;
+        }
+
+        // only the tail of the last segment may be cut: revisions after a
+        // bad record anywhere else are still in later segments
+        if (!last) {
+            error = path + ": corrupt record at byte " + std::to_string(good) +
+                    ", revision " + std::to_string(store.revision() + 1) + " on";
+            return false;
+        }
+
+        struct stat st{};
+        if (stat(path.c_str(), &st) == 0 && uint64_t(st.st_size) > good)
+            recovery_.torn_bytes += uint64_t(st.st_size) - good;
+
+        // cut the torn tail so appends continue from intact records (a torn
+        // header: start the segment over)
+        if (good >= sizeof(BeliefLogHeader)) {
+            if (truncate(path.c_str(), good) < 0) {
+                error = path + ": " + std::strerror(errno);
+                return false;
+            }
+            last_usable = true;
+        }
+    }
+
+    // append to the last segment if it is intact, else start one
+    bool appending = false;
+    if (last_usable) {
+        const std::string path = segment_path(segments.back());
+        fd_ = ::open(path.c_str(), O_WRONLY | O_APPEND);
+        struct stat st{};
+        if (fd_ >= 0 && fstat(fd_, &st) == 0 && size_t(st.st_size) >= sizeof(BeliefLogHeader)) {
+            segment_base_  = segments.back();
+            segment_bytes_ = uint64_t(st.st_size);
+            appending = true;
+        } else if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+    if (!appending && !start_segment(store.revision(), error))
+        return false;
+
+    durable_revision_ = pending_revision_ = store.revision();
+    recovery_.ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - t0).count();
+    return true;
+}
+
+bool BeliefLog::load_snapshot(const std::string& path, BeliefStore& store, std::string& error)
+{
+    Mapped m;
+    if (!m.map(path, error))
+        return false;
+
+    // checked before touching the store, so a bad file leaves it empty
+    BeliefSnapshotHeader h;
+    if (!check_snapshot(m, path, h, error))
+        return false;
+
+    const auto* records = reinterpret_cast<const BeliefSnapshotRecord*>(m.data + sizeof(h));
+    const char* pool    = m.data + sizeof(h) + h.count * sizeof(BeliefSnapshotRecord);
+
+    for (uint64_t i = 0; i < h.count; ++i) {
+        const auto& r = records[i];
+        const char* s = pool + r.offset;
+        store.restore(std::string_view(s + r.subject_len, r.component_len),
+                      std::string_view(s, r.subject_len),
+                      r.polarity != 0,
+                      std::string_view(s + r.subject_len + r.component_len, r.context_len),
+                      r.revision);
+    }
+    store.rebase(h.revision);
+
+    snapshot_revision_          = h.revision;
+    recovery_.snapshot_revision = h.revision;
+    recovery_.subjects          = h.count;
+    return true;
+}
+
+BeliefLog::Replay BeliefLog::replay_segment(const std::string& path, BeliefStore& store,
+                                            uint64_t& good_bytes, std::string& error)
+{
+    good_bytes = 0;
+
+    Mapped m;
+    if (!m.map(path, error))
+        return Replay::unreadable;
+    if (m.size < sizeof(BeliefLogHeader))
+        return Replay::torn;   // created, header never written
+
+    BeliefLogHeader h;
+    std::memcpy(&h, m.data, sizeof(h));
+    if (std::memcmp(h.magic, LOG_MAGIC, sizeof(LOG_MAGIC)) != 0 ||
+        h.version != 1 || h.record_size != sizeof(BeliefLogRecord)) {
+        error = path + ": not a belief log segment";
+        return Replay::unreadable;
+    }
+    if (h.base_revision > store.revision()) {
+        error = path + ": revisions " + std::to_string(store.revision() + 1) + ".." +
+                std::to_string(h.base_revision) + " are missing";
+        return Replay::gap;
+    }
+
+    size_t at = sizeof(h);
+    good_bytes = at;
+
+    while (at < m.size) {
+        if (m.size - at < sizeof(BeliefLogRecord))
+            return Replay::torn;
+
+        BeliefLogRecord r;
+        std::memcpy(&r, m.data + at, sizeof(r));
+        const uint64_t n = uint64_t(r.subject_len) + r.component_len + r.context_len;
+        if (n > m.size - at - sizeof(r))
+            return Replay::torn;
+
+        const char* s = m.data + at + sizeof(r);
+        if (record_crc(r, s, n) != r.crc)
+            return Replay::torn;
+
+        if (r.revision == store.revision() + 1) {
+            store.commit(std::string_view(s + r.subject_len, r.component_len),
+                         std::string_view(s, r.subject_len),
+                         r.polarity != 0,
+                         std::string(s + r.subject_len + r.component_len, r.context_len));
+            ++recovery_.replayed;
+        } else if (r.revision > store.revision()) {
+            error = path + ": revision " + std::to_string(r.revision) + " follows " +
+                    std::to_string(store.revision());
+            return Replay::gap;
+        }
+
+        at += sizeof(r) + n;
+        good_bytes = at;
+    }
+    return Replay::intact;
+}
+
+// -----------------------------------------------------------------------------
+// Appending
+// -----------------------------------------------------------------------------
+bool BeliefLog::start_segment(uint64_t base, std::string& error)
+{
+    const std::string path = segment_path(base);
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0) {
+        error = path + ": " + std::strerror(errno);
+        return false;
+    }
+
+    BeliefLogHeader h;
+    h.base_revision = base;
+    if (::write(fd, &h, sizeof(h)) != ssize_t(sizeof(h)) || fdatasync(fd) < 0) {
+        error = path + ": " + std::strerror(errno);
+        ::close(fd);
+        return false;
+    }
+    sync_dir();
+
+    if (fd_ >= 0)
+        ::close(fd_);
+    fd_            = fd;
+    segment_base_  = base;
+    segment_bytes_ = sizeof(h);
+    return true;
+}
+
+void BeliefLog::close()
+{
+    if (fd_ < 0)
+        return;
+
+    std::string error;
+    sync(error);
+    ::close(fd_);
+    fd_ = -1;
+}
+
+void BeliefLog::append(const BeliefStore& store, uint64_t revision)
+{
+    const uint32_t id = store.written_by(revision);
+    const std::string& subject = store.subject(id);
+    const BeliefStore::Entry& e = store.entry(id);
+
+    BeliefLogRecord r;
+    r.subject_len   = uint32_t(subject.size());
+    r.revision      = revision;
+    r.component_len = uint32_t(e.component.size());
+    r.context_len   = uint32_t(e.context.size());
+    r.polarity      = e.polarity ? 1 : 0;
+
+    const size_t at = pending_.size();
+    pending_.append(reinterpret_cast<const char*>(&r), sizeof(r));
+    pending_ += subject;
+    pending_ += e.component;
+    pending_ += e.context;
+
+    r.crc = record_crc(r, pending_.data() + at + sizeof(r), pending_.size() - at - sizeof(r));
+    std::memcpy(pending_.data() + at, &r.crc, sizeof(r.crc));
+
+    ++pending_records_;
+    pending_revision_ = revision;
+
+    // bound the buffer between syncs; the fsync still waits for sync()
+    if (pending_.size() >= WRITE_AHEAD) {
+        std::string error;
+        if (!write_pending(error))
+            std::fprintf(stderr, "[BLS] %s\n", error.c_str());
+    }
+}
+
+bool BeliefLog::write_pending(std::string& error)
+{
+    size_t done = 0;
+    while (done < pending_.size()) {
+        const ssize_t n = ::write(fd_, pending_.data() + done, pending_.size() - done);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            error = segment_path(segment_base_) + ": " + std::strerror(errno);
+            pending_.erase(0, done);
+            return false;
+        }
+        done += size_t(n);
+    }
+
+    segment_bytes_ += done;
+    bytes_written_ += done;
+    pending_.clear();
+    return true;
+}
+
+size_t BeliefLog::sync(std::string& error)
+{
+    if (fd_ < 0 || pending_revision_ == durable_revision_)
+        return 0;
+
+    if (!write_pending(error))
+        return 0;
+    if (fdatasync(fd_) < 0) {
+        error = segment_path(segment_base_) + ": " + std::strerror(errno);
+        return 0;
+    }
+
+    const size_t n = pending_records_;
+    pending_records_  = 0;
+    durable_revision_ = pending_revision_;
+    return n;
+}
+
+// -----------------------------------------------------------------------------
+// Compaction
+// -----------------------------------------------------------------------------
+bool BeliefLog::due_for_snapshot() const
+{
+    return durable_revision_ - snapshot_revision_ >= options.snapshot_every ||
+           segment_bytes_ >= options.segment_bytes;
+}
+
+bool BeliefLog::snapshot(const BeliefStore& store, std::string& error)
+{
+    if (fd_ < 0)
+        return false;
+    sync(error);
+
+    const uint64_t revision = store.revision();
+    const std::string path  = snapshot_path(revision);
+    const std::string tmp   = path + ".tmp";
+
+    FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (!f) {
+        error = tmp + ": " + std::strerror(errno);
+        return false;
+    }
+    std::setvbuf(f, nullptr, _IOFBF, 1 << 20);
+
+    BeliefSnapshotHeader h;
+    h.revision = revision;
+    h.count    = store.size();
+    std::fwrite(&h, sizeof(h), 1, f);
+
+    uint32_t crc = 0;
+    auto put = [&](const void* data, size_t n) {
+        std::fwrite(data, 1, n, f);
+        crc = crc32(crc, data, n);
+    };
+
+    uint64_t offset = 0;
+    for (uint32_t id = 0; id < store.size(); ++id) {
+        const auto& e = store.entry(id);
+        BeliefSnapshotRecord r;
+        r.revision      = e.revision;
+        r.offset        = offset;
+        r.subject_len   = uint32_t(store.subject(id).size());
+        r.component_len = uint32_t(e.component.size());
+        r.context_len   = uint32_t(e.context.size());
+        r.polarity      = e.polarity ? 1 : 0;
+        put(&r, sizeof(r));
+        offset += uint64_t(r.subject_len) + r.component_len + r.context_len;
+    }
+    for (uint32_t id = 0; id < store.size(); ++id) {
+        const auto& e = store.entry(id);
+        const std::string& s = store.subject(id);
+        put(s.data(), s.size());
+        put(e.component.data(), e.component.size());
+        put(e.context.data(), e.context.size());
+    }
+
+    h.file_size = sizeof(h) + h.count * sizeof(BeliefSnapshotRecord) + offset;
+    h.crc       = crc32(crc, &h, sizeof(h));   // h.crc still 0
+    std::fseek(f, 0, SEEK_SET);
+    std::fwrite(&h, sizeof(h), 1, f);
+
+    const bool ok = std::fflush(f) == 0 && !std::ferror(f) && fdatasync(fileno(f)) == 0;
+    std::fclose(f);
+    if (!ok) {
+        error = tmp + ": " + std::strerror(errno);
+        std::remove(tmp.c_str());
+        return false;
+    }
+
+    // read it back before it can replace anything
+    {
+        Mapped m;
+        BeliefSnapshotHeader back;
+        if (!m.map(tmp, error) || !check_snapshot(m, tmp, back, error) ||
+            back.revision != revision) {
+            if (error.empty())
+                error = tmp + ": read back a different snapshot";
+            std::remove(tmp.c_str());
+            return false;
+        }
+    }
+
+    if (std::rename(tmp.c_str(), path.c_str()) < 0) {
+        error = tmp + ": " + std::strerror(errno);
+        std::remove(tmp.c_str());
+        return false;
+    }
+    sync_dir();
+
+    if (!start_segment(revision, error))
+        return false;
+
+    // The new snapshot and segment are durable. The previous snapshot and
+    // its segments stay as the fallback; only what came before it goes.
+    const uint64_t previous = snapshot_revision_;
+    for (uint64_t r : list(dir_, "snapshot-", ".mppbs"))
+        if (r < previous)
+            std::remove(snapshot_path(r).c_str());
+    for (uint64_t b : list(dir_, "log-", ".mppbl"))
+        if (b < previous)
+            std::remove(segment_path(b).c_str());
+
+    snapshot_revision_ = revision;
+    return true;
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "BeliefStore.hpp"
+
+#include <cstdint>
+#include <string>
+
+// -----------------------------------------------------------------------------
+// Durable belief log (BLS persistence)
+//
+// A directory holding the two newest snapshots and the log segments from
+// the older one on:
+//
+//     snapshot-<revision>.mppbs    every subject's latest belief at revision
+//     log-<base>.mppbl             revisions base+1, base+2, ... in order
+//
+// Log segment:   BeliefLogHeader { BeliefLogRecord, subject, component,
+//                                  context } ...
+// Snapshot:      BeliefSnapshotHeader, BeliefSnapshotRecord[count],
+//                string pool (subject, component, context per record),
+//                CRC32 over all of it in the header
+//
+// Beliefs are appended to a buffer as they are stored; sync() writes the
+// buffer and fdatasyncs once for everything gathered since the last call
+// (group commit: BLS calls it once per loop, so one fsync covers a whole
+// batch of datagrams). Every record carries a CRC32; a torn or corrupt
+// tail of the last segment is truncated at recovery. Anything else that
+// leaves revisions missing (a corrupt earlier segment, a gap between
+// segments) fails open() and leaves the directory as it was.
+//
+// snapshot() compacts: the store is written to a temporary file, fsynced,
+// read back and checked, then renamed into place, and a new segment starts
+// at its revision. The snapshot before it and its segments are kept, so a
+// newest snapshot that goes bad later falls back to them; only older ones
+// are deleted. Recovery maps the newest valid snapshot, restores it without
+// parsing, and replays only the segments after it, so startup is bounded
+// by subjects + snapshot_every, not total revisions.
+// -----------------------------------------------------------------------------
+struct BeliefLogHeader
+{
+    char     magic[8]      = { 'M', 'P', 'P', 'B', 'L', 'O', 'G', '\0' };
+    uint32_t version       = 1;
+    uint32_t record_size   = 32;   // sizeof(BeliefLogRecord)
+    uint64_t base_revision = 0;    // the first record is base_revision + 1
+};
+
+struct BeliefLogRecord
+{
+    uint32_t crc           = 0;    // CRC32 of the rest of the record + strings
+    uint32_t subject_len   = 0;
+    uint64_t revision      = 0;
+    uint32_t component_len = 0;
+    uint32_t context_len   = 0;
+    uint8_t  polarity      = 0;
+    uint8_t  pad[7]        = {};
+};
+
+struct BeliefSnapshotHeader
+{
+    char     magic[8]    = { 'M', 'P', 'P', 'B', 'S', 'N', 'P', '\0' };
+    uint32_t version     = 2;
+    uint32_t record_size = 32;     // sizeof(BeliefSnapshotRecord)
+    uint64_t revision    = 0;
+    uint64_t count       = 0;      // records
+    uint64_t file_size   = 0;
+    uint32_t crc         = 0;      // CRC32 of records + pool, then this header (crc 0)
+    uint32_t pad         = 0;
+};
+
+struct BeliefSnapshotRecord
+{
+    uint64_t revision      = 0;    // that last wrote the subject
+    uint64_t offset        = 0;    // of subject, component, context in the pool
+    uint32_t subject_len   = 0;
+    uint32_t component_len = 0;
+    uint32_t context_len   = 0;
+    uint8_t  polarity      = 0;
+    uint8_t  pad[3]        = {};
+};
+
+static_assert(sizeof(BeliefLogRecord) == 32);
+static_assert(sizeof(BeliefSnapshotRecord) == 32);
+
+class BeliefLog
+{
+public:
+    struct Options {
+        uint64_t snapshot_every = 1 << 18;    // revisions between snapshots
+        uint64_t segment_bytes  = 64 << 20;   // or a segment this large
+    };
+
+    struct Recovery {
+        uint64_t snapshot_revision = 0;
+        uint64_t subjects          = 0;       // restored from the snapshot
+        uint64_t replayed          = 0;       // log records applied after it
+        uint64_t torn_bytes        = 0;       // cut from the last segment
+        double   ms                = 0;
+    };
+
+    BeliefLog() = default;
+    BeliefLog(const BeliefLog&) = delete;
+    BeliefLog& operator=(const BeliefLog&) = delete;
+    ~BeliefLog() { close(); }
+
+    // Recovers dir into store (which must be empty) and opens the last
+    // segment for appending. Creates dir if needed. On error nothing in dir
+    // is changed, and store holds what was recovered before it.
+    bool open(const std::string& dir, BeliefStore& store, std::string& error);
+    void close();
+    bool is_open() const { return fd_ >= 0; }
+
+    // buffers the belief that wrote `revision` (already in store)
+    void append(const BeliefStore& store, uint64_t revision);
+
+    // group commit: writes what append() buffered and fdatasyncs it.
+    // Returns the records made durable, 0 if none were pending or on error.
+    size_t sync(std::string& error);
+
+    bool due_for_snapshot() const;
+    bool snapshot(const BeliefStore& store, std::string& error);
+
+    Options options;
+
+    const std::string& dir() const { return dir_; }
+    const Recovery&    recovery() const { return recovery_; }
+    uint64_t durable_revision() const { return durable_revision_; }
+    uint64_t snapshot_revision() const { return snapshot_revision_; }
+    uint64_t segment_base() const { return segment_base_; }
+    uint64_t segment_bytes() const { return segment_bytes_; }
+    uint64_t bytes_written() const { return bytes_written_; }
+
+private:
+    std::string dir_;
+    int         fd_ = -1;              // current segment, O_APPEND
+    std::string pending_;              // records not yet written
+    size_t      pending_records_  = 0;
+    uint64_t    pending_revision_ = 0; // last appended
+    uint64_t    durable_revision_ = 0;
+    uint64_t    snapshot_revision_ = 0;
+    uint64_t    segment_base_     = 0;
+    uint64_t    segment_bytes_    = 0;
+    uint64_t    bytes_written_    = 0;
+    Recovery    recovery_;
+
+    std::string snapshot_path(uint64_t revision) const;
+    std::string segment_path(uint64_t base) const;
+
+    bool load_snapshot(const std::string& path, BeliefStore& store, std::string& error);
+
+    enum class Replay {
+        intact,
+        torn,         // ends in a torn or corrupt record (good_bytes: the intact prefix)
+        gap,          // does not continue store
+        unreadable
+    };
+    // applies the records that continue store
+    Replay replay_segment(const std::string& path, BeliefStore& store, uint64_t& good_bytes,
+                          std::string& error);
+    bool start_segment(uint64_t base, std::string& error);
+    bool write_pending(std::string& error);
+    void sync_dir();
+};
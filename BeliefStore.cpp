@@ -0,0 +1,553 @@
+#include "BeliefStore.hpp"
+
+#include <algorithm>
+
+#include <nlohmann/json.hpp>
+
+uint32_t BeliefStore::intern(std::string_view subject)
+{
+    auto it = index_.find(subject);
+    if (it != index_.end())
+        return it->second;
+
+    const uint32_t id = static_cast<uint32_t>(subjects_.size());
+    subjects_.emplace_back(subject);
+    quoted_.push_back(nlohmann::json(subjects_.back()).dump());
+    entries_.emplace_back();
+    index_.emplace(subjects_.back(), id);
+
+    uint32_t node = 0;
+    for (size_t at = 0, dot; (dot = subject.find('.', at)) != std::string_view::npos; at = dot + 1) {
+        const std::string_view segment = subject.substr(at, dot - at);
+        auto child = namespaces_[node].children.find(segment);
+        if (child == namespaces_[node].children.end()) {
+            const uint32_t n = static_cast<uint32_t>(namespaces_.size());
+            namespaces_[node].children.emplace(std::string(segment), n);
+            namespaces_.emplace_back();
+            node = n;
+        } else {
+            node = child->second;
+        }
+        namespaces_[node].ids.push_back(id);
+    }
+    return id;
+}
+
+const std::vector<uint32_t>* BeliefStore::under(std::string_view prefix) const
+{
+    static const std::vector<uint32_t> none;
+
+    uint32_t node = 0;
+    for (size_t at = 0, dot; (dot = prefix.find('.', at)) != std::string_view::npos; at = dot + 1) {
+        auto child = namespaces_[node].children.find(prefix.substr(at, dot - at));
+        if (child == namespaces_[node].children.end())
+            return &none;
+        node = child->second;
+    }
+    return node ? &namespaces_[node].ids : nullptr;
+}
+
+int BeliefStore::find(std::string_view subject) const
+{
+    auto it = index_.find(subject);
+    return it == index_.end() ? -1 : static_cast<int>(it->second);
+}
+
+uint64_t BeliefStore::commit(std::string_view component, std::string_view subject,
+                             bool polarity, std::string context)
+{
+    const uint32_t id = intern(subject);
+
+    Entry& e = entries_[id];
+    const uint64_t prev = e.revision;
+
+    // first write since the log began: keep the value it replaces
+    if (prev && prev <= log_base_)
+        base_[id] = BaseValue{ prev, e.polarity, std::move(e.context) };
+
+    e.revision = ++revision_;
+    e.polarity = polarity;
+    if (e.component != component)
+        e.component.assign(component);
+    e.context = context.empty() ? "{}" : std::move(context);
+
+    log_.push_back(Version{ id, polarity, prev, e.context });
+
+    if (options.checkpoint_every && revision_ % options.checkpoint_every == 0) {
+        Checkpoint& cp = checkpoints_.emplace_back();
+        cp.revision = revision_;
+        cp.last.resize(entries_.size());
+        for (size_t i = 0; i < entries_.size(); ++i)
+            cp.last[i] = entries_[i].revision;
+    }
+
+    // the revision just written always stays (BeliefLog reads it back)
+    while (revision_ - log_base_ > std::max<uint64_t>(options.history, 1))
+        trim();
+
+    return revision_;
+}
+
+void BeliefStore::trim()
+{
+    Version& v = log_.front();
+    const uint64_t r = log_base_ + 1;
+
+    // r becomes the value before the log, needed only if written again since
+    if (entries_[v.subject].revision > r)
+        base_[v.subject] = BaseValue{ r, v.polarity, std::move(v.context) };
+    else
+        base_.erase(v.subject);
+
+    log_.pop_front();
+    log_base_ = r;
+
+    while (!checkpoints_.empty() && checkpoints_.front().revision < log_base_)
+        checkpoints_.pop_front();
+}
+
+void BeliefStore::restore(std::string_view component, std::string_view subject,
+                          bool polarity, std::string_view context, uint64_t revision)
+{
+    Entry& e = entries_[intern(subject)];
+    e.revision = revision;
+    e.polarity = polarity;
+    e.component.assign(component);
+    e.context.assign(context.empty() ? std::string_view("{}") : context);
+}
+
+void BeliefStore::rebase(uint64_t revision)
+{
+    revision_ = revision;
+    log_base_ = revision;
+    log_.clear();
+    base_.clear();
+    checkpoints_.clear();
+}
+
+// -----------------------------------------------------------------------------
+// History
+// -----------------------------------------------------------------------------
+uint64_t BeliefStore::written_as_of(uint32_t id, uint64_t r) const
+{
+    uint64_t w = entries_[id].revision;
+    while (w > r)
+        w = version(w).prev;   // w > r >= log_base_: still in the log
+    return w;
+}
+
+void BeliefStore::value_at(uint32_t id, uint64_t r, bool& polarity,
+                           const std::string*& context) const
+{
+    if (r == entries_[id].revision) {
+        polarity = entries_[id].polarity;
+        context  = &entries_[id].context;
+    } else if (r > log_base_) {
+        polarity = version(r).polarity;
+        context  = &version(r).context;
+    } else {
+        const BaseValue& b = base_.at(id);
+        polarity = b.polarity;
+        context  = &b.context;
+    }
+}
+
+std::vector<uint64_t> BeliefStore::revisions_as_of(uint64_t r) const
+{
+    std::vector<uint64_t> last(entries_.size(), 0);
+
+    // start from the nearest checkpoint at or before r, else the log's start
+    const Checkpoint* cp = nullptr;
+    for (auto it = checkpoints_.rbegin(); it != checkpoints_.rend(); ++it)
+        if (it->revision <= r) {
+            cp = &*it;
+            break;
+        }
+
+    uint64_t from = log_base_;
+    if (cp) {
+        std::copy(cp->last.begin(), cp->last.end(), last.begin());
+        from = cp->revision;
+    } else {
+        for (uint32_t id = 0; id < entries_.size(); ++id) {
+            if (entries_[id].revision <= log_base_)
+                last[id] = entries_[id].revision;
+            else if (auto b = base_.find(id); b != base_.end())
+                last[id] = b->second.revision;
+        }
+    }
+
+    for (uint64_t w = from + 1; w <= r; ++w)
+        last[version(w).subject] = w;
+    return last;
+}
+
+// -----------------------------------------------------------------------------
+// Queries
+// -----------------------------------------------------------------------------
+namespace
+{
+    // sorted, and without prefixes another one already covers (empty: all)
+    std::vector<std::string_view> disjoint(std::vector<std::string_view> prefixes)
+    {
+        std::sort(prefixes.begin(), prefixes.end());
+        std::vector<std::string_view> out;
+        for (std::string_view p : prefixes) {
+            if (p.empty())
+                return {};
+            if (out.empty() || !p.starts_with(out.back()))
+                out.push_back(p);
+        }
+        return out;
+    }
+
+    bool matches(std::string_view subject, const std::vector<std::string_view>& prefixes)
+    {
+        if (prefixes.empty())
+            return true;
+        for (std::string_view p : prefixes)
+            if (subject.starts_with(p))
+                return true;
+        return false;
+    }
+}
+
+template <typename F>
+void BeliefStore::select(const Query& q, const std::vector<uint64_t>* as_of, F&& f) const
+{
+    const std::vector<std::string_view> prefixes = disjoint(q.prefixes);
+
+    if (!as_of) {
+        if (q.since >= revision_)
+            return;
+
+        // A short tail: walk the log, taking each subject at its latest
+        // write only.
+        if (q.since >= log_base_ && q.since > 0 && revision_ - q.since < subjects_.size()) {
+            for (uint64_t r = q.since + 1; r <= revision_; ++r) {
+                const uint32_t id = written_by(r);
+                if (entries_[id].revision == r && matches(subjects_[id], prefixes))
+                    f(id, r);
+            }
+            return;
+        }
+    }
+
+    auto visit = [&](uint32_t id) {
+        const uint64_t r = as_of ? (*as_of)[id] : entries_[id].revision;
+        if (r > q.since)
+            f(id, r);
+    };
+
+    if (prefixes.empty()) {
+        for (uint32_t id = 0; id < subjects_.size(); ++id)
+            visit(id);
+        return;
+    }
+
+    // otherwise only the subjects under each prefix's namespace
+    for (std::string_view p : prefixes) {
+        if (const std::vector<uint32_t>* ids = under(p)) {
+            for (uint32_t id : *ids)
+                if (std::string_view(subjects_[id]).starts_with(p))
+                    visit(id);
+        } else {
+            for (uint32_t id = 0; id < subjects_.size(); ++id)
+                if (std::string_view(subjects_[id]).starts_with(p))
+                    visit(id);
+        }
+    }
+}
+
+static void append_prefixes(std::string& out, const std::vector<std::string_view>& prefixes)
+{
+    if (prefixes.empty())
+        return;
+
+    out += ",\"prefix\":";
+    if (prefixes.size() == 1) {
+        out += nlohmann::json(std::string(prefixes[0])).dump();
+        return;
+    }
+    out += '[';
+    for (size_t i = 0; i < prefixes.size(); ++i) {
+        if (i)
+            out += ',';
+        out += nlohmann::json(std::string(prefixes[i])).dump();
+    }
+    out += ']';
+}
+
+static void append_value(std::string& out, bool polarity, const std::string& context,
+                         uint64_t revision)
+{
+    out += polarity ? "{\"polarity\":true,\"context\":" : "{\"polarity\":false,\"context\":";
+    out += context;
+    out += ",\"revision\":";
+    out += std::to_string(revision);
+    out += '}';
+}
+
+size_t BeliefStore::snapshot_floor(const Query& q) const
+{
+    // Ids are handed out at a subject's first write (or its restore, at or
+    // before log_base_), so the ids below a checkpoint's size all existed
+    // at its revision and are in any state as of a later one.
+    const bool past = q.as_of < revision_;
+    size_t existed = subjects_.size();
+    if (past) {
+        if (q.since)
+            return 0;
+        existed = 0;
+        for (auto it = checkpoints_.rbegin(); it != checkpoints_.rend(); ++it)
+            if (it->revision <= q.as_of) {
+                existed = it->last.size();
+                break;
+            }
+    }
+
+    // shortest record per subject besides its name: "s":true in beliefs
+    // (and "s":0 in contexts), or a list object with an empty component
+    // and a one-character context
+    const size_t record = q.list ? 64 : q.contexts ? 7 : 5;
+    const size_t names  = q.list || !q.contexts ? 1 : 2;
+
+    Query now = q;
+    now.as_of = NOW;
+    size_t bytes = 0;
+    select(now, nullptr, [&](uint32_t id, uint64_t) {
+        if (id < existed)
+            bytes += names * quoted_[id].size() + record;
+    });
+    return bytes;
+}
+
+size_t BeliefStore::snapshot(const Query& q, std::string& out) const
+{
+    if (q.max_bytes != SIZE_MAX && snapshot_floor(q) > q.max_bytes)
+        return TOO_LARGE;
+
+    // as_of the current revision is just the current state
+    const bool past = q.as_of < revision_;
+    std::vector<uint64_t> as_of;
+    if (past)
+        as_of = revisions_as_of(q.as_of);
+
+    // serialization stops, and the reply is dropped, once past max_bytes
+    const size_t start = out.size();
+    bool over = false;
+    auto full = [&] {
+        over = over || out.size() - start > q.max_bytes;
+        return over;
+    };
+
+    out += "{\"component\":\"BLS\",\"revision\":";
+    out += std::to_string(revision_);
+    if (q.since) {
+        out += ",\"since_revision\":";
+        out += std::to_string(q.since);
+    }
+    if (q.as_of != NOW) {
+        out += ",\"as_of_revision\":";
+        out += std::to_string(q.as_of);
+    }
+    append_prefixes(out, q.prefixes);
+
+    size_t n = 0;
+    bool polarity = false;
+    const std::string* context = nullptr;
+
+    if (q.list) {
+        out += ",\"beliefs\":[";
+        select(q, past ? &as_of : nullptr, [&](uint32_t id, uint64_t r) {
+            if (full())
+                return;
+            value_at(id, r, polarity, context);
+            if (n++)
+                out += ',';
+            out += "{\"component\":";
+            out += nlohmann::json(entries_[id].component).dump();
+            out += ",\"subject\":";
+            out += quoted_[id];
+            out += polarity ? ",\"polarity\":true" : ",\"polarity\":false";
+            out += ",\"context\":";
+            out += *context;
+            out += ",\"revision\":";
+            out += std::to_string(r);
+            out += '}';
+        });
+        out += "]}";
+        if (full()) {
+            out.resize(start);
+            return TOO_LARGE;
+        }
+        return n;
+    }
+
+    out += ",\"beliefs\":{";
+    select(q, past ? &as_of : nullptr, [&](uint32_t id, uint64_t r) {
+        if (full())
+            return;
+        value_at(id, r, polarity, context);
+        if (n++)
+            out += ',';
+        out += quoted_[id];
+        out += polarity ? ":true" : ":false";
+    });
+    out += '}';
+
+    if (q.contexts) {
+        out += ",\"contexts\":{";
+        size_t k = 0;
+        select(q, past ? &as_of : nullptr, [&](uint32_t id, uint64_t r) {
+            if (full())
+                return;
+            value_at(id, r, polarity, context);
+            if (k++)
+                out += ',';
+            out += quoted_[id];
+            out += ':';
+            out += *context;
+        });
+        out += '}';
+    }
+
+    out += '}';
+    if (full()) {
+        out.resize(start);
+        return TOO_LARGE;
+    }
+    return n;
+}
+
+size_t BeliefStore::diff(uint64_t from, uint64_t to,
+                         const std::vector<std::string_view>& prefixes, std::string& out,
+                         size_t max_bytes) const
+{
+    // Every subject written in the range is counted at its shortest change,
+    // "s":{"from":null,"to":{"polarity":true,"context":0,"revision":1}},
+    // as it is found: once they cannot fit, the rest is neither looked for
+    // nor serialized.
+    const size_t start = out.size();
+    size_t floor = 0;
+    auto counted = [&](uint32_t id) {
+        floor += quoted_[id].size() + 62;
+        return floor <= max_bytes;
+    };
+
+    out += "{\"component\":\"BLS\",\"revision\":";
+    out += std::to_string(revision_);
+    out += ",\"from_revision\":";
+    out += std::to_string(from);
+    out += ",\"to_revision\":";
+    out += std::to_string(to);
+    append_prefixes(out, prefixes);
+    out += ",\"changes\":{";
+
+    // (subject, its revision at `from` (0: none), its revision at `to`),
+    // in order of the first write between them
+    struct Change {
+        uint32_t id;
+        uint64_t a, b;
+    };
+    std::vector<Change> changes;
+
+    // Subjects under the prefixes' namespaces, when following their own
+    // writes back from `to` (a random access per write, about
+    // (revision_ - from) / size() writes each) costs less than walking
+    // the range in order.
+    const std::vector<std::string_view> disjoint_prefixes = disjoint(prefixes);
+    std::vector<uint32_t> candidates;
+    bool indexed = !disjoint_prefixes.empty();
+    for (std::string_view p : disjoint_prefixes) {
+        const std::vector<uint32_t>* ids = under(p);
+        if (!ids || candidates.size() + ids->size() >= to - from) {
+            indexed = false;
+            break;
+        }
+        for (uint32_t id : *ids)
+            if (std::string_view(subjects_[id]).starts_with(p))
+                candidates.push_back(id);
+    }
+    if (indexed) {
+        const uint64_t writes = 1 + (revision_ - from) / std::max<size_t>(subjects_.size(), 1);
+        indexed = candidates.size() * writes * 4 < to - from;
+    }
+
+    if (indexed) {
+        // each candidate's own writes, followed back from `to`
+        std::vector<std::pair<uint64_t, Change>> found;
+        for (uint32_t id : candidates) {
+            const uint64_t b = written_as_of(id, to);
+            if (b <= from)
+                continue;
+            uint64_t first = b;
+            while (version(first).prev > from)
+                first = version(first).prev;
+            found.push_back({ first, Change{ id, version(first).prev, b } });
+            if (!counted(id)) {
+                out.resize(start);
+                return TOO_LARGE;
+            }
+        }
+        std::sort(found.begin(), found.end(),
+                  [](const auto& x, const auto& y) { return x.first < y.first; });
+        for (const auto& f : found)
+            changes.push_back(f.second);
+    } else {
+        // One pass over (from, to]: the first write of each subject there
+        // has its value at `from` as prev, the last one is its value at `to`.
+        std::vector<uint64_t> first_prev(entries_.size(), 0);
+        std::vector<uint64_t> last(entries_.size(), 0);
+        std::vector<uint32_t> order;
+        for (uint64_t r = from + 1; r <= to; ++r) {
+            const Version& v = version(r);
+            if (!last[v.subject]) {
+                if (!matches(subjects_[v.subject], prefixes))
+                    continue;
+                first_prev[v.subject] = v.prev;
+                order.push_back(v.subject);
+                if (!counted(v.subject)) {
+                    out.resize(start);
+                    return TOO_LARGE;
+                }
+            }
+            last[v.subject] = r;
+        }
+        for (uint32_t id : order)
+            changes.push_back(Change{ id, first_prev[id], last[id] });
+    }
+
+    size_t n = 0;
+    for (const auto& [id, a, b] : changes) {
+
+        bool pa = false, pb = false;
+        const std::string* ca = nullptr;
+        const std::string* cb = nullptr;
+        value_at(id, b, pb, cb);
+        if (a) {
+            value_at(id, a, pa, ca);
+            if (pa == pb && *ca == *cb)
+                continue;   // rewritten, but back where it was
+        }
+
+        if (n++)
+            out += ',';
+        out += quoted_[id];
+        out += ":{\"from\":";
+        if (a)
+            append_value(out, pa, *ca, a);
+        else
+            out += "null";
+        out += ",\"to\":";
+        append_value(out, pb, *cb, b);
+        out += '}';
+    }
+
+    out += "}}";
+    if (out.size() - start > max_bytes) {
+        out.resize(start);
+        return TOO_LARGE;
+    }
+    return n;
+}
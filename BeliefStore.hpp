@@ -0,0 +1,189 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// Belief store (BLS memory)
+//
+// The latest belief per subject, and the revision that wrote it. Subjects
+// are interned to dense ids on first commit and never forgotten: a hash map
+// finds the id, and everything else is a vector indexed by it.
+//
+// Every accepted belief is one revision. The revision log records what each
+// revision wrote, so "what changed since R" walks only the tail of the log
+// instead of every subject.
+//
+// The log is also the history: the last `history` revisions are kept
+// (older ones are folded into the values as of the oldest, and only for
+// subjects written since), with a checkpoint every `checkpoint_every`
+// revisions holding the revision that last wrote each subject. The state
+// as of R is the checkpoint before R plus at most one interval of log; a
+// diff R1..R2 walks only the revisions between them. After recovery the
+// history starts at the restored revision.
+//
+// Subjects are namespaced by dots (NET.*, FSM.XFR.*): every namespace of a
+// subject lists it, so a prefix query visits only the subjects under the
+// deepest complete namespace of the prefix ("FSM.XFR." or, for "NET.rx",
+// "NET.") instead of every subject. A prefixed diff follows those
+// subjects' own writes back when that costs less than walking the range.
+//
+// Subjects are kept JSON-quoted and contexts serialized, exactly as they
+// go out, so a snapshot is string appends and no json tree is built.
+// -----------------------------------------------------------------------------
+class BeliefStore
+{
+public:
+    static constexpr uint64_t NOW = UINT64_MAX;
+    static constexpr size_t   TOO_LARGE = SIZE_MAX;   // snapshot / diff: refused
+
+    struct Entry {
+        uint64_t    revision = 0;     // 0: never committed
+        bool        polarity = false;
+        std::string component;
+        std::string context;          // serialized JSON ("{}" when none)
+    };
+
+    struct Query {
+        uint64_t         since    = 0;      // only subjects written after it
+        uint64_t         as_of    = NOW;    // as they were at this revision
+        std::vector<std::string_view> prefixes;   // only subjects starting with one
+        bool             contexts = false;  // add "contexts"
+        bool             list     = false;  // HUD form: beliefs as an array
+        size_t           max_bytes = SIZE_MAX;   // refuse a longer reply
+    };
+
+    struct Options {
+        uint64_t history          = 1 << 20;   // revisions kept for as_of / diff
+        uint64_t checkpoint_every = 1 << 16;
+    };
+
+    Options options;
+
+    // returns the new revision
+    uint64_t commit(std::string_view component, std::string_view subject,
+                    bool polarity, std::string context);
+
+    uint64_t revision() const { return revision_; }
+    size_t   size() const { return subjects_.size(); }
+
+    // ---- recovery (BeliefLog) ----
+    // a subject's latest belief as of `revision`, not logged
+    void restore(std::string_view component, std::string_view subject,
+                 bool polarity, std::string_view context, uint64_t revision);
+    // continue from `revision`; the log starts over after it
+    void rebase(uint64_t revision);
+    uint64_t log_base() const { return log_base_; }
+
+    int                find(std::string_view subject) const;   // -1: unknown
+    const std::string& subject(uint32_t id) const { return subjects_[id]; }
+    const Entry&       entry(uint32_t id) const { return entries_[id]; }
+
+    // subject written by revision r (log_base() < r <= revision())
+    uint32_t written_by(uint64_t r) const { return version(r).subject; }
+
+    // revisions as_of / diff can address: log_base() .. revision()
+    bool in_history(uint64_t r) const { return r >= log_base_ && r <= revision_; }
+
+    // Appends a GET beliefs reply to out:
+    //   {"component":"BLS","revision":N[,"since_revision":R][,"as_of_revision":A]
+    //    [,"prefix":P|[P,...]],"beliefs":{subject:polarity,...}[,"contexts":{...}]}
+    // or, with list, "beliefs":[{"component","subject","polarity","context",
+    // "revision"},...]. as_of must be in_history(). Returns the number of
+    // subjects included, or TOO_LARGE (out as it was) for a reply longer
+    // than q.max_bytes: refused before any history is read when the
+    // subjects it certainly covers are already too many, else as soon as
+    // serialization passes it.
+    size_t snapshot(const Query& q, std::string& out) const;
+
+    // Appends a diff reply to out, for subjects whose polarity or context
+    // differ between from and to (both in_history(), from <= to):
+    //   {"component":"BLS","revision":N,"from_revision":R1,"to_revision":R2
+    //    [,"prefix":P|[P,...]],"changes":{subject:{"from":{"polarity","context",
+    //    "revision"} or null,"to":{...}},...}}
+    // Returns the number of subjects included, or TOO_LARGE (out as it
+    // was) once the subjects written between from and to could not fit
+    // max_bytes: the walk stops there, before serializing. Subjects
+    // rewritten back to their value at `from` count too, so a range of
+    // mostly undone writes may be refused although its diff would fit.
+    size_t diff(uint64_t from, uint64_t to, const std::vector<std::string_view>& prefixes,
+                std::string& out, size_t max_bytes = SIZE_MAX) const;
+
+private:
+    struct SubjectHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view s) const
+        {
+            return std::hash<std::string_view>{}(s);
+        }
+    };
+
+    // what one revision wrote
+    struct Version {
+        uint32_t    subject  = 0;
+        bool        polarity = false;
+        uint64_t    prev     = 0;     // revision that wrote the subject before (0: none)
+        std::string context;
+    };
+
+    // a subject's value from before the log: written at or before
+    // log_base_, then written again since
+    struct BaseValue {
+        uint64_t    revision = 0;
+        bool        polarity = false;
+        std::string context;
+    };
+
+    struct Checkpoint {
+        uint64_t              revision = 0;
+        std::vector<uint64_t> last;   // id -> revision that last wrote it (0: none)
+    };
+
+    std::unordered_map<std::string, uint32_t, SubjectHash, std::equal_to<>> index_;
+    std::vector<std::string> subjects_;   // id -> subject
+    std::vector<std::string> quoted_;     // id -> "subject", escaped
+    std::vector<Entry>       entries_;    // id -> latest belief
+    std::deque<Version>      log_;        // revision - 1 - log_base_ -> what it wrote
+    uint64_t                 log_base_ = 0;
+    uint64_t                 revision_ = 0;
+
+    std::unordered_map<uint32_t, BaseValue> base_;
+    std::deque<Checkpoint>                  checkpoints_;
+
+    // "FSM.XFR.start" is listed under FSM and FSM.XFR
+    struct Namespace {
+        std::unordered_map<std::string, uint32_t, SubjectHash, std::equal_to<>> children;
+        std::vector<uint32_t> ids;   // every subject below it, in id order
+    };
+    std::vector<Namespace> namespaces_ = std::vector<Namespace>(1);   // [0]: root
+
+    uint32_t intern(std::string_view subject);
+
+    // the subjects a prefix can match: those under its deepest complete
+    // namespace (nullptr: every subject)
+    const std::vector<uint32_t>* under(std::string_view prefix) const;
+    void     trim();   // drops the oldest logged revision
+
+    const Version& version(uint64_t r) const { return log_[r - 1 - log_base_]; }
+
+    // the revision that last wrote id as of r (0: none), and its value
+    uint64_t written_as_of(uint32_t id, uint64_t r) const;
+    void     value_at(uint32_t id, uint64_t r, bool& polarity, const std::string*& context) const;
+
+    // id -> revision that last wrote it, as of r
+    std::vector<uint64_t> revisions_as_of(uint64_t r) const;
+
+    // bytes q's reply takes at least, from the subjects it certainly
+    // covers (0 when that is unknown without reading history)
+    size_t snapshot_floor(const Query& q) const;
+
+    // subject ids a query covers, in output order, with the revision each
+    // is reported at (as_of: revisions_as_of(q.as_of) for a past state)
+    template <typename F>
+    void select(const Query& q, const std::vector<uint64_t>* as_of, F&& f) const;
+};
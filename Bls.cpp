@@ -0,0 +1,250 @@
+#include "Bls.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+using json = nlohmann::ordered_json;
+
+Bls::Bls(int sba)
+    : mpp::Component<Bls>(sba)
+{
+    if (const char* history = std::getenv("MPP_BLS_HISTORY"))
+        store_.options.history = std::strtoull(history, nullptr, 10);
+
+    if (const char* dir = std::getenv("MPP_BLS_DIR"))
+        open_log(dir);
+}
+
+void Bls::open_log(const char* dir)
+{
+    if (const char* every = std::getenv("MPP_BLS_SNAPSHOT_EVERY"))
+        log_.options.snapshot_every = std::max<uint64_t>(1, std::strtoull(every, nullptr, 10));
+
+    std::string error;
+    if (!log_.open(dir, store_, error)) {
+        std::cerr << "[MPP] BLS log: " << error << " (not durable)" << std::endl;
+        return;
+    }
+
+    const auto& r = log_.recovery();
+    std::cout << "[MPP] BLS recovered revision " << store_.revision()
+              << " from " << dir << ": snapshot " << r.snapshot_revision
+              << " (" << r.subjects << " subjects) + " << r.replayed << " replayed";
+    if (r.torn_bytes)
+        std::cout << ", " << r.torn_bytes << " torn bytes cut";
+    std::cout << ", " << r.ms << " ms" << std::endl;
+}
+
+void Bls::on_message(const json& j)
+{
+    if (!j.is_object())
+        return;
+
+    if (j.contains("belief")) {
+        store_belief(j);
+        return;
+    }
+
+    if (j.value("verb", "") == "GET" && j.value("resource", "") == "beliefs") {
+        reply_snapshot(j, false);
+        return;
+    }
+
+    if (j.value("verb", "") == "GET" && j.value("resource", "") == "diff") {
+        reply_diff(j);
+        return;
+    }
+
+    if (j.value("verb", "") == "GET" && j.value("resource", "") == "persistence") {
+        reply_persistence();
+        return;
+    }
+
+    if (j.value("read", false))
+        reply_snapshot(j, true);
+}
+
+// group commit: one fsync for every belief stored since the last loop
+void Bls::on_idle()
+{
+    if (!log_.is_open())
+        return;
+
+    std::string error;
+    const uint64_t t0 = mpp::now_ns();
+    if (const size_t n = log_.sync(error)) {
+        log_sync_ns_.record(mpp::now_ns() - t0);
+        log_group_.record(n);
+    } else if (!error.empty()) {
+        log_errors_.add();
+        std::cerr << "[MPP] BLS log: " << error << std::endl;
+    }
+
+    if (log_.due_for_snapshot()) {
+        const uint64_t t1 = mpp::now_ns();
+        if (log_.snapshot(store_, error)) {
+            snapshots_total_.add();
+            snapshot_write_ns_.record(mpp::now_ns() - t1);
+        } else {
+            log_errors_.add();
+            std::cerr << "[MPP] BLS snapshot: " << error << std::endl;
+        }
+    }
+}
+
+void Bls::on_metrics()
+{
+    subjects_gauge_.set(static_cast<int64_t>(store_.size()));
+    revision_gauge_.set(static_cast<int64_t>(store_.revision()));
+    durable_gauge_.set(static_cast<int64_t>(log_.durable_revision()));
+}
+
+// -----------------------------------------------------------------------------
+// Write side
+// -----------------------------------------------------------------------------
+void Bls::store_belief(const json& j)
+{
+    const json& b = j["belief"];
+    if (!b.is_object() || j.value("_via", "") == "BLS" || b.value("_via", "") == "BLS") {
+        ignored_total_.add();
+        return;
+    }
+
+    const auto subject = b.find("subject");
+    if (subject == b.end() || !subject->is_string() || subject->get_ref<const std::string&>().empty()) {
+        ignored_total_.add();
+        return;
+    }
+
+    const auto context = b.find("context");
+    const uint64_t revision = store_.commit(b.value("component", ""),
+                  subject->get_ref<const std::string&>(),
+                  b.value("polarity", true),
+                  context != b.end() && !context->is_null() ? context->dump() : std::string());
+    beliefs_total_.add();
+
+    if (log_.is_open())
+        log_.append(store_, revision);
+}
+
+// -----------------------------------------------------------------------------
+// Read side
+// -----------------------------------------------------------------------------
+
+// "prefix": "NET." or ["NET.", "FSM.XFR."], viewed in place
+static std::vector<std::string_view> prefixes_of(const json& j)
+{
+    std::vector<std::string_view> out;
+    const auto it = j.find("prefix");
+    if (it == j.end())
+        return out;
+
+    if (it->is_string())
+        out.push_back(it->get_ref<const std::string&>());
+    else if (it->is_array())
+        for (const auto& p : *it)
+            if (p.is_string())
+                out.push_back(p.get_ref<const std::string&>());
+    return out;
+}
+
+void Bls::reply_snapshot(const json& j, bool list)
+{
+    BeliefStore::Query q;
+    q.since     = j.value("since_revision", uint64_t(0));
+    q.as_of     = j.value("as_of_revision", BeliefStore::NOW);
+    q.prefixes  = prefixes_of(j);
+    q.contexts  = j.value("contexts", false);
+    q.list      = list;
+    q.max_bytes = MAX_REPLY - 1;   // and the newline
+
+    if (q.as_of != BeliefStore::NOW && !store_.in_history(q.as_of)) {
+        reply_not_in_history(q.as_of);
+        return;
+    }
+
+    const uint64_t t0 = mpp::now_ns();
+    reply_buf_.clear();
+    const size_t n = store_.snapshot(q, reply_buf_);
+    reply_buf_ += '\n';
+    (q.as_of == BeliefStore::NOW ? snapshot_ns_ : history_ns_).record(mpp::now_ns() - t0);
+    if (n != BeliefStore::TOO_LARGE)
+        snapshot_subjects_.record(n);
+
+    send_reply(n);
+}
+
+void Bls::reply_diff(const json& j)
+{
+    const uint64_t from = j.value("from_revision", store_.log_base());
+    const uint64_t to   = j.value("to_revision", store_.revision());
+
+    if (!store_.in_history(from) || !store_.in_history(to) || from > to) {
+        reply_not_in_history(store_.in_history(from) ? to : from);
+        return;
+    }
+
+    const uint64_t t0 = mpp::now_ns();
+    reply_buf_.clear();
+    const size_t n = store_.diff(from, to, prefixes_of(j), reply_buf_, MAX_REPLY - 1);
+    reply_buf_ += '\n';
+    history_ns_.record(mpp::now_ns() - t0);
+
+    send_reply(n);
+}
+
+void Bls::send_reply(size_t subjects)
+{
+    if (subjects == BeliefStore::TOO_LARGE) {
+        oversize_total_.add();
+
+        json err;
+        err["component"] = "BLS";
+        err["revision"]  = store_.revision();
+        err["error"]     = "snapshot too large";
+        err["max_bytes"] = MAX_REPLY;
+        reply_json(err);
+        return;
+    }
+
+    reply_bytes(reply_buf_);
+}
+
+void Bls::reply_not_in_history(uint64_t revision)
+{
+    json err;
+    err["component"]       = "BLS";
+    err["revision"]        = store_.revision();
+    err["error"]           = "revision not in history";
+    err["asked"]           = revision;
+    err["oldest_revision"] = store_.log_base();
+    reply_json(err);
+}
+
+void Bls::reply_persistence()
+{
+    json r;
+    r["component"] = "BLS";
+    r["revision"]  = store_.revision();
+    r["durable"]   = log_.is_open();
+
+    if (log_.is_open()) {
+        const auto& rec = log_.recovery();
+        r["dir"]               = log_.dir();
+        r["durable_revision"]  = log_.durable_revision();
+        r["snapshot_revision"] = log_.snapshot_revision();
+        r["snapshot_every"]    = log_.options.snapshot_every;
+        r["segment_base"]      = log_.segment_base();
+        r["segment_bytes"]     = log_.segment_bytes();
+        r["recovery"] = {
+            {"snapshot_revision", rec.snapshot_revision},
+            {"subjects",          rec.subjects},
+            {"replayed",          rec.replayed},
+            {"torn_bytes",        rec.torn_bytes},
+            {"ms",                rec.ms}
+        };
+    }
+
+    reply_json(r);
+}
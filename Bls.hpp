@@ -0,0 +1,105 @@
+#pragma once
+
+#include "BeliefLog.hpp"
+#include "BeliefStore.hpp"
+#include "Component.hpp"
+
+#include <string>
+
+using json = nlohmann::ordered_json;
+
+// -----------------------------------------------------------------------------
+// BLS: belief memory (BeliefBasedArchitecture.md, section 7)
+//
+// Stores the latest belief per subject from every {"belief":{...}} on the
+// bus (except those with _via "BLS") and counts revisions. Snapshots:
+//
+//   {"verb":"GET","resource":"beliefs"}          what Fsm::poll_bls() asks:
+//       [,"contexts":true]                       {"revision","beliefs":{s:bool}
+//       [,"since_revision":R]                     [,"contexts":{s:{...}}]}
+//       [,"prefix":"NET." | ["NET.","FSM.XFR."]]
+//       [,"as_of_revision":A]
+//   {"read":true[,"since_revision":R][,...]}    HUD: "beliefs" as a list of
+//                                                full belief objects
+//   {"verb":"GET","resource":"diff",            subjects that differ between
+//    "from_revision":R1,"to_revision":R2         R1 and R2: {"changes":{s:
+//    [,"prefix":"NET."]}                         {"from":{...}|null,"to":{...}}}}
+//
+// since_revision returns only subjects written after R (their latest
+// value); a reader that keeps the last revision it saw stays current with
+// deltas. as_of_revision answers as BLS would have at revision A; it and
+// diff reach back MPP_BLS_HISTORY revisions (default 1M), and older ones
+// are answered with {"error":"revision not in history","oldest_revision"}.
+// A reply must fit one datagram: one that would not is answered with
+// {"error":"snapshot too large","max_bytes"} and the reader should narrow
+// it. BeliefStore refuses it as soon as that is certain, before reading
+// history when it can, so an oversize query does not hold up commits.
+//
+// With MPP_BLS_DIR=<dir> the store is durable (BeliefLog.hpp): recovered
+// from <dir> at startup, every belief logged, one fsync per loop for all
+// beliefs received in it, and a compacted snapshot every
+// MPP_BLS_SNAPSHOT_EVERY revisions. A <dir> that cannot be recovered in
+// full (revisions missing) is left as it is and BLS runs without it.
+// {"verb":"GET","resource":"persistence"} reports the log and the last
+// recovery.
+// -----------------------------------------------------------------------------
+class Bls : public mpp::Component<Bls>
+{
+public:
+    explicit Bls(int sba);
+
+    // MPP interface
+    void apply_snapshot(const json&) {}
+    void on_message(const json& j);
+    void on_idle();
+    void on_metrics();
+
+protected:
+    const char* component_name() const override { return "BLS"; }
+
+private:
+    static constexpr size_t MAX_REPLY = 65507;   // UDP over IPv4
+
+    BeliefStore store_;
+    BeliefLog   log_;
+    std::string reply_buf_;
+
+    void open_log(const char* dir);
+    void store_belief(const json& j);
+    void reply_snapshot(const json& j, bool list);
+    void reply_diff(const json& j);
+    void reply_not_in_history(uint64_t revision);
+    void send_reply(size_t subjects);   // reply_buf_, or TOO_LARGE's error
+    void reply_persistence();
+
+    mpp::Counter&   beliefs_total_ =
+        metrics_.counter("bls_beliefs_total", "Beliefs stored (one revision each)");
+    mpp::Counter&   ignored_total_ =
+        metrics_.counter("bls_ignored_total", "Beliefs ignored: _via BLS or no subject");
+    mpp::Counter&   oversize_total_ =
+        metrics_.counter("bls_oversize_total", "Snapshots refused: larger than a datagram");
+    mpp::Histogram& snapshot_ns_ =
+        metrics_.histogram("bls_snapshot_ns", "Snapshot serialization time (ns)");
+    mpp::Histogram& history_ns_ =
+        metrics_.histogram("bls_history_ns", "as_of_revision / diff query time (ns)");
+    mpp::Histogram& snapshot_subjects_ =
+        metrics_.histogram("bls_snapshot_subjects", "Subjects per snapshot reply");
+    mpp::Gauge&     subjects_gauge_ =
+        metrics_.gauge("bls_subjects", "Distinct subjects ever committed");
+    mpp::Gauge&     revision_gauge_ =
+        metrics_.gauge("bls_revision", "Current revision");
+
+    // persistence (MPP_BLS_DIR)
+    mpp::Histogram& log_sync_ns_ =
+        metrics_.histogram("bls_log_sync_ns", "Log write + fdatasync per group commit (ns)");
+    mpp::Histogram& log_group_ =
+        metrics_.histogram("bls_log_group", "Beliefs made durable per fsync");
+    mpp::Counter&   log_errors_ =
+        metrics_.counter("bls_log_errors_total", "Failed log writes, syncs or snapshots");
+    mpp::Counter&   snapshots_total_ =
+        metrics_.counter("bls_log_snapshots_total", "Compacted snapshots written");
+    mpp::Histogram& snapshot_write_ns_ =
+        metrics_.histogram("bls_log_snapshot_ns", "Compacted snapshot write time (ns)");
+    mpp::Gauge&     durable_gauge_ =
+        metrics_.gauge("bls_durable_revision", "Last revision known to be on disk");
+};
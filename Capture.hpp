@@ -0,0 +1,164 @@
+// Capture.hpp
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace mpp {
+
+// -----------------------------------------------------------------------------
+// Input capture (record and replay)
+//
+// A capture log is every datagram a component received, in arrival order,
+// as the socket delivered it:
+//
+//     CaptureHeader
+//     { CaptureRecord, char payload[record.bytes] } ...
+//
+// Records are appended through a large stdio buffer, flushed when the
+// component's loop goes idle, so capturing costs one memcpy per datagram.
+// tools/replay.cpp feeds a log back through Component::inject().
+// -----------------------------------------------------------------------------
+struct CaptureHeader
+{
+    char     magic[8]    = { 'M', 'P', 'P', 'C', 'A', 'P', 'T', '\0' };
+    uint32_t version     = 1;
+    uint32_t record_size = 24;     // sizeof(CaptureRecord)
+};
+
+struct CaptureRecord
+{
+    uint64_t ns    = 0;     // mpp::now_ns() on receipt
+    uint32_t addr  = 0;     // sender IPv4, host order (destination in a replay's output)
+    uint16_t port  = 0;     // sender port, host order
+    uint16_t sba   = 0;     // port of the component that captured it
+    uint32_t bytes = 0;     // payload that follows
+    uint32_t pad   = 0;
+};
+
+static_assert(sizeof(CaptureRecord) == 24);
+
+class CaptureWriter
+{
+public:
+    CaptureWriter() = default;
+    CaptureWriter(const CaptureWriter&) = delete;
+    CaptureWriter& operator=(const CaptureWriter&) = delete;
+    ~CaptureWriter() { close(); }
+
+    bool open(const std::string& path, std::string& error)
+    {
+        close();
+
+        file_ = std::fopen(path.c_str(), "wb");
+        if (!file_) {
+            error = path + ": " + std::strerror(errno);
+            return false;
+        }
+        std::setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+
+        const CaptureHeader h;
+        std::fwrite(&h, sizeof(h), 1, file_);
+        path_    = path;
+        records_ = 0;
+        bytes_   = sizeof(h);
+        return true;
+    }
+
+    void close()
+    {
+        if (file_)
+            std::fclose(file_);
+        file_ = nullptr;
+    }
+
+    bool is_open() const { return file_ != nullptr; }
+
+    void append(uint64_t ns, uint32_t addr, uint16_t port, uint16_t sba,
+                std::string_view payload)
+    {
+        CaptureRecord r;
+        r.ns    = ns;
+        r.addr  = addr;
+        r.port  = port;
+        r.sba   = sba;
+        r.bytes = static_cast<uint32_t>(payload.size());
+
+        std::fwrite(&r, sizeof(r), 1, file_);
+        std::fwrite(payload.data(), 1, payload.size(), file_);
+        ++records_;
+        bytes_ += sizeof(r) + payload.size();
+    }
+
+    void flush()
+    {
+        if (file_)
+            std::fflush(file_);
+    }
+
+    const std::string& path() const { return path_; }
+    uint64_t records() const { return records_; }
+    uint64_t bytes()   const { return bytes_; }
+
+private:
+    std::FILE*  file_ = nullptr;
+    std::string path_;
+    uint64_t    records_ = 0;
+    uint64_t    bytes_   = 0;
+};
+
+class CaptureReader
+{
+public:
+    CaptureReader() = default;
+    CaptureReader(const CaptureReader&) = delete;
+    CaptureReader& operator=(const CaptureReader&) = delete;
+    ~CaptureReader()
+    {
+        if (file_)
+            std::fclose(file_);
+    }
+
+    bool open(const std::string& path, std::string& error)
+    {
+        file_ = std::fopen(path.c_str(), "rb");
+        if (!file_) {
+            error = path + ": " + std::strerror(errno);
+            return false;
+        }
+        std::setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+
+        CaptureHeader h;
+        if (std::fread(&h, sizeof(h), 1, file_) != 1 ||
+            std::memcmp(h.magic, CaptureHeader{}.magic, sizeof(h.magic)) != 0 ||
+            h.version != 1 || h.record_size != sizeof(CaptureRecord)) {
+            error = path + ": not a capture log";
+            return false;
+        }
+        return true;
+    }
+
+    // false at the end; a record cut short (capture killed mid-write)
+    // also ends the log
+    bool next(CaptureRecord& r, std::string& payload)
+    {
+        if (std::fread(&r, sizeof(r), 1, file_) != 1)
+            return false;
+        payload.resize(r.bytes);
+        return std::fread(payload.data(), 1, r.bytes, file_) == r.bytes;
+    }
+
+    void rewind()
+    {
+        std::fseek(file_, sizeof(CaptureHeader), SEEK_SET);
+    }
+
+private:
+    std::FILE* file_ = nullptr;
+};
+
+} // namespace mpp
@@ -2,26 +2,79 @@
 
 #include <atomic>
 #include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <set>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <time.h>
 
 #include <nlohmann/json.hpp>
 
 #include "Belief.hpp"
+#include "Capture.hpp"
+#include "Metrics.hpp"
+#include "Trace.hpp"
 
 namespace mpp
 {
     static constexpr int BLS_PORT = 4000;
     using json = nlohmann::ordered_json;
 
+    // Set by a Simulation (Sim.hpp) to its virtual clock; components
+    // created while it is set get no socket.
+    inline const uint64_t* virtual_clock_ns = nullptr;
+
+    // Monotonic clock for timers and measurements (ns)
+    inline uint64_t now_ns()
+    {
+        if (virtual_clock_ns)
+            return *virtual_clock_ns;
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
     // -----------------------------------------------------------------------------
     // Component (UDP control + belief commit capable)
+    //
+    // Every component answers {"verb":"GET","resource":"metrics"} itself
+    // (the request never reaches the derived class) with its metrics_ in
+    // the Prometheus text format; derived classes register their own there.
+    //
+    // Likewise for tracing (Trace.hpp), off unless MPP_TRACE is set:
+    //   {"verb":"PUT","resource":"trace","enable":true|false}
+    //   {"verb":"GET","resource":"trace","path":"/tmp/fsm.trace"}
+    //
+    // The socket asks the kernel for receive timestamps (SO_TIMESTAMPNS), so
+    // mpp_queue_delay_ns{type=...} shows how long each kind of message sat
+    // between arriving and reaching its handler: socket queue plus the
+    // loop's sleep and whatever was handled before it.
+    //
+    // Input capture (Capture.hpp) logs every datagram received, for replay:
+    //   MPP_CAPTURE=<dir>  captures from the start to <dir>/<name>-<sba>.mppcap
+    //   {"verb":"PUT","resource":"capture","path":"/tmp/fsm.mppcap"}
+    //   {"verb":"PUT","resource":"capture","enable":false}
+    //
+    // A component whose registers an Fsm mirrors (Fsm.hpp) defines
+    // json serialize_registers() const, and Component publishes them:
+    //   {"verb":"POST","resource":"registers","action":"subscribe"|"unsubscribe"
+    //    [,"sba":N]}
+    // gets the subscriber a full snapshot at once and every
+    // publish_period_ms_, and a delta of the changed registers whenever the
+    // derived class called registers_changed() (sent from its on_idle() by
+    // publish_registers()). The revision counts changes, so a subscriber can
+    // tell a lost delta from a duplicate.
     // -----------------------------------------------------------------------------
     template <typename Derived>
     class Component
@@ -30,9 +83,27 @@ namespace mpp
         explicit Component(int sba)
             : sba_(sba),
               running_(true),
-              udp_fd_(-1)
+              udp_fd_(-1),
+              rx_datagrams_(metrics_.counter("mpp_rx_datagrams_total", "Datagrams received")),
+              rx_bytes_(metrics_.counter("mpp_rx_bytes_total", "Bytes received")),
+              rx_bad_(metrics_.counter("mpp_rx_parse_errors_total", "Datagrams that were not JSON")),
+              rx_batch_(metrics_.histogram("mpp_rx_batch", "Datagrams handled per loop iteration")),
+              parse_ns_(metrics_.histogram("mpp_parse_ns", "JSON parse time per datagram (ns)")),
+              handler_ns_(metrics_.histogram("mpp_handler_ns", "apply_snapshot + on_message time (ns)")),
+              tx_datagrams_(metrics_.counter("mpp_tx_datagrams_total", "Datagrams sent")),
+              tx_bytes_(metrics_.counter("mpp_tx_bytes_total", "Bytes sent")),
+              tx_errors_(metrics_.counter("mpp_tx_errors_total", "Sends that failed or were short")),
+              send_json_ns_(metrics_.histogram("mpp_send_json_ns", "send_json serialize + send time (ns)")),
+              commits_(metrics_.counter("mpp_commits_total", "Beliefs committed")),
+              commits_rejected_(metrics_.counter("mpp_commits_rejected_total",
+                                                 "Commits refused (foreign prefix or repeat)")),
+              commit_ns_(metrics_.histogram("mpp_commit_ns", "commit time (ns)")),
+              committed_gauge_(metrics_.gauge("mpp_committed_beliefs", "Beliefs in the committed set")),
+              uptime_(metrics_.gauge("mpp_uptime_seconds", "Seconds since the component started")),
+              started_ns_(now_ns())
         {
-            setup_udp();
+            if (!virtual_clock_ns)
+                setup_udp();
         }
 
         virtual ~Component()
@@ -47,13 +118,46 @@ namespace mpp
             std::cout << "[MPP] running " << component_name()
                       << " on sba=" << sba_ << std::endl;
 
+            if (const char* dir = std::getenv("MPP_CAPTURE")) {
+                const std::string path = std::string(dir) + "/" + component_name() +
+                                         "-" + std::to_string(sba_) + ".mppcap";
+                std::string error;
+                if (!capture_.open(path, error))
+                    std::cerr << "[MPP] capture: " << error << std::endl;
+            }
+
             while (running_)
             {
-                poll_socket();
+                // Drain what is queued (bounded) before sleeping, so a host
+                // with many instances is not limited to one datagram per ms.
+                int handled = 0;
+                while (handled < max_batch_ && poll_socket())
+                    ++handled;
+                if (handled) {
+                    rx_batch_.record(handled);
+                    capture_.flush();
+                }
+
+                // optional per-iteration hook (timers and the like)
+                if constexpr (requires(Derived& d) { d.on_idle(); })
+                    static_cast<Derived*>(this)->on_idle();
+
                 usleep(1000);
             }
         }
 
+        // ---- replay (tools/replay.cpp) ----
+        using Outbox = std::function<void(std::string_view payload, const sockaddr_in& dest)>;
+
+        // everything the component sends goes to outbox instead of the socket
+        void set_outbox(Outbox outbox) { outbox_ = std::move(outbox); }
+
+        // handles one datagram exactly as if the socket had delivered it
+        void inject(std::string_view datagram, const sockaddr_in& sender)
+        {
+            dispatch(datagram.data(), datagram.size(), sender, 0);
+        }
+
     protected:
         // ---- identity ----
         virtual const char* component_name() const = 0;
@@ -63,29 +167,11 @@ namespace mpp
                     bool polarity,
                     const json& context = json::object())
         {
-            const std::string full_subject(subject);
-            const std::string prefix =
-                std::string(component_name()) + ".";
-
-            // Enforce ownership
-            if (full_subject.rfind(prefix, 0) != 0)
+            const uint64_t t0 = now_ns();
+            if (!admit(subject, polarity, context))
                 return;
 
-            // Enforce monotonicity
-            for (const auto& b : committed_) {
-                if (b.subject == full_subject &&
-                    b.polarity == polarity)
-                    return;
-            }
-
-            mpp::Belief belief{
-                component_name(),
-                full_subject,
-                polarity,
-                context
-            };
-
-            committed_.push_back(belief);
+            const mpp::Belief& belief = committed_.back();
 
             json msg;
             msg["belief"] = {
@@ -96,17 +182,48 @@ namespace mpp
             };
 
             send_json(msg, BLS_PORT);
+            commit_ns_.record(now_ns() - t0);
+        }
+
+        // Same rules as commit(), for a belief datagram serialized ahead of
+        // time (bytes must be what commit() would have sent).
+        void commit_prepared(const std::string& subject,
+                             bool polarity,
+                             const nlohmann::json& context,
+                             std::string_view bytes)
+        {
+            const uint64_t t0 = now_ns();
+            if (!admit(subject, polarity, context))
+                return;
+
+            send_bytes(bytes, BLS_PORT);
+            commit_ns_.record(now_ns() - t0);
         }
 
         // ---- networking helpers ----
         bool send_json(const json& j, int port)
+        {
+            const uint64_t t0 = now_ns();
+            const bool ok = send_bytes(j.dump() + "\n", port);
+            send_json_ns_.record(now_ns() - t0);
+            return ok;
+        }
+
+        // an already serialized datagram (newline included)
+        bool send_bytes(std::string_view payload, int port)
         {
             sockaddr_in dest{};
             dest.sin_family = AF_INET;
             dest.sin_port = htons(port);
             dest.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
 
-            const std::string payload = j.dump() + "\n";
+            if (trace_.current.trace)
+                payload = stamp(payload);
+
+            if (outbox_) {
+                outbox_(payload, dest);
+                return count_sent(payload.size(), payload.size());
+            }
 
             const ssize_t sent = sendto(
                 udp_fd_,
@@ -117,15 +234,27 @@ namespace mpp
                 sizeof(dest)
             );
 
-            return sent == static_cast<ssize_t>(payload.size());
+            return count_sent(sent, payload.size());
         }
 
         bool reply_json(const json& j)
+        {
+            return reply_bytes(j.dump() + "\n");
+        }
+
+        // to whoever sent the datagram being handled
+        bool reply_bytes(std::string_view payload)
         {
             if (!has_sender_)
                 return false;
 
-            const std::string payload = j.dump() + "\n";
+            if (trace_.current.trace)
+                payload = stamp(payload);
+
+            if (outbox_) {
+                outbox_(payload, last_sender_);
+                return count_sent(payload.size(), payload.size());
+            }
 
             const ssize_t sent = sendto(
                 udp_fd_,
@@ -136,20 +265,389 @@ namespace mpp
                 sizeof(last_sender_)
             );
 
-            return sent == static_cast<ssize_t>(payload.size());
+            return count_sent(sent, payload.size());
+        }
+
+        // ---- register publication ----
+        void registers_changed() { registers_dirty_ = true; }
+
+        // from on_idle(): a full snapshot once the period is up, else a
+        // delta if registers_changed() since the last one
+        void publish_registers()
+        {
+            if (subscribers_.empty())
+                return;
+
+            if (now_ns() - last_full_ns_ >= publish_period_ms_ * 1000000ull)
+                send_registers(true);
+            else if (registers_dirty_)
+                send_registers(false);
         }
 
     protected:
         int sba_;
         std::atomic<bool> running_;
         std::vector<mpp::Belief> committed_;
+        std::unordered_set<std::string> committed_index_[2];   // by polarity
 
         sockaddr_in last_sender_{};
         bool has_sender_ = false;
 
+        int max_batch_ = 256;   // datagrams handled per loop iteration
+
+        uint32_t publish_period_ms_ = 1000;   // full register snapshots
+
+        Metrics metrics_;
+
     private:
         int udp_fd_;
 
+        // ---- built-in metrics ----
+        Counter&   rx_datagrams_;
+        Counter&   rx_bytes_;
+        Counter&   rx_bad_;
+        Histogram& rx_batch_;
+        Histogram& parse_ns_;
+        Histogram& handler_ns_;
+        Counter&   tx_datagrams_;
+        Counter&   tx_bytes_;
+        Counter&   tx_errors_;
+        Histogram& send_json_ns_;
+        Counter&   commits_;
+        Counter&   commits_rejected_;
+        Histogram& commit_ns_;
+        Gauge&     committed_gauge_;
+        Gauge&     uptime_;
+        uint64_t   started_ns_;
+
+        // ---- register publication ----
+        std::set<int> subscribers_;
+        json          published_;           // registers as last published
+        uint64_t      registers_revision_ = 0;
+        uint64_t      last_full_ns_       = 0;
+        bool          registers_dirty_    = false;
+
+        void registers_request(const json& j)
+        {
+            const std::string action = j.value("action", "");
+            const int from = j.value("sba", int(ntohs(last_sender_.sin_port)));
+
+            if (action == "subscribe") {
+                subscribers_.insert(from);
+                send_registers(true);
+            }
+            if (action == "unsubscribe")
+                subscribers_.erase(from);
+        }
+
+        void send_registers(bool full)
+        {
+            registers_dirty_ = false;
+            if (subscribers_.empty())
+                return;
+
+            const json now = static_cast<const Derived*>(this)->serialize_registers();
+
+            json changed = json::object();
+            for (auto it = now.begin(); it != now.end(); ++it) {
+                auto was = published_.find(it.key());
+                if (was == published_.end() || *was != it.value())
+                    changed[it.key()] = it.value();
+            }
+
+            if (!changed.empty())
+                ++registers_revision_;
+            published_ = now;
+
+            if (!full && changed.empty())
+                return;
+
+            json msg;
+            msg["sba"]       = sba_;
+            msg["revision"]  = registers_revision_;
+            msg["full"]      = full;
+            msg["registers"] = full ? now : changed;
+
+            for (int sba : subscribers_)
+                send_json(msg, sba);
+
+            if (full)
+                last_full_ns_ = now_ns();
+        }
+
+        // ---- tracing ----
+        Tracer      trace_;
+        std::string stamped_;   // last datagram sent with a trace context
+
+        // payload + "_trace" (a JSON object keeps its closing brace last)
+        std::string_view stamp(std::string_view payload)
+        {
+            size_t close = payload.find_last_of('}');
+            if (payload.empty() || payload.front() != '{' || close == std::string_view::npos)
+                return payload;
+
+            size_t last = payload.find_last_not_of(" \t\r\n", close - 1);
+            char ctx[112];
+            const int n = std::snprintf(ctx, sizeof(ctx),
+                "%s\"_trace\":{\"trace\":%llu,\"parent\":%llu,\"ts\":%llu}",
+                payload[last] == '{' ? "" : ",",
+                static_cast<unsigned long long>(trace_.current.trace),
+                static_cast<unsigned long long>(trace_.current.span),
+                static_cast<unsigned long long>(now_ns()));
+
+            stamped_.assign(payload.substr(0, close));
+            stamped_.append(ctx, n);
+            stamped_.append(payload.substr(close));
+            trace_.sent = true;
+            return stamped_;
+        }
+
+        // Takes the sender's context out of j (handlers never see it) and,
+        // when tracing, opens the span handling j: a child of the sender's,
+        // or the root of a new trace.
+        void trace_begin(json& j, const std::string& type, uint64_t received_ns)
+        {
+            uint64_t trace = 0, parent = 0, sent_ns = 0;
+            if (j.is_object()) {
+                auto it = j.find("_trace");
+                if (it != j.end()) {
+                    if (it->is_object()) {
+                        trace   = it->value("trace",  uint64_t(0));
+                        parent  = it->value("parent", uint64_t(0));
+                        sent_ns = it->value("ts",     uint64_t(0));
+                    }
+                    j.erase(it);
+                }
+            }
+
+            if (!trace_.enabled)
+                return;
+
+            TraceSpan& s = trace_.current;
+            s.trace    = trace ? trace : trace_.next_id();
+            s.span     = trace_.next_id();
+            s.parent   = trace ? parent : 0;
+            s.sent_ns  = trace ? sent_ns : 0;
+            s.start_ns = received_ns;
+            s.sba      = static_cast<uint32_t>(sba_);
+            trace_copy(s.component, component_name());
+
+            trace_copy(s.name, type);
+            trace_.sent = false;
+        }
+
+        // Roots that sent nothing (a tick with no effect) are not kept.
+        void trace_end()
+        {
+            TraceSpan& s = trace_.current;
+            if (!s.trace)
+                return;
+            s.end_ns = now_ns();
+            if (s.parent || trace_.sent)
+                SpanBuffer::process().record(s);
+            s.trace = 0;
+        }
+
+        // ---- capture and replay ----
+        CaptureWriter capture_;
+        Outbox        outbox_;
+
+        // ---- queueing delay ----
+        static constexpr size_t MAX_MESSAGE_TYPES = 32;   // then type="other"
+
+        bool rx_timestamps_ = false;
+        std::unordered_map<std::string, Histogram*> queue_delay_;
+
+        // "verb resource" for requests, else the first member ("tick",
+        // "belief", "beliefs", ...)
+        static std::string message_type(const json& j)
+        {
+            if (!j.is_object() || j.empty())
+                return "?";
+
+            auto verb = j.find("verb");
+            if (verb == j.end())
+                return j.begin().key();
+
+            std::string type = verb->is_string() ? verb->template get<std::string>() : "?";
+            auto resource = j.find("resource");
+            if (resource != j.end() && resource->is_string())
+                type += " " + resource->template get<std::string>();
+            return type;
+        }
+
+        void record_queue_delay(const std::string& type, uint64_t delay_ns)
+        {
+            auto it = queue_delay_.find(type);
+            if (it == queue_delay_.end()) {
+                const std::string& key = queue_delay_.size() < MAX_MESSAGE_TYPES ? type : "other";
+                it = queue_delay_.find(key);
+                if (it == queue_delay_.end()) {
+                    std::string label;
+                    for (char c : key) {
+                        if (c == '"' || c == '\\')
+                            label += '\\';
+                        label += c;
+                    }
+                    Histogram& h = metrics_.histogram(
+                        "mpp_queue_delay_ns",
+                        "Kernel receive timestamp to dispatch, by message type (ns)",
+                        "type=\"" + label + "\"");
+                    it = queue_delay_.emplace(key, &h).first;
+                }
+            }
+            it->second->record(delay_ns);
+        }
+
+        static uint64_t realtime_ns()
+        {
+            timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            return uint64_t(ts.tv_sec) * 1000000000ull + uint64_t(ts.tv_nsec);
+        }
+
+        // the requests every component answers itself; true if j was one
+        bool builtin_request(const json& j)
+        {
+            if (!j.is_object() || !j.contains("verb") || !j.contains("resource"))
+                return false;
+
+            const std::string verb     = j.value("verb", "");
+            const std::string resource = j.value("resource", "");
+
+            if (verb == "GET" && resource == "metrics") {
+                reply_metrics();
+                return true;
+            }
+
+            if (resource == "capture")
+                return capture_request(j, verb);
+
+            if constexpr (requires(const Derived& d) { d.serialize_registers(); })
+                if (verb == "POST" && resource == "registers") {
+                    registers_request(j);
+                    return true;
+                }
+
+            if (resource != "trace")
+                return false;
+
+            json r;
+            r["component"] = component_name();
+            r["sba"]       = sba_;
+
+            if (verb == "PUT") {
+                trace_.enabled = j.value("enable", trace_.enabled);
+            }
+            else if (verb == "GET" && j.contains("path")) {
+                const std::string path = j.value("path", "");
+                size_t count = 0;
+                std::string error;
+                if (!SpanBuffer::process().dump(path, count, error)) {
+                    r["last_error"] = "trace dump failed: " + error;
+                    reply_json(r);
+                    return true;
+                }
+                r["path"]  = path;
+                r["spans"] = count;
+            }
+            else if (verb != "GET") {
+                return false;
+            }
+
+            r["trace"]    = trace_.enabled;
+            r["recorded"] = SpanBuffer::process().recorded();
+            reply_json(r);
+            return true;
+        }
+
+        bool count_sent(ssize_t sent, size_t size)
+        {
+            if (sent != static_cast<ssize_t>(size)) {
+                tx_errors_.add();
+                return false;
+            }
+            tx_datagrams_.add();
+            tx_bytes_.add(size);
+            return true;
+        }
+
+        void reply_metrics()
+        {
+            committed_gauge_.set(static_cast<int64_t>(committed_.size()));
+            uptime_.set(static_cast<int64_t>((now_ns() - started_ns_) / 1000000000));
+
+            // optional hook to refresh the derived class's gauges
+            if constexpr (requires(Derived& d) { d.on_metrics(); })
+                static_cast<Derived*>(this)->on_metrics();
+
+            const std::string labels = "component=\"" + std::string(component_name()) +
+                                       "\",sba=\"" + std::to_string(sba_) + "\"";
+            reply_bytes(metrics_.expose(labels));
+        }
+
+        // Ownership (own prefix only) and monotonicity (each subject and
+        // polarity once); records the belief when it may be sent.
+        bool admit(const std::string& subject,
+                   bool polarity,
+                   const nlohmann::json& context)
+        {
+            const std::string prefix =
+                std::string(component_name()) + ".";
+
+            // Enforce ownership
+            if (subject.rfind(prefix, 0) != 0) {
+                commits_rejected_.add();
+                return false;
+            }
+
+            // Enforce monotonicity
+            if (!committed_index_[polarity].insert(subject).second) {
+                commits_rejected_.add();
+                return false;
+            }
+
+            commits_.add();
+            committed_.push_back(mpp::Belief{
+                component_name(),
+                subject,
+                polarity,
+                context
+            });
+            return true;
+        }
+
+        bool capture_request(const json& j, const std::string& verb)
+        {
+            json r;
+            r["component"] = component_name();
+            r["sba"]       = sba_;
+
+            if (verb == "PUT") {
+                if (j.contains("path")) {
+                    std::string error;
+                    if (!capture_.open(j.value("path", ""), error)) {
+                        r["last_error"] = "capture failed: " + error;
+                        reply_json(r);
+                        return true;
+                    }
+                }
+                else if (!j.value("enable", true)) {
+                    capture_.close();
+                }
+            }
+            else if (verb != "GET") {
+                return false;
+            }
+
+            r["capture"] = capture_.is_open();
+            r["path"]    = capture_.path();
+            r["records"] = capture_.records();
+            r["bytes"]   = capture_.bytes();
+            reply_json(r);
+            return true;
+        }
+
         void setup_udp()
         {
             udp_fd_ = socket(AF_INET, SOCK_DGRAM, 0);
@@ -160,6 +658,10 @@ namespace mpp
 
             int yes = 1;
             setsockopt(udp_fd_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+#ifdef SO_TIMESTAMPNS
+            rx_timestamps_ =
+                setsockopt(udp_fd_, SOL_SOCKET, SO_TIMESTAMPNS, &yes, sizeof(yes)) == 0;
+#endif
             fcntl(udp_fd_, F_SETFL, O_NONBLOCK);
 
             sockaddr_in addr{};
@@ -174,36 +676,80 @@ namespace mpp
             }
         }
 
-        void poll_socket()
+        bool poll_socket()
         {
             char buffer[65536]{};
             sockaddr_in sender{};
-            socklen_t sender_len = sizeof(sender);
 
-            ssize_t len = recvfrom(
-                udp_fd_,
-                buffer,
-                sizeof(buffer) - 1,
-                0,
-                (sockaddr*)&sender,
-                &sender_len
-            );
+            // datagram plus the kernel's receive timestamp, if enabled
+            iovec iov{ buffer, sizeof(buffer) - 1 };
+            alignas(cmsghdr) char control[CMSG_SPACE(sizeof(timespec))];
+
+            msghdr msg{};
+            msg.msg_name       = &sender;
+            msg.msg_namelen    = sizeof(sender);
+            msg.msg_iov        = &iov;
+            msg.msg_iovlen     = 1;
+            msg.msg_control    = control;
+            msg.msg_controllen = sizeof(control);
+
+            ssize_t len = recvmsg(udp_fd_, &msg, 0);
 
             if (len <= 0)
-                return;
+                return false;
+
+            uint64_t arrived_ns = 0;   // CLOCK_REALTIME
+#ifdef SO_TIMESTAMPNS
+            for (cmsghdr* c = rx_timestamps_ ? CMSG_FIRSTHDR(&msg) : nullptr;
+                 c; c = CMSG_NXTHDR(&msg, c))
+                if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS) {
+                    timespec ts;
+                    std::memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+                    arrived_ns = uint64_t(ts.tv_sec) * 1000000000ull + uint64_t(ts.tv_nsec);
+                }
+#endif
+
+            if (capture_.is_open())
+                capture_.append(now_ns(), ntohl(sender.sin_addr.s_addr), ntohs(sender.sin_port),
+                                static_cast<uint16_t>(sba_), std::string_view(buffer, len));
+
+            dispatch(buffer, len, sender, arrived_ns);
+            return true;
+        }
 
+        // arrived_ns: kernel receive time (CLOCK_REALTIME), 0 if unknown
+        void dispatch(const char* data, size_t len, const sockaddr_in& sender, uint64_t arrived_ns)
+        {
             last_sender_ = sender;
             has_sender_ = true;
 
-            json j;
-            try {
-                j = json::parse(buffer, buffer + len);
-            } catch (...) {
+            rx_datagrams_.add();
+            rx_bytes_.add(len);
+
+            const uint64_t t0 = now_ns();
+            json j = json::parse(data, data + len, nullptr, false);
+            const uint64_t t1 = now_ns();
+            parse_ns_.record(t1 - t0);
+
+            if (j.is_discarded()) {
+                rx_bad_.add();
                 return;
             }
 
+            const std::string type = message_type(j);
+            if (arrived_ns) {
+                const uint64_t now = realtime_ns();
+                record_queue_delay(type, now > arrived_ns ? now - arrived_ns : 0);
+            }
+
+            if (builtin_request(j))
+                return;
+
+            trace_begin(j, type, t0);
             static_cast<Derived*>(this)->apply_snapshot(j);
             static_cast<Derived*>(this)->on_message(j);
+            trace_end();
+            handler_ns_.record(now_ns() - t1);
         }
     };
 
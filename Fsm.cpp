@@ -1,18 +1,15 @@
 #include "Fsm.hpp"
+#include "FsmBits.hpp"
 
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
 #include <sstream>
-#include <cctype>
+#include <functional>
 
-// -----------------------------------------------------------------------------
-// Utilities
-// -----------------------------------------------------------------------------
-static void trim(std::string& s)
-{
-    while (!s.empty() && std::isspace((unsigned char)s.front()))
-        s.erase(s.begin());
-    while (!s.empty() && std::isspace((unsigned char)s.back()))
-        s.pop_back();
-}
+#include <sys/stat.h>
 
 // -----------------------------------------------------------------------------
 // Construction
@@ -20,169 +17,1442 @@ static void trim(std::string& s)
 Fsm::Fsm(int sba)
     : mpp::Component<Fsm>(sba)
 {
-    regs_.sba_ = sba;
+    FsmInstance& inst = instances_[""];
+    inst.regs_.sba_ = sba;
 }
 
 // -----------------------------------------------------------------------------
-// Control Plane (PUT / GET)
+// Control Plane (PUT / GET / POST / DELETE)
 // -----------------------------------------------------------------------------
 void Fsm::apply_snapshot(const json& j)
 {
     // ---- TICK ----
     if (j.value("tick", false)) {
-        if (regs_.run_) {
-            on_tick();
-        }
+        on_tick();
         return;
     }
-    
+
     if (!j.contains("verb"))
         return;
 
     const std::string verb = j["verb"];
+    const std::string id   = j.value("instance", "");
 
     if (verb == "GET") {
+        if (j.value("resource","") == "instances") {
+            json r;
+            r["component"]   = "FSM";
+            r["sba"]         = sba_;
+            r["count"]       = instances_.size();
+            r["definitions"] = definitions_.size();
+            r["mirror_stale_ms"] = mirror_stale_ms_;
+            r["instances"]   = json::array();
+            for (const auto& [iid, inst] : instances_)
+                r["instances"].push_back(iid);
+            reply_json(r);
+            return;
+        }
+
+        auto it = instances_.find(id);
+        if (it == instances_.end()) {
+            json r;
+            r["component"]  = "FSM";
+            r["sba"]        = sba_;
+            r["instance"]   = id;
+            r["last_error"] = "no such instance";
+            reply_json(r);
+            return;
+        }
+
+        if (j.value("resource","") == "history") {
+            if (!j.contains("path")) {
+                reply_json(history(it->second, j.value("limit", size_t(128))));
+                return;
+            }
+
+            json r;
+            r["component"] = "FSM";
+            r["sba"]       = sba_;
+            r["instance"]  = id;
+            r["path"]      = j["path"];
+
+            std::string why;
+            if (dump_history(it->second, j["path"].get<std::string>(), why))
+                r["records"] = it->second.history_.size();
+            else
+                r["last_error"] = "history dump failed: " + why;
+            reply_json(r);
+            return;
+        }
+
+        reply_json(describe(it->second));
+        return;
+    }
+
+    // process-wide: every instance's guards read the same mirrors
+    if (verb == "PUT" && j.value("resource","") == "mirrors") {
         json r;
-        r["component"]        = "FSM";
-        r["sba"]              = regs_.sba_;
-        r["target_sba"]       = regs_.target_sba_;
-        r["tck_sba"]          = regs_.tck_sba_;
-        r["run"]              = regs_.run_;
-        r["loaded"]           = regs_.loaded_;
-        r["current_state"]    = regs_.current_state_;
-        r["next_state"]       = regs_.next_state_;
-        r["transition_fired"] = regs_.transition_fired_;
-        r["last_error"]       = regs_.last_error_;
+        r["component"] = "FSM";
+        r["sba"]       = sba_;
+        if (j.contains("stale_ms") && j["stale_ms"].is_number_unsigned())
+            mirror_stale_ms_ = j["stale_ms"].get<uint32_t>();
+        else if (j.contains("stale_ms"))
+            r["last_error"] = "stale_ms must be a whole number of ms";
+        r["mirror_stale_ms"] = mirror_stale_ms_;
         reply_json(r);
         return;
     }
 
     if (verb == "PUT" && j.value("resource","") == "fsm") {
-        const auto& body = j["body"];
+        if (id.find('.') != std::string::npos) {
+            json r;
+            r["component"]  = "FSM";
+            r["sba"]        = sba_;
+            r["instance"]   = id;
+            r["last_error"] = "instance ids may not contain '.'";
+            reply_json(r);
+            return;
+        }
+        put_fsm(instance_for(j), j["body"]);
+        return;
+    }
+
+    if (verb == "DELETE") {
+        if (!id.empty() && instances_.erase(id))
+            batches_dirty_ = true;
+        return;
+    }
+
+    if (verb == "POST") {
+        auto it = instances_.find(id);
+        if (it == instances_.end())
+            return;
+
+        FsmInstance& inst = it->second;
+        const std::string action = j.value("action","");
+        if (action == "run")  inst.regs_.run_ = true;
+        if (action == "stop") inst.regs_.run_ = false;
+
+        if (inst.regs_.quiescent_)
+            wake(inst);
+        sync_slot(inst);
+    }
+}
+
+FsmInstance& Fsm::instance_for(const json& j)
+{
+    const std::string id = j.value("instance", "");
+
+    auto it = instances_.find(id);
+    if (it != instances_.end())
+        return it->second;
+
+    FsmInstance& inst = instances_[id];
+    inst.id = id;
+    inst.regs_.sba_ = sba_;
+    batches_dirty_ = true;
+    return inst;
+}
+
+json Fsm::describe(const FsmInstance& inst) const
+{
+    const FsmRegisters& regs = inst.regs_;
+
+    json r;
+    r["component"]        = "FSM";
+    r["sba"]              = regs.sba_;
+    r["instance"]         = inst.id;
+    r["definition"]       = inst.def_ ? inst.def_->name : "";
+    r["target_sba"]       = regs.target_sba_;
+    r["tck_sba"]          = regs.tck_sba_;
+    r["run"]              = regs.run_;
+    r["loaded"]           = regs.loaded_;
+    r["current_state"]    = regs.current_state_;
+    r["next_state"]       = regs.next_state_;
+    r["transition_fired"] = regs.transition_fired_;
+    r["quiescent"]        = regs.quiescent_;
+    r["last_error"]       = regs.last_error_;
+
+    // full configuration, composites first; current_state has the leaves
+    if (inst.def_ && inst.def_->hierarchical()) {
+        json active = json::array();
+        for (const auto& a : inst.active_)
+            active.push_back(inst.def_->states[a.state].name);
+        r["active_states"] = active;
+    }
+
+    if (!inst.last_reload_.is_null())
+        r["last_reload"] = inst.last_reload_;
+
+    auto m = mirrors_.find(regs.target_sba_);
+    if (m != mirrors_.end()) {
+        const RegisterMirror& mirror = m->second;
+        r["target_mirror"] = {
+            {"revision", mirror.revision},
+            {"synced",   mirror.synced},
+            {"age_ms",   mirror.updated_ns
+                             ? (mpp::now_ns() - mirror.updated_ns) / 1000000
+                             : 0},
+            {"stale",    fresh_mirror(regs.target_sba_) == nullptr}
+        };
+    }
+    return r;
+}
+
+// -----------------------------------------------------------------------------
+// Flight recorder
+// -----------------------------------------------------------------------------
+json Fsm::history(const FsmInstance& inst, size_t limit) const
+{
+    const FsmHistory& h = inst.history_;
+
+    json r;
+    r["component"]  = "FSM";
+    r["sba"]        = sba_;
+    r["instance"]   = inst.id;
+    r["definition"] = inst.def_ ? inst.def_->name : "";
+    r["capacity"]   = h.capacity();
+    r["recorded"]   = h.recorded();
+    r["now_ns"]     = mpp::now_ns();
+    r["records"]    = json::array();
+
+    if (!inst.def_)
+        return r;
+
+    const FsmDefinition& def = *inst.def_;
+    const uint32_t n = h.size();
+    for (uint32_t i = n - std::min<size_t>(n, limit); i < n; ++i) {
+        const FsmHistoryRecord& rec = h.at(i);
+        const auto& tr = def.transitions[rec.transition];
+
+        json matched = json::array(), matched_false = json::array();
+        for (uint32_t k = 0; k < rec.matched; ++k)
+            ((rec.matched_true >> k) & 1 ? matched : matched_false)
+                .push_back(subjects_->names[rec.subject[k]]);
+
+        r["records"].push_back({
+            {"seq",           rec.seq},
+            {"ns",            rec.ns},
+            {"tick",          rec.tick},
+            {"bls_revision",  rec.bls_revision},
+            {"from",          def.states[rec.from].name},
+            {"to",            def.states[rec.to].name},
+            {"beliefs",       tr.beliefs},
+            {"beliefs_false", tr.beliefs_false},
+            {"matched",       matched},
+            {"matched_false", matched_false}
+        });
+    }
+    return r;
+}
+
+json Fsm::history_legend(const FsmInstance& inst) const
+{
+    json legend;
+    legend["definition"]  = inst.def_ ? inst.def_->name : "";
+    legend["instance"]    = inst.id;
+    legend["states"]      = json::array();
+    legend["transitions"] = json::object();
+    legend["subjects"]    = json::object();
+
+    if (!inst.def_)
+        return legend;
+
+    const FsmDefinition& def = *inst.def_;
+    for (const auto& st : def.states)
+        legend["states"].push_back(st.name);
+
+    // only the transitions the records name
+    const FsmHistory& h = inst.history_;
+    for (uint32_t i = 0; i < h.size(); ++i) {
+        for (uint32_t k = 0; k < h.at(i).matched; ++k) {
+            const int id = h.at(i).subject[k];
+            legend["subjects"][std::to_string(id)] = subjects_->names[id];
+        }
+
+        const auto key = std::to_string(h.at(i).transition);
+        if (legend["transitions"].contains(key))
+            continue;
+
+        const auto& tr = def.transitions[h.at(i).transition];
+        legend["transitions"][key] = {
+            {"line",          tr.line},
+            {"guard",         tr.guard},
+            {"beliefs",       tr.beliefs},
+            {"beliefs_false", tr.beliefs_false}
+        };
+    }
+    return legend;
+}
+
+// Mask bits all held, or t would not have fired; of the bytecode's belief
+// atoms, the ones whose bit is set. A named instance's own subjects are
+// recorded as the copies its view read them from.
+void Fsm::record_matched(const FsmInstance& inst, int t, FsmHistoryRecord& rec) const
+{
+    const FsmDefinition& def = *inst.def_;
+
+    auto source = [&](int id) {
+        for (const auto& [guard_id, own] : inst.read_as_)
+            if (guard_id == id)
+                return own;
+        return id;
+    };
+    auto held = [](const std::vector<uint64_t>& view, int id) {
+        return size_t(id / 64) < view.size() && ((view[id / 64] >> (id % 64)) & 1);
+    };
+
+    for (size_t w = 0; w < def.mask_words; ++w) {
+        for (uint64_t bits = def.need_true(t)[w]; bits; bits &= bits - 1)
+            FsmHistory::add_matched(rec, source(int(w * 64) + std::countr_zero(bits)), true);
+        for (uint64_t bits = def.need_false(t)[w]; bits; bits &= bits - 1)
+            FsmHistory::add_matched(rec, source(int(w * 64) + std::countr_zero(bits)), false);
+    }
+
+    const auto& tr = def.transitions[t];
+    for (int i = tr.code_begin; i < tr.code_end; ++i) {
+        const GuardOp& op = def.guard_code[i];
+        if (op.code == GuardOp::BeliefTrue && held(view_true_, op.a))
+            FsmHistory::add_matched(rec, source(op.a), true);
+        if (op.code == GuardOp::BeliefFalse && held(view_false_, op.a))
+            FsmHistory::add_matched(rec, source(op.a), false);
+    }
+}
+
+bool Fsm::dump_history(const FsmInstance& inst,
+                       const std::string& path,
+                       std::string& error) const
+{
+    const FsmHistory& h = inst.history_;
+    const std::string legend = history_legend(inst).dump();
+
+    FsmHistoryHeader hdr;
+    hdr.recorded     = h.recorded();
+    hdr.count        = h.size();
+    hdr.legend_bytes = static_cast<uint32_t>(legend.size());
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        error = path + ": " + std::strerror(errno);
+        return false;
+    }
+
+    out.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+    for (uint32_t i = 0; i < h.size(); ++i)
+        out.write(reinterpret_cast<const char*>(&h.at(i)), sizeof(FsmHistoryRecord));
+    out.write(legend.data(), static_cast<std::streamsize>(legend.size()));
 
-        if (body.contains("target_sba"))
-            regs_.target_sba_ = body["target_sba"].get<int>();
+    if (!out) {
+        error = path + ": write failed";
+        return false;
+    }
+    return true;
+}
+
+void Fsm::put_fsm(FsmInstance& inst, const json& body)
+{
+    FsmRegisters& regs = inst.regs_;
+
+    if (body.contains("target_sba"))
+        regs.target_sba_ = body["target_sba"].get<int>();
+
+    if (body.contains("tck_sba"))
+        regs.tck_sba_ = body["tck_sba"].get<int>();
 
-        if (body.contains("tck_sba"))
-            regs_.tck_sba_ = body["tck_sba"].get<int>();
+    if (body.contains("mirror_stale_ms"))
+        FSM_ERROR(inst, "mirror_stale_ms is process-wide: "
+                        "PUT resource \"mirrors\" with \"stale_ms\"");
+
+    if (body.contains("history"))
+        inst.history_.resize(body["history"].get<uint32_t>());
+
+    // fsm_text compiles (or re-uses) a definition, fsm_image maps a compiled
+    // one from disk; "definition" alone attaches the instance to one that is
+    // already loaded.
+    if (body.contains("fsm_text") || body.contains("fsm_image") ||
+        body.contains("definition")) {
+        const std::string name = body.value("definition", "");
+        std::shared_ptr<const FsmDefinition> def;
 
         if (body.contains("fsm_text")) {
-            fsm_text_ = body["fsm_text"].get<std::string>();
-            regs_.loaded_ = parse_plantuml(fsm_text_);
-            if (regs_.loaded_ && !state_order_.empty()) {
-                regs_.current_state_ = state_order_.front();
-                regs_.run_ = true;
+            std::string why;
+            def = load_definition(name, body["fsm_text"].get<std::string>(), why);
+            if (!def)
+                FSM_ERROR(inst, "fsm_text rejected: " + why);
+        } else if (body.contains("fsm_image")) {
+            std::string why;
+            def = load_image(name, body["fsm_image"].get<std::string>(), why);
+            if (!def)
+                FSM_ERROR(inst, "fsm_image rejected: " + why);
+        } else {
+            auto it = definitions_.find(name);
+            if (it != definitions_.end())
+                def = it->second;
+            else
+                FSM_ERROR(inst, "unknown definition " + name);
+        }
+
+        // "reload": swap in place for every instance sharing this one's
+        // definition; a definition that fails to load leaves them running
+        if (body.value("reload", false) && inst.def_ && !inst.active_.empty()) {
+            if (def)
+                reload(inst.def_, def, body.value("state_map", json::object()));
+            return;
+        }
+
+        regs.loaded_ = (def != nullptr);
+        if (regs.loaded_) {
+            if (inst.def_ != def) {
+                inst.history_.clear();   // recorded ids were the old table's
+                batches_dirty_ = true;
             }
+            inst.def_ = def;
+            bind_beliefs(inst);
+            enter_initial(inst);
+            regs.run_ = true;
+
+            // remote $REG reads (guards or payloads) need the target's
+            // registers mirrored here
+            if (!def->remote_registers.empty() && regs.target_sba_ != 0)
+                subscribe_registers(regs.target_sba_);
         }
+    }
+
+    if (regs.quiescent_)
+        wake(inst);
+    sync_slot(inst);
+}
+
+std::shared_ptr<const FsmDefinition>
+Fsm::load_definition(const std::string& name,
+                     const std::string& text,
+                     std::string& error)
+{
+    const std::string key = name.empty()
+        ? "#" + std::to_string(std::hash<std::string>{}(text))
+        : name;
+
+    auto it = definitions_.find(key);
+    if (it != definitions_.end() && it->second->text == text)
+        return it->second;
+
+    auto def = FsmDefinition::parse_plantuml(text, subjects_, &error);
+    if (!def)
+        return nullptr;
+
+    def->name = key;
+    return install_definition(def);
+}
+
+// An image is mapped once per (path, mtime, size): a recompiled file is
+// mapped afresh, while instances already running keep the mapping they have.
+std::shared_ptr<const FsmDefinition>
+Fsm::load_image(const std::string& name,
+                const std::string& path,
+                std::string& error)
+{
+    struct stat st{};
+    if (stat(path.c_str(), &st) < 0) {
+        error = path + ": " + std::strerror(errno);
+        return nullptr;
+    }
+
+    const uint64_t mtime = uint64_t(st.st_mtim.tv_sec) * 1000000000ull +
+                           uint64_t(st.st_mtim.tv_nsec);
+
+    auto it = images_.find(path);
+    if (it != images_.end() &&
+        it->second.mtime_ns == mtime &&
+        it->second.size == uint64_t(st.st_size) &&
+        (name.empty() || it->second.def->name == name))
+        return it->second.def;
+
+    auto def = FsmDefinition::load_image(path, subjects_, &error);
+    if (!def)
+        return nullptr;
+
+    if (!name.empty())
+        def->name = name;
+    else if (def->name.empty())
+        def->name = path;
+
+    images_[path] = { mtime, uint64_t(st.st_size), def };
+    return install_definition(def);
+}
+
+std::shared_ptr<const FsmDefinition>
+Fsm::install_definition(std::shared_ptr<FsmDefinition> def)
+{
+    if (!def->contexts.empty())
+        want_contexts_ = true;
+
+    // remote registers as mirror slots; mirrors already held learn new ones
+    const size_t known = register_names_.size();
+    def->remote_slots.clear();
+    for (const auto& name : def->remote_registers) {
+        auto [it, added] = register_slots_.emplace(name, int(register_names_.size()));
+        if (added)
+            register_names_.push_back(name);
+        def->remote_slots.push_back(it->second);
+    }
+    if (register_names_.size() != known)
+        for (auto& [sba, m] : mirrors_)
+            index_mirror(m, known);
+
+    // new subjects may have widened the masks
+    const size_t words = std::max<size_t>(subjects_->words(), 1);
+    observed_true_.resize(words, 0);
+    observed_false_.resize(words, 0);
+
+    definitions_[def->name] = def;
+    return def;
+}
+
+// A named instance writes "FSM.<id>.<rest>" for each "FSM.<rest>" its
+// definition names; guards on those read the instance's copies, interned
+// here so BLS snapshots fill them in like any other subject.
+void Fsm::bind_beliefs(FsmInstance& inst)
+{
+    inst.written_.clear();
+    inst.read_as_.clear();
+    if (inst.id.empty())
         return;
+
+    auto own = [&](const std::string& subject) {
+        if (!subject.starts_with("FSM."))
+            return subject;   // not ours to write; admit() rejects it anyway
+        return "FSM." + inst.id + subject.substr(3);
+    };
+
+    const FsmDefinition& def = *inst.def_;
+    for (const auto& st : def.states)
+        inst.written_.push_back({ own(st.payloads.state_subject),
+                                  own(st.payloads.commit_subject),
+                                  own(st.deadline_subject) });
+
+    for (int id : def.written_ids)
+        inst.read_as_.emplace_back(id, subjects_->intern(own(subjects_->names[id])));
+
+    const size_t words = std::max<size_t>(subjects_->words(), 1);
+    observed_true_.resize(words, 0);
+    observed_false_.resize(words, 0);
+}
+
+// -----------------------------------------------------------------------------
+// Hot reload
+//
+// Messages are handled one at a time between ticks, so a swap is atomic with
+// respect to step(): every instance on the old definition moves to the new
+// one in the same handler. Each keeps its current state (matched by name, or
+// through "state_map": {"OLD": "NEW"}), its registers and its time in state;
+// timers are re-armed from the new table. If any current state has no
+// counterpart, nothing is swapped.
+// -----------------------------------------------------------------------------
+namespace {
+
+// outgoing edges and note bytes of one state, for diffing by name
+std::string state_signature(const FsmDefinition& def, int s)
+{
+    const auto& st = def.states[s];
+
+    std::string sig = st.payloads.state_bytes + st.payloads.commit_bytes +
+                      st.payloads.tck_bytes;
+    for (const auto& chunk : st.payloads.send.chunks)
+        sig += chunk;
+    for (const auto& hole : st.payloads.send.holes)
+        sig += "$" + hole.name;
+
+    for (int t = st.first_transition; t < st.first_transition + st.transition_count; ++t)
+        sig += "\n" + def.states[def.transitions[t].to].name + ":" +
+               def.transitions[t].guard;
+
+    sig += "\n" + std::to_string(st.deadline_ms) + "/" +
+           std::to_string(st.deadline_ticks) + "/" + st.deadline_subject;
+    return sig;
+}
+
+// A mapped configuration must still nest: every state inside an active
+// composite, one state per region.
+std::string check_configuration(const FsmDefinition& def,
+                                const std::vector<FsmInstance::Active>& active)
+{
+    for (size_t i = 0; i < active.size(); ++i) {
+        const auto& st = def.states[active[i].state];
+
+        bool parent_active = st.parent < 0;
+        for (size_t k = 0; k < active.size(); ++k) {
+            const auto& other = def.states[active[k].state];
+            parent_active |= (active[k].state == st.parent);
+
+            if (k != i && other.region == st.region && other.parent == st.parent)
+                return "states " + st.name + " and " + other.name +
+                       " would share a region";
+        }
+
+        if (!parent_active)
+            return "state " + st.name + " is not inside an active state in " +
+                   def.name;
     }
+    return "";
+}
 
-    if (verb == "POST") {
-        const std::string action = j.value("action","");
-        if (action == "run")  regs_.run_ = true;
-        if (action == "stop") regs_.run_ = false;
+json diff_definitions(const FsmDefinition& from, const FsmDefinition& to)
+{
+    json d;
+    d["added"]   = json::array();
+    d["removed"] = json::array();
+    d["changed"] = json::array();
+
+    for (size_t s = 0; s < to.states.size(); ++s) {
+        const int old = from.find_state(to.states[s].name);
+        if (old < 0)
+            d["added"].push_back(to.states[s].name);
+        else if (state_signature(from, old) != state_signature(to, int(s)))
+            d["changed"].push_back(to.states[s].name);
+    }
+
+    for (const auto& st : from.states)
+        if (to.find_state(st.name) < 0)
+            d["removed"].push_back(st.name);
+
+    return d;
+}
+
+} // namespace
+
+void Fsm::reload(std::shared_ptr<const FsmDefinition> from,
+                 std::shared_ptr<const FsmDefinition> to,
+                 const json& state_map)
+{
+    if (from == to)
+        return;   // same text: nothing to swap
+
+    auto mapped = [&](const std::string& state) {
+        const std::string target = state_map.is_object()
+            ? state_map.value(state, state)
+            : state;
+        return to->find_state(target);
+    };
+
+    // ---- map every instance's configuration before touching any ----
+    std::vector<std::pair<FsmInstance*, std::vector<FsmInstance::Active>>> moving;
+    for (auto& [id, inst] : instances_) {
+        if (inst.def_ != from || inst.active_.empty())
+            continue;
+
+        std::vector<FsmInstance::Active> next;
+        std::string why;
+        for (const auto& a : inst.active_) {
+            const std::string& name = from->states[a.state].name;
+            const int state = mapped(name);
+            if (state < 0) {
+                why = "state " + name + " not in " + to->name;
+                break;
+            }
+            next.push_back({ state, a.entry, a.entered_ns, a.entered_tick });
+        }
+        if (why.empty())
+            why = check_configuration(*to, next);
+
+        if (!why.empty()) {
+            for (auto& [id2, other] : instances_)
+                if (other.def_ == from)
+                    FSM_ERROR(other, "reload rejected: " + why);
+            return;
+        }
+        moving.emplace_back(&inst, std::move(next));
+    }
+
+    json diff = diff_definitions(*from, *to);
+    diff["from"] = from->name;
+    diff["to"]   = to->name;
+
+    if (!moving.empty())
+        batches_dirty_ = true;
+
+    for (auto& [inst, next] : moving) {
+        inst->def_    = to;
+        inst->active_ = std::move(next);
+        bind_beliefs(*inst);
+        inst->regs_.last_error_.clear();
+        inst->last_reload_ = diff;
+        inst->history_.clear();   // recorded ids were the old table's
+
+        for (auto& a : inst->active_)
+            arm_timers(*inst, a);
+
+        // regions the new table added to an active composite start at
+        // their initial states
+        for (size_t i = 0; i < inst->active_.size(); ++i) {
+            const int state = inst->active_[i].state;
+            for (int r : to->states[state].regions) {
+                bool occupied = false;
+                for (const auto& a : inst->active_)
+                    occupied |= (to->states[a.state].region == r);
+                if (!occupied)
+                    enter_default(*inst, to->regions[r].initial, false);
+            }
+        }
+        update_current(*inst);
+
+        if (!to->remote_registers.empty() && inst->regs_.target_sba_ != 0 &&
+            !mirrors_.count(inst->regs_.target_sba_))
+            subscribe_registers(inst->regs_.target_sba_);
+
+        // a fix may have given a terminal state a way out, or taken it away
+        if (is_terminal(*inst))
+            enter_quiescence(*inst);
+        else if (inst->regs_.quiescent_)
+            wake(*inst);
     }
 }
 
 // -----------------------------------------------------------------------------
 // Time Plane
+//
+// One tick drives every hosted instance. BLS is polled once per tick and
+// the snapshot is shared; parked and stopped instances cost nothing.
+//
+// Flat instances are stepped definition by definition, in id order within
+// each: their batch picks every transition the masks enable in one pass,
+// and only the picks are acted on here. A pick with guard bytecode, and
+// every instance of a composite definition, goes through step().
 // -----------------------------------------------------------------------------
 void Fsm::on_tick()
 {
-    poll_bls();
-    step();
+    const uint64_t t0 = mpp::now_ns();
+    ++ticks_;
+
+    while (!tick_timers_.empty() && tick_timers_.top().due <= ticks_) {
+        const Timer timer = tick_timers_.top();
+        tick_timers_.pop();
+        expire(timer, false);   // stepped below with everyone else
+    }
+
+    refresh_mirrors();
+
+    if (batches_dirty_)
+        rebuild_batches();
+
+    bool polled = false;
+    auto poll_once = [&] {
+        if (!polled) {
+            poll_bls();
+            polled = true;
+        }
+    };
+
+    for (FsmBatch& b : batches_) {
+        for (int32_t i : b.owners_)
+            if (b.live_[i])
+                own_view(*b.instance_[i], b.definition()->mask_words,
+                         b.own_mask(i), b.own_true(i), b.own_false(i));
+        b.select(observed_true_.data(), observed_false_.data());
+
+        const FsmDefinition& def = *b.definition();
+        for (size_t i = 0; i < b.size(); ++i) {
+            if (!b.live_[i])
+                continue;
+            poll_once();
+
+            FsmInstance& inst = *b.instance_[i];
+            const int32_t t = b.picked_[i];
+
+            if (t == FsmBatch::NONE) {
+                if (b.moved_[i]) {   // what step() would reset
+                    inst.regs_.transition_fired_ = false;
+                    inst.regs_.next_state_.clear();
+                    b.moved_[i] = 0;
+                }
+            } else if (t == FsmBatch::TERMINAL || def.has_program(t)) {
+                step(inst);
+            } else {
+                fire(inst, t);
+                settle(inst);
+            }
+        }
+    }
+
+    for (FsmInstance* inst : unbatched_) {
+        if (!inst->regs_.run_ || inst->regs_.quiescent_)
+            continue;
+        poll_once();
+        step(*inst);
+    }
+
+    // A TCK may be shared by several instances; only silence it once none
+    // of them can move any more.
+    if (!parked_tcks_.empty()) {
+        std::set<int> busy;   // parked TCKs still driving a live instance
+        auto live = [&](int tck) {
+            if (parked_tcks_.count(tck))
+                busy.insert(tck);
+        };
+        for (const FsmBatch& b : batches_)
+            for (size_t i = 0; i < b.size(); ++i)
+                if (b.live_[i])
+                    live(b.tck_[i]);
+        for (const FsmInstance* inst : unbatched_)
+            if (inst->regs_.run_ && !inst->regs_.quiescent_)
+                live(inst->regs_.tck_sba_);
+
+        for (int tck : parked_tcks_)
+            if (!busy.count(tck))
+                route_tck(tck, TCK_DISABLE);
+        parked_tcks_.clear();
+    }
+
+    tick_ns_.record(mpp::now_ns() - t0);
+}
+
+// Batches in order of first use, slots in instance id order.
+void Fsm::rebuild_batches()
+{
+    batches_.clear();
+    unbatched_.clear();
+    batches_dirty_ = false;
+
+    for (auto& [id, inst] : instances_) {
+        inst.batch_ = inst.slot_ = -1;
+        if (!inst.def_ || inst.def_->hierarchical()) {
+            unbatched_.push_back(&inst);
+            continue;
+        }
+
+        size_t b = 0;
+        while (b < batches_.size() && batches_[b].definition() != inst.def_)
+            ++b;
+        if (b == batches_.size())
+            batches_.emplace_back(inst.def_);
+
+        // an own row only where the masks would read it; bytecode reads
+        // go through step(), which builds the whole view
+        FsmBatch& batch = batches_[b];
+        bool own = false;
+        for (const auto& [guard_id, copy] : inst.read_as_)
+            own |= batch.reads(guard_id);
+        for (uint64_t w : inst.def_->deadline_mask)
+            own |= (w != 0);
+
+        inst.batch_ = static_cast<int>(b);
+        inst.slot_  = batch.add(&inst, own);
+        sync_slot(inst);
+    }
+}
+
+void Fsm::sync_slot(const FsmInstance& inst)
+{
+    if (batches_dirty_ || inst.batch_ < 0)
+        return;   // placed afresh at the next tick
+
+    FsmBatch& b = batches_[inst.batch_];
+    const FsmRegisters& regs = inst.regs_;
+    const int i = inst.slot_;
+
+    b.state_[i] = inst.active_.empty() ? b.definition()->initial : inst.active_[0].state;
+    b.tck_[i]   = regs.tck_sba_;
+    b.live_[i]  = regs.run_ && !regs.quiescent_ && !inst.active_.empty();
+    b.moved_[i] = regs.transition_fired_;
+}
+
+void Fsm::on_metrics()
+{
+    instances_gauge_.set(static_cast<int64_t>(instances_.size()));
+}
+
+void Fsm::on_idle()
+{
+    if (ms_timers_.empty())
+        return;
+
+    const uint64_t now = mpp::now_ns();
+    while (!ms_timers_.empty() && ms_timers_.top().due <= now) {
+        const Timer timer = ms_timers_.top();
+        ms_timers_.pop();
+        expire(timer, true);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Timers
+// -----------------------------------------------------------------------------
+// Timers count from the entry into the state, so re-arming after a reload
+// keeps time already spent there; anything already due fires right away.
+void Fsm::arm_timers(FsmInstance& inst, FsmInstance::Active& a)
+{
+    a.entry = ++next_entry_;   // orphans timers armed before
+
+    const auto& s = inst.def_->states[a.state];
+
+    for (uint32_t ms : s.after_ms)
+        ms_timers_.push({a.entered_ns + ms * 1000000ull, a.entry, false, inst.id});
+    for (uint32_t n : s.after_ticks)
+        tick_timers_.push({a.entered_tick + n, a.entry, false, inst.id});
+
+    if (s.deadline_ms)
+        ms_timers_.push({a.entered_ns + s.deadline_ms * 1000000ull, a.entry, true, inst.id});
+    if (s.deadline_ticks)
+        tick_timers_.push({a.entered_tick + s.deadline_ticks, a.entry, true, inst.id});
+}
+
+void Fsm::expire(const Timer& timer, bool step_now)
+{
+    auto it = instances_.find(timer.instance);
+    if (it == instances_.end())
+        return;
+
+    FsmInstance& inst = it->second;
+
+    FsmInstance::Active* a = nullptr;
+    for (auto& x : inst.active_)
+        if (x.entry == timer.entry)
+            a = &x;
+    if (!a)
+        return;   // left the state since the timer was armed
+
+    const auto& s = inst.def_->states[a->state];
+
+    if (timer.deadline) {
+        a->timed_out = true;   // read by this instance's guards (build_view)
+
+        // for everyone else; the belief is permanent in BLS, so our own
+        // guards never read it back from there
+        json ctx;
+        ctx["state"]    = s.name;
+        ctx["instance"] = inst.id;
+        const std::string& subject = inst.written_.empty()
+            ? s.deadline_subject
+            : inst.written_[a->state].deadline;
+        commit(subject.c_str(), true, ctx);
+    }
+
+    if (step_now && inst.regs_.run_ && !inst.regs_.quiescent_)
+        step(inst);
+}
+
+const FsmInstance::Active* FsmInstance::find_active(int state) const
+{
+    for (const auto& a : active_)
+        if (a.state == state)
+            return &a;
+    return nullptr;
 }
 
 // -----------------------------------------------------------------------------
 // FSM Core
 // -----------------------------------------------------------------------------
-void Fsm::step()
+void Fsm::step(FsmInstance& inst)
 {
-    regs_.transition_fired_ = false;
-    regs_.next_state_.clear();
+    FsmRegisters& regs = inst.regs_;
+
+    regs.transition_fired_ = false;
+    regs.next_state_.clear();
+
+    if (!inst.def_ || inst.active_.empty())
+        return;
 
-    auto it = transitions_.find(regs_.current_state_);
-    if (it == transitions_.end())
+    const FsmDefinition& def = *inst.def_;
+
+    if (is_terminal(inst)) {
+        enter_quiescence(inst);
         return;
+    }
+
+    build_view(inst);
+
+    if (!def.hierarchical()) {
+        const int fired = select_transition(inst, inst.active_[0].state);
+        if (fired >= 0)
+            fire(inst, fired);
+    } else {
+        // leaves as of the start of the step; one entered by a transition
+        // this step waits for the next one
+        leaves_.clear();
+        seen_.clear();
+        for (const auto& a : inst.active_)
+            if (!def.states[a.state].composite())
+                leaves_.emplace_back(a.state, a.entry);
+
+        for (const auto& [leaf, entry] : leaves_) {
+            const FsmInstance::Active* a = inst.find_active(leaf);
+            if (!a || a->entry != entry)
+                continue;   // exited by an earlier transition this step
+
+            for (int s = leaf; s >= 0; s = def.states[s].parent) {
+                if (def.states[s].composite()) {
+                    if (std::find(seen_.begin(), seen_.end(), s) != seen_.end())
+                        break;   // tried from a sibling region already
+                    seen_.push_back(s);
+                }
+
+                const int fired = select_transition(inst, s);
+                if (fired >= 0) {
+                    fire(inst, fired);
+                    break;
+                }
+            }
+        }
+    }
+
+    if (regs.transition_fired_)
+        settle(inst);
+}
+
+void Fsm::settle(FsmInstance& inst)
+{
+    update_current(inst);
+    inst.regs_.last_error_.clear();
+
+    if (is_terminal(inst))
+        enter_quiescence(inst);
+}
+
+// Deadline subjects of the definition are true for an active entry whose
+// deadline expired and false for one still waiting, whatever BLS says.
+void Fsm::build_view(const FsmInstance& inst)
+{
+    view_true_  = observed_true_;
+    view_false_ = observed_false_;
+
+    const size_t words = view_true_.size();
+    own_.resize(3 * words);
+    uint64_t* mask = own_.data();
+    own_view(inst, words, mask, mask + words, mask + 2 * words);
+
+    for (size_t w = 0; w < words; ++w) {
+        view_true_[w]  = (view_true_[w] & ~mask[w]) | mask[words + w];
+        view_false_[w] = (view_false_[w] & ~mask[w]) | mask[2 * words + w];
+    }
+}
+
+void Fsm::own_view(const FsmInstance& inst, size_t words,
+                   uint64_t* mask, uint64_t* own_true, uint64_t* own_false) const
+{
+    std::fill(mask, mask + words, 0);
+    std::fill(own_true, own_true + words, 0);
+    std::fill(own_false, own_false + words, 0);
 
-    for (const auto& t : it->second) {
-        if (!evaluate_transition(t))
+    auto bit = [](const std::vector<uint64_t>& bits, int id) {
+        return (bits[id / 64] >> (id % 64)) & 1;
+    };
+    for (const auto& [id, own] : inst.read_as_) {
+        if (size_t(id / 64) >= words)
             continue;
+        mask[id / 64]      |= uint64_t(1) << (id % 64);
+        own_true[id / 64]  |= bit(observed_true_, own) << (id % 64);
+        own_false[id / 64] |= bit(observed_false_, own) << (id % 64);
+    }
+
+    const FsmDefinition& def = *inst.def_;
+    for (size_t w = 0; w < def.deadline_mask.size() && w < words; ++w) {
+        mask[w]      |= def.deadline_mask[w];
+        own_true[w]  &= ~def.deadline_mask[w];
+        own_false[w] &= ~def.deadline_mask[w];
+    }
+
+    for (const auto& a : inst.active_) {
+        const int id = def.states[a.state].deadline_id;
+        if (id >= 0 && size_t(id / 64) < words)
+            (a.timed_out ? own_true : own_false)[id / 64] |= uint64_t(1) << (id % 64);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Statecharts
+// -----------------------------------------------------------------------------
+namespace {
 
-        regs_.next_state_ = t.to;
-        regs_.current_state_ = t.to;
-        regs_.transition_fired_ = true;
-        regs_.last_error_.clear();
+// least common proper ancestor: the states below it on the source side are
+// left and re-entered as a whole (external transitions, as in UML)
+int transition_domain(const FsmDefinition& def, int from, int to)
+{
+    for (int p = def.states[from].parent; p >= 0; p = def.states[p].parent)
+        if (p != to && def.is_descendant(to, p))
+            return p;
+    return -1;
+}
+
+} // namespace
+
+void Fsm::enter_initial(FsmInstance& inst)
+{
+    inst.active_.clear();
+    enter_path(inst, -1, inst.def_->initial, false);
+    update_current(inst);
+}
+
+void Fsm::fire(FsmInstance& inst, int t)
+{
+    const FsmDefinition& def = *inst.def_;
+    const auto& tr = def.transitions[t];
+
+    const int domain = transition_domain(def, tr.from, tr.to);
+
+    int exited = tr.from;
+    while (def.states[exited].parent != domain)
+        exited = def.states[exited].parent;
+
+    auto& active = inst.active_;
+    active.erase(std::remove_if(active.begin(), active.end(),
+                     [&](const FsmInstance::Active& a) {
+                         return def.is_descendant(a.state, exited);
+                     }),
+                 active.end());
+
+    entered_.clear();
+    enter_path(inst, domain, tr.to, true);
+
+    inst.regs_.next_state_       = def.states[tr.to].name;
+    inst.regs_.transition_fired_ = true;
+    update_current(inst);
+
+    record_matched(inst, t, inst.history_.record(mpp::now_ns(), ticks_, bls_revision_,
+                                                 t, tr.from, tr.to));
+    transitions_total_.add();
+
+    // effects once the configuration is final, so $REG.current_state in a
+    // note already names where the machine went
+    for (int state : entered_) {
+        const auto& st = def.states[state];
 
         // State belief
-        commit(("FSM.state." + t.to).c_str(), true);
+        const FsmNote& out = st.payloads;
+        if (inst.written_.empty())
+            commit_prepared(out.state_subject, true, nlohmann::json::object(),
+                            out.state_bytes);
+        else
+            commit(inst.written_[state].state.c_str(), true);
 
-        auto note_it = state_notes_.find(t.to);
-        if (note_it != state_notes_.end()) {
-            regs_.last_applied_state_ = t.to;
-            apply_state_note(note_it->second);
+        if (out.has_note) {
+            inst.regs_.last_applied_state_ = st.name;
+            apply_state_note(inst, state);
         }
+    }
+}
 
-        return; // exactly one transition per tick
+void Fsm::enter_path(FsmInstance& inst, int domain, int target, bool effects)
+{
+    const FsmDefinition& def = *inst.def_;
+
+    path_.clear();
+    for (int s = target; s != domain; s = def.states[s].parent)
+        path_.push_back(s);
+
+    // outermost first; a composite on the way starts its other regions
+    for (size_t i = path_.size() - 1; i > 0; --i) {
+        activate(inst, path_[i], effects);
+        for (int r : def.states[path_[i]].regions)
+            if (r != def.states[path_[i - 1]].region)
+                enter_default(inst, def.regions[r].initial, effects);
+    }
+
+    enter_default(inst, target, effects);
+}
+
+void Fsm::enter_default(FsmInstance& inst, int state, bool effects)
+{
+    activate(inst, state, effects);
+
+    for (int r : inst.def_->states[state].regions)
+        enter_default(inst, inst.def_->regions[r].initial, effects);
+}
+
+// Initial entry (PUT, reload) only arms timers; states entered by a
+// transition are queued for fire() to commit and route.
+void Fsm::activate(FsmInstance& inst, int state, bool effects)
+{
+    FsmInstance::Active a;
+    a.state        = state;
+    a.entered_ns   = mpp::now_ns();
+    a.entered_tick = ticks_;
+    arm_timers(inst, a);
+    inst.active_.push_back(a);
+
+    if (effects)
+        entered_.push_back(state);
+}
+
+// current_state: the active leaf, or every active leaf joined with ','
+void Fsm::update_current(FsmInstance& inst)
+{
+    const FsmDefinition& def = *inst.def_;
+    std::string& current = inst.regs_.current_state_;
+
+    // leaves in region order, so the name does not depend on which region
+    // moved last
+    order_.clear();
+    for (const auto& a : inst.active_)
+        if (!def.states[a.state].composite())
+            order_.push_back(a.state);
+    std::sort(order_.begin(), order_.end(), [&](int x, int y) {
+        return def.states[x].region < def.states[y].region;
+    });
+
+    current.clear();
+    for (int state : order_) {
+        if (!current.empty())
+            current += ",";
+        current += def.states[state].name;
     }
+    sync_slot(inst);
 }
 
 // -----------------------------------------------------------------------------
 // Guard Evaluation
+//
+// Belief atoms are mask tests; anything else (or / not / register and
+// context comparisons) runs as guard bytecode against an InstanceEnv.
 // -----------------------------------------------------------------------------
-bool Fsm::evaluate_transition(const Transition& t)
+namespace {
+
+GuardValue guard_value_of(const json& v)
 {
-    for (const auto& subject : t.beliefs) {
-        auto it = observed_beliefs_.find(subject);
-        if (it == observed_beliefs_.end())
-            return false;
-        if (!it->second)
+    if (v.is_boolean()) return GuardValue::of(v.get<bool>());
+    if (v.is_number())  return GuardValue::of(v.get<double>());
+    if (v.is_string())  return GuardValue::of(std::string_view(v.get_ref<const std::string&>()));
+    return {};
+}
+
+GuardValue register_value(const FsmRegisters& r, FsmReg reg)
+{
+    switch (reg) {
+        case FsmReg::sba:                return GuardValue::of(r.sba_);
+        case FsmReg::target_sba:         return GuardValue::of(r.target_sba_);
+        case FsmReg::tck_sba:            return GuardValue::of(r.tck_sba_);
+        case FsmReg::run:                return GuardValue::of(r.run_);
+        case FsmReg::loaded:             return GuardValue::of(r.loaded_);
+        case FsmReg::current_state:      return GuardValue::of(std::string_view(r.current_state_));
+        case FsmReg::next_state:         return GuardValue::of(std::string_view(r.next_state_));
+        case FsmReg::transition_fired:   return GuardValue::of(r.transition_fired_);
+        case FsmReg::quiescent:          return GuardValue::of(r.quiescent_);
+        case FsmReg::last_applied_state: return GuardValue::of(std::string_view(r.last_applied_state_));
+        case FsmReg::last_error:         return GuardValue::of(std::string_view(r.last_error_));
+        case FsmReg::count:              break;
+    }
+    return {};
+}
+
+// JSON text of a register value, for $REG holes in "_send" payloads
+void append_value(std::string& out, const GuardValue& v)
+{
+    switch (v.kind) {
+        case GuardValue::Bool:
+            out += v.b ? "true" : "false";
+            return;
+        case GuardValue::Number:   // FsmRegisters numbers are all ints
+            out += std::to_string(static_cast<long long>(v.num));
+            return;
+        case GuardValue::String:
+            out += json(std::string(v.str)).dump();
+            return;
+        case GuardValue::None:
+            break;
+    }
+    out += "null";
+}
+
+struct InstanceEnv : GuardEnv
+{
+    const FsmInstance*                    inst     = nullptr;
+    const std::unordered_map<int, json>*  contexts = nullptr;
+    const RegisterMirror*                 mirror   = nullptr;   // fresh only
+    const FsmInstance::Active*            at       = nullptr;   // source state
+    uint64_t                              ticks    = 0;
+
+    uint64_t elapsed_ms() const override
+    {
+        return (mpp::now_ns() - at->entered_ns) / 1000000;
+    }
+
+    uint64_t elapsed_ticks() const override
+    {
+        return ticks - at->entered_tick;
+    }
+
+    GuardValue local(FsmReg reg) const override
+    {
+        return register_value(inst->regs_, reg);
+    }
+
+    GuardValue remote(int slot) const override
+    {
+        if (!mirror)
+            return {};
+
+        const json* v = mirror->slot(inst->def_->remote_slots[slot]);
+        return v ? guard_value_of(*v) : GuardValue{};
+    }
+
+    GuardValue context(int slot) const override
+    {
+        const GuardContextRef& ref = inst->def_->contexts[slot];
+
+        auto it = contexts->find(ref.subject);
+        if (it == contexts->end())
+            return {};
+
+        const json* v = &it->second;
+        for (const auto& key : ref.path) {
+            if (!v->is_object())
+                return {};
+            auto f = v->find(key);
+            if (f == v->end())
+                return {};
+            v = &*f;
+        }
+        return guard_value_of(*v);
+    }
+};
+
+} // namespace
+
+bool Fsm::evaluate_transition(const FsmInstance& inst, int t) const
+{
+    const FsmDefinition& def = *inst.def_;
+
+    if (!fsm_covers(view_true_.data(), view_false_.data(),
+                    def.need_true(t), def.need_false(t), def.mask_words))
+        return false;
+
+    if (!def.has_program(t))
+        return true;
+
+    InstanceEnv env;
+    env.observed_true  = view_true_.data();
+    env.observed_false = view_false_.data();
+    env.words          = view_true_.size();
+    env.inst           = &inst;
+    env.contexts       = &observed_context_;
+    env.mirror         = fresh_mirror(inst.regs_.target_sba_);
+    env.at             = inst.find_active(def.transitions[t].from);
+    env.ticks          = ticks_;
+
+    return fsm_eval_guard(def, t, env);
+}
+
+int Fsm::select_transition(const FsmInstance& inst, int state) const
+{
+    const FsmDefinition& def = *inst.def_;
+    const auto& from  = def.states[state];
+    const int   first = from.first_transition;
+    const int   end   = first + from.transition_count;
+
+    if (def.mask_words != 1) {
+        for (int i = first; i < end; ++i)
+            if (evaluate_transition(inst, i))
+                return i;
+        return -1;
+    }
+
+    // Single-word masks: test the remaining outgoing transitions at once,
+    // then confirm the candidate's bytecode (if any).
+    for (int i = first; i < end; ++i) {
+        const int k = fsm_first_match(view_true_[0], view_false_[0],
+                                      def.need_true(i), def.need_false(i),
+                                      end - i);
+        if (k < 0)
+            return -1;
+
+        i += k;
+        if (evaluate_transition(inst, i))
+            return i;
+    }
+    return -1;
+}
+
+// -----------------------------------------------------------------------------
+// Quiescence
+//
+// A terminal state has no outgoing transitions, so polling BLS from it can
+// never change anything. Park the instance: ticks skip it, and once no live
+// instance shares its TCK the TCK is told to stop until a PUT / POST wakes
+// the instance up again.
+// -----------------------------------------------------------------------------
+bool Fsm::is_terminal(const FsmInstance& inst) const
+{
+    if (!inst.def_ || inst.active_.empty())
+        return false;
+
+    // all active leaves terminal (which rules out their ancestors moving)
+    for (const auto& a : inst.active_) {
+        const auto& st = inst.def_->states[a.state];
+        if (!st.composite() && !st.terminal)
             return false;
     }
     return true;
 }
 
+void Fsm::enter_quiescence(FsmInstance& inst)
+{
+    inst.regs_.quiescent_ = true;
+    parked_tcks_.insert(inst.regs_.tck_sba_);
+    sync_slot(inst);
+}
+
+void Fsm::wake(FsmInstance& inst)
+{
+    if (!inst.regs_.loaded_ || is_terminal(inst))
+        return;   // still nothing to evaluate; stay parked
+
+    inst.regs_.quiescent_ = false;
+    route_tck(inst.regs_.tck_sba_, TCK_ENABLE);
+    sync_slot(inst);
+}
+
 // -----------------------------------------------------------------------------
 // Intent Routing
 // -----------------------------------------------------------------------------
-void Fsm::apply_state_note(const json& note)
+void Fsm::apply_state_note(FsmInstance& inst, int state)
 {
-    if (note.contains("_commit"))
-        route_commit(note["_commit"]);
+    const FsmNote& note = inst.def_->states[state].payloads;
+
+    if (note.has_commit)
+        route_commit(inst, state);
 
-    if (note.contains("_send"))
-        route_send(note["_send"]);
+    if (!note.send.empty())
+        route_send(inst, note.send);
 
-    if (note.contains("_tck"))
-        route_tck(note["_tck"]);
+    if (!note.tck_bytes.empty())
+        route_tck(inst.regs_.tck_sba_, note.tck_bytes);
 }
 
-void Fsm::route_commit(const json& c)
+void Fsm::route_commit(const FsmInstance& inst, int state)
 {
-    std::string subject = c.value("subject","");
-    if (subject.empty())
+    const FsmNote& note = inst.def_->states[state].payloads;
+
+    if (!inst.written_.empty()) {
+        commit(inst.written_[state].commit.c_str(),
+               note.commit_polarity,
+               note.commit_context);
         return;
+    }
 
-    commit(subject.c_str(),
-           c.value("polarity", true),
-           c.value("context", json::object()));
+    commit_prepared(note.commit_subject,
+                    note.commit_polarity,
+                    note.commit_context,
+                    note.commit_bytes);
 }
 
-void Fsm::route_send(json payload)
+void Fsm::route_send(FsmInstance& inst, const FsmPayload& payload)
 {
-    if (regs_.target_sba_ == 0)
+    if (inst.regs_.target_sba_ == 0)
+        return;
+
+    if (payload.constant()) {
+        send_bytes(payload.chunks[0], inst.regs_.target_sba_);
         return;
+    }
 
-    substitute_register_refs(payload);
-    send_json(payload, regs_.target_sba_);
+    substitute_register_refs(inst, payload, send_buf_);
+    send_bytes(send_buf_, inst.regs_.target_sba_);
 }
 
-void Fsm::route_tck(const json& t)
+void Fsm::route_tck(int tck_sba, std::string_view bytes)
 {
-    if (regs_.tck_sba_ == 0)
+    if (tck_sba == 0)
         return;
 
-    send_json(t, regs_.tck_sba_);
+    send_bytes(bytes, tck_sba);
 }
 
 // -----------------------------------------------------------------------------
@@ -190,126 +1460,222 @@ void Fsm::route_tck(const json& t)
 // -----------------------------------------------------------------------------
 void Fsm::poll_bls()
 {
+    if (subjects_->names.size() != bls_prefixes_for_)
+        update_bls_prefixes();
+
     json req;
     req["verb"] = "GET";
     req["resource"] = "beliefs";
+    if (want_contexts_)
+        req["contexts"] = true;
+    if (!bls_prefixes_.empty())
+        req["prefix"] = bls_prefixes_;
 
     send_json(req, bls_sba_);
 }
 
+void Fsm::update_bls_prefixes()
+{
+    bls_prefixes_for_ = subjects_->names.size();
+    bls_prefixes_ = json::array();
+
+    std::set<std::string> namespaces;
+    for (const std::string& subject : subjects_->names) {
+        const size_t dot = subject.rfind('.');
+        if (dot == std::string::npos)
+            return;   // no namespace to narrow to
+        namespaces.insert(subject.substr(0, dot + 1));
+    }
+
+    // sorted, so "FSM." comes before the "FSM.XFR." it covers
+    std::string last;
+    for (const std::string& ns : namespaces) {
+        if (!last.empty() && ns.starts_with(last))
+            continue;
+        bls_prefixes_.push_back(ns);
+        last = ns;
+    }
+}
+
 void Fsm::on_message(const json& j)
 {
     if (!j.is_object())
         return;
 
     if (j.contains("beliefs")) {
-        observed_beliefs_.clear();
+        if (j.contains("revision") && j["revision"].is_number_unsigned())
+            bls_revision_ = j["revision"].get<uint64_t>();
+
+        std::fill(observed_true_.begin(), observed_true_.end(), 0);
+        std::fill(observed_false_.begin(), observed_false_.end(), 0);
+
         for (auto it = j["beliefs"].begin();
              it != j["beliefs"].end(); ++it)
         {
-            observed_beliefs_[it.key()] = it.value().get<bool>();
+            const int id = subjects_->find(it.key());
+            if (id < 0)
+                continue;   // no loaded guard mentions it
+
+            auto& bits = it.value().get<bool>() ? observed_true_
+                                                : observed_false_;
+            bits[id / 64] |= uint64_t(1) << (id % 64);
+        }
+
+        if (j.contains("contexts") && j["contexts"].is_object()) {
+            observed_context_.clear();
+            for (auto it = j["contexts"].begin();
+                 it != j["contexts"].end(); ++it)
+            {
+                const int id = subjects_->find(it.key());
+                if (id >= 0)
+                    observed_context_[id] = it.value();
+            }
         }
         return;
     }
+
+    // ---- target registers ----
+    if (j.contains("registers")) {
+        apply_registers(j);
+        return;
+    }
 }
 
 // -----------------------------------------------------------------------------
-// PlantUML Parser
+// Register mirrors
 // -----------------------------------------------------------------------------
-bool Fsm::parse_plantuml(const std::string& text)
-{
-    transitions_.clear();
-    state_notes_.clear();
-    state_order_.clear();
-
-    std::istringstream iss(text);
-    std::string line;
-    bool any = false;
-
-    while (std::getline(iss, line)) {
-        auto arrow = line.find("-->");
-        if (arrow != std::string::npos) {
-            std::string from = line.substr(0, arrow);
-            std::string rest = line.substr(arrow + 3);
-
-            auto colon = rest.find(':');
-            std::string to = (colon == std::string::npos)
-                           ? rest
-                           : rest.substr(0, colon);
-
-            trim(from);
-            trim(to);
-
-            Transition t;
-            t.from = from;
-            t.to   = to;
-            t.guards = json::object();
-
-            if (colon != std::string::npos) {
-                std::string conds = rest.substr(colon + 1);
-                trim(conds);
-
-                if (conds.rfind("belief ", 0) == 0) {
-                    std::string subj = conds.substr(7);
-                    trim(subj);
-                    t.beliefs.push_back(subj);
-                }
-            }
+void Fsm::subscribe_registers(int target_sba)
+{
+    RegisterMirror& m = mirrors_[target_sba];
+    m.asked_ns = mpp::now_ns();
 
-            transitions_[from].push_back(t);
-            continue;
-        }
+    json req;
+    req["verb"]     = "POST";
+    req["resource"] = "registers";
+    req["action"]   = "subscribe";
+    req["sba"]      = sba_;
 
-        if (line.rfind("note right of ", 0) == 0) {
-            std::string state = line.substr(14);
-            trim(state);
+    send_json(req, target_sba);
+}
 
-            if (!state_notes_.count(state))
-                state_order_.push_back(state);
+void Fsm::apply_registers(const json& j)
+{
+    const json& r = j["registers"];
+    if (!r.is_object())
+        return;
 
-            std::string body;
-            while (std::getline(iss, line)) {
-                if (line.find("end note") != std::string::npos)
-                    break;
-                body += line + "\n";
-            }
+    const int from = j.value("sba", r.value("sba", int(ntohs(last_sender_.sin_port))));
+    RegisterMirror& m = mirrors_[from];
 
-            try {
-                state_notes_[state] = json::parse(body);
-                any = true;
-            } catch (...) {
-                state_notes_[state] = json{{"_raw", body}};
+    // no revision: an unsolicited full dump (e.g. a GET reply)
+    const bool     full     = j.value("full", !j.contains("revision"));
+    const uint64_t revision = j.value("revision", m.revision);
+
+    if (full) {
+        m.values   = r;
+        m.revision = revision;
+        m.synced   = true;
+        index_mirror(m, 0);
+    } else {
+        if (!m.synced || revision <= m.revision)
+            return;   // before the first full snapshot, or a duplicate
+
+        if (revision != m.revision + 1) {
+            m.synced = false;   // lost a delta; refresh_mirrors() resyncs
+            return;
+        }
+
+        for (auto it = r.begin(); it != r.end(); ++it) {
+            m.values[it.key()] = it.value();
+
+            auto s = register_slots_.find(it.key());
+            if (s != register_slots_.end() && size_t(s->second) < m.slot_text.size()) {
+                m.slot_values[s->second] = it.value();
+                m.slot_text[s->second]   = it.value().dump();
             }
         }
+        m.revision = revision;
+    }
+
+    m.updated_ns = mpp::now_ns();
+}
+
+void Fsm::index_mirror(RegisterMirror& m, size_t first)
+{
+    m.slot_values.resize(register_names_.size());
+    m.slot_text.resize(register_names_.size());
+
+    for (size_t id = first; id < register_names_.size(); ++id) {
+        const json* v = m.find(register_names_[id]);
+        m.slot_values[id] = v ? *v : json();
+        m.slot_text[id]   = v ? v->dump() : std::string();
+    }
+}
+
+void Fsm::refresh_mirrors()
+{
+    const uint64_t now   = mpp::now_ns();
+    const uint64_t limit = mirror_stale_ms_ * 1000000ull;
+
+    for (auto& [sba, m] : mirrors_) {
+        if (m.asked_ns == 0)
+            continue;   // pushed to us unasked; nothing to renew
+
+        const bool stale = !m.synced || now - m.updated_ns > limit;
+        if (stale && now - m.asked_ns > limit / 4)
+            subscribe_registers(sba);
     }
+}
+
+const RegisterMirror* Fsm::fresh_mirror(int target_sba) const
+{
+    auto it = mirrors_.find(target_sba);
+    if (it == mirrors_.end() || !it->second.synced)
+        return nullptr;
 
-    return any;
+    const RegisterMirror& m = it->second;
+    if (mpp::now_ns() - m.updated_ns > mirror_stale_ms_ * 1000000ull)
+        return nullptr;
+    return &m;
 }
 
 // -----------------------------------------------------------------------------
 // Substitution
+//
+// Holes were bound when the definition was compiled: FsmRegisters fields are
+// read from the instance, anything else is copied from the text the mirror
+// of the instance's target keeps for the hole's slot.
 // -----------------------------------------------------------------------------
-void Fsm::substitute_register_refs(json& j)
+void Fsm::substitute_register_refs(const FsmInstance& inst,
+                                   const FsmPayload& payload,
+                                   std::string& out)
 {
-    for (auto it = j.begin(); it != j.end(); ++it) {
-        if (!it->is_string())
-            continue;
+    auto it = mirrors_.find(inst.regs_.target_sba_);
+    const RegisterMirror* mirror = it == mirrors_.end() ? nullptr : &it->second;
+    const std::vector<int>& slots = inst.def_->remote_slots;
 
-        const std::string s = it->get<std::string>();
-        if (s.rfind("$REG.", 0) != 0)
-            continue;
+    payload.render(out, [&](std::string& o, const FsmPayload::Hole& h) {
+        if (h.local >= 0) {
+            append_value(o, register_value(inst.regs_, FsmReg(h.local)));
+            return;
+        }
 
-        it.value() = nullptr; // placeholder until register polling exists
-    }
+        if (mirror && mirror->slot(slots[h.remote])) {
+            o += mirror->slot_text[slots[h.remote]];
+            return;
+        }
+
+        o += "null";   // not (yet) published by the target
+    });
 }
 
 // -----------------------------------------------------------------------------
 // Errors
 // -----------------------------------------------------------------------------
-void Fsm::set_error(const std::string& msg,
-                    const char* file,
-                    int line,
-                    const char* func)
+void FsmInstance::set_error(const std::string& msg,
+                            const char* file,
+                            int line,
+                            const char* func)
 {
     std::ostringstream oss;
     oss << msg << " | " << file << ":" << line << " in " << func;
@@ -1,9 +1,16 @@
 #pragma once
 
 #include "Component.hpp"
+#include "FsmBatch.hpp"
+#include "FsmDefinition.hpp"
+#include "FsmHistory.hpp"
 
 #include <string>
 #include <map>
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include <queue>
 #include <vector>
 #include <set>
 
@@ -24,13 +31,106 @@ struct FsmRegisters
     std::string current_state_;
     std::string next_state_;
     bool        transition_fired_ = false;
+    bool        quiescent_  = false;   // parked in a terminal state
 
     std::string last_applied_state_;
     std::string last_error_;
 };
 
+// -----------------------------------------------------------------------------
+// Register mirror (a target component's registers, as it last published them)
+//
+// Targets push {"registers": {...}, "revision": R, "full": bool} to
+// subscribers: a full snapshot replaces the mirror, a delta (only changed
+// registers) applies on top if it is exactly revision + 1. A gap or silence
+// longer than the stale limit makes the Fsm re-subscribe, which the target
+// answers with a full snapshot.
+//
+// The registers loaded definitions read are also kept by slot (Fsm's
+// register_names_), value and JSON text, so guards and "$REG" holes index
+// instead of searching by name on every evaluation or send.
+// -----------------------------------------------------------------------------
+struct RegisterMirror
+{
+    json     values     = json::object();
+    uint64_t revision   = 0;
+    uint64_t updated_ns = 0;    // last snapshot or delta applied
+    uint64_t asked_ns   = 0;    // last subscribe sent
+    bool     synced     = false;  // a full snapshot has arrived
+
+    std::vector<json>        slot_values;   // by register slot
+    std::vector<std::string> slot_text;     // dumped; "" = not published
+
+    const json* find(const std::string& name) const
+    {
+        auto it = values.find(name);
+        return it == values.end() ? nullptr : &*it;
+    }
+
+    const json* slot(int id) const
+    {
+        return size_t(id) < slot_text.size() && !slot_text[id].empty()
+            ? &slot_values[id] : nullptr;
+    }
+};
+
+// -----------------------------------------------------------------------------
+// FSM Instance (one running machine; definition shared, registers private)
+// -----------------------------------------------------------------------------
+struct FsmInstance
+{
+    std::string  id;
+    FsmRegisters regs_;
+
+    std::shared_ptr<const FsmDefinition> def_;
+
+    // ---- active configuration ----
+    // Every active state, each composite before the states active inside
+    // it; a flat machine has exactly one. Times feed after() and deadlines.
+    struct Active {
+        int      state        = -1;    // index into def_->states
+        uint64_t entry        = 0;     // unique per state entry
+        uint64_t entered_ns   = 0;
+        uint64_t entered_tick = 0;
+        bool     timed_out    = false; // its "_deadline" expired (this entry only)
+    };
+    std::vector<Active> active_;
+
+    const Active* find_active(int state) const;
+
+    // ---- beliefs of a named instance ----
+    // "FSM.<rest>" subjects the definition writes become "FSM.<id>.<rest>",
+    // so instances never share state, "_commit" or "_deadline" beliefs, and
+    // guards on the definition's own subjects read the instance's copies.
+    // Both are empty for the default instance, which keeps the plain names.
+    struct Written {
+        std::string state;      // FsmNote::state_subject
+        std::string commit;     // FsmNote::commit_subject
+        std::string deadline;   // State::deadline_subject
+    };
+    std::vector<Written>             written_;   // by state
+    std::vector<std::pair<int, int>> read_as_;   // guard subject id -> own copy
+
+    int          batch_ = -1;          // Fsm::batches_ index, -1: stepped alone
+    int          slot_  = -1;          // its slot there
+
+    json         last_reload_;         // diff applied by the last hot reload
+    FsmHistory   history_;             // flight recorder (fired transitions)
+
+    void set_error(const std::string& msg,
+                   const char* file,
+                   int line,
+                   const char* func);
+};
+
 // -----------------------------------------------------------------------------
 // FSM Component (tick-driven, intent-only)
+//
+// Hosts any number of named instances. Requests carry an optional
+// "instance" id; requests without one address the default instance "",
+// which keeps single-machine deployments working unchanged. A named
+// instance's beliefs live under "FSM.<id>." (see FsmInstance::written_),
+// so ids may not contain '.'.
 // -----------------------------------------------------------------------------
 class Fsm : public mpp::Component<Fsm>
 {
@@ -41,74 +141,243 @@ public:
     void apply_snapshot(const json& j);
 
     // ---- time plane ----
-    void on_tick();   // ← THE ONLY PLACE step() is called
+    void on_tick();   // ← steps every live instance
+    void on_idle();   // ← steps only instances whose ms timer expired
 
     void on_message(const json& j);
+    void on_metrics();  // ← gauges read at GET metrics time
 
 protected:
     const char* component_name() const override { return "FSM"; }
 
 private:
     int bls_sba_ = mpp::BLS_PORT;
+    uint64_t bls_revision_ = 0;   // of the last snapshot, if BLS sends one
 
-    std::map<std::string, bool> observed_beliefs_;
+    // FSM series next to the built-in ones in GET metrics
+    mpp::Counter&   transitions_total_ =
+        metrics_.counter("fsm_transitions_total", "Transitions fired, all instances");
+    mpp::Histogram& tick_ns_ =
+        metrics_.histogram("fsm_tick_ns", "on_tick time, every live instance stepped (ns)");
+    mpp::Gauge&     instances_gauge_ =
+        metrics_.gauge("fsm_instances", "Hosted instances");
 
     // -------------------------------------------------------------------------
-    // FSM definition
+    // Observed beliefs (last BLS snapshot) as dense bitsets over the subject
+    // ids shared by every loaded definition. Polarity is tracked separately:
+    // "observed false" is not the same as "not observed".
     // -------------------------------------------------------------------------
-    struct Transition {
-        std::string from;
-        std::string to;
-        json        guards;          // register guards (key=value)
-        std::vector<std::string> beliefs; // belief subjects required
-    };
+    std::shared_ptr<SubjectTable> subjects_ = std::make_shared<SubjectTable>();
+    std::vector<uint64_t> observed_true_;
+    std::vector<uint64_t> observed_false_;
+
+    // The observed beliefs as the instance being stepped sees them. Subjects
+    // the definition writes are read from the instance's own copies
+    // (FsmInstance::read_as_). Deadline subjects come from its own active
+    // entries, never from BLS: a timeout belief is permanent there and would
+    // fire every later entry at once.
+    std::vector<uint64_t> view_true_;
+    std::vector<uint64_t> view_false_;
+    void build_view(const FsmInstance& inst);
+
+    // where inst's view differs: bits under mask read own_true / own_false
+    // (first `words` words; FsmBatch keeps these rows per slot)
+    void own_view(const FsmInstance& inst, size_t words,
+                  uint64_t* mask, uint64_t* own_true, uint64_t* own_false) const;
+    std::vector<uint64_t> own_;   // scratch: build_view's rows
 
-    std::string fsm_text_;
-    std::vector<std::string> state_order_;
-    std::map<std::string, json> state_notes_;
-    std::map<std::string, std::vector<Transition>> transitions_;
+    // belief contexts by subject id, fetched only when a loaded guard
+    // has a ctx(...) predicate
+    std::unordered_map<int, json> observed_context_;
+    bool want_contexts_ = false;
 
     // -------------------------------------------------------------------------
-    // Runtime belief snapshot (polled from BLS)
+    // Target register mirrors, by target sba. Guards read only fresh mirrors
+    // (a stale register compares false); $REG substitution uses the last
+    // value published. The stale limit is one for the process:
+    //
+    //   {"verb":"PUT","resource":"mirrors","stale_ms":3000}
     // -------------------------------------------------------------------------
-    std::map<std::string, bool> beliefs_;
+    std::unordered_map<int, RegisterMirror> mirrors_;
+    uint32_t mirror_stale_ms_ = 3000;   // all mirrors; PUT resource "mirrors"
+
+    // remote register names of every loaded definition, by mirror slot
+    std::vector<std::string>             register_names_;
+    std::unordered_map<std::string, int> register_slots_;
+    void index_mirror(RegisterMirror& m, size_t first);   // slots first.. from values
+
+    void subscribe_registers(int target_sba);
+    void apply_registers(const json& j);
+    void refresh_mirrors();   // re-subscribe to stale or out-of-sync targets
+    const RegisterMirror* fresh_mirror(int target_sba) const;
 
     // -------------------------------------------------------------------------
-    // Registers
+    // Hosted instances and the compiled definitions they share
     // -------------------------------------------------------------------------
-    FsmRegisters regs_;
+    std::map<std::string, FsmInstance> instances_;
+    std::map<std::string, std::shared_ptr<const FsmDefinition>> definitions_;
+
+    // compiled images mapped so far, by path
+    struct MappedImage {
+        uint64_t mtime_ns = 0;
+        uint64_t size     = 0;
+        std::shared_ptr<const FsmDefinition> def;
+    };
+    std::map<std::string, MappedImage> images_;
+
+    // -------------------------------------------------------------------------
+    // Batches (FsmBatch): the flat instances of each definition, in id
+    // order, selected in one pass per tick. Rebuilt at the next tick once
+    // instances come, go or change definition; until then sync_slot()
+    // keeps a slot's columns in step with its instance.
+    // -------------------------------------------------------------------------
+    std::vector<FsmBatch>     batches_;
+    std::vector<FsmInstance*> unbatched_;   // composite definitions, or none yet
+    bool batches_dirty_ = true;
+
+    void rebuild_batches();
+    void sync_slot(const FsmInstance& inst);
+
+    // -------------------------------------------------------------------------
+    // Control plane helpers
+    // -------------------------------------------------------------------------
+    FsmInstance& instance_for(const json& j);
+    json describe(const FsmInstance& inst) const;
+    void put_fsm(FsmInstance& inst, const json& body);
+    void bind_beliefs(FsmInstance& inst);   // written_ / read_as_ for inst.def_
+
+    // flight recorder: newest `limit` records as JSON, or all of them to a
+    // binary file (FsmHistory.hpp)
+    json history(const FsmInstance& inst, size_t limit) const;
+    json history_legend(const FsmInstance& inst) const;
+    bool dump_history(const FsmInstance& inst,
+                      const std::string& path,
+                      std::string& error) const;
+
+    // the subjects transition t's guard read that held in the current view
+    void record_matched(const FsmInstance& inst, int t, FsmHistoryRecord& rec) const;
+
+    std::shared_ptr<const FsmDefinition>
+    load_definition(const std::string& name,
+                    const std::string& text,
+                    std::string& error);
+
+    std::shared_ptr<const FsmDefinition>
+    load_image(const std::string& name,
+               const std::string& path,
+               std::string& error);
+
+    std::shared_ptr<const FsmDefinition>
+    install_definition(std::shared_ptr<FsmDefinition> def);
+
+    // moves every instance running `from` onto `to` in place
+    void reload(std::shared_ptr<const FsmDefinition> from,
+                std::shared_ptr<const FsmDefinition> to,
+                const json& state_map);
 
     // -------------------------------------------------------------------------
     // Core FSM logic
     // -------------------------------------------------------------------------
-    void step();   // evaluates transitions exactly once per tick
-    bool evaluate_transition(const Transition& t);
+    void step(FsmInstance& inst);   // evaluates transitions exactly once per tick
+    void settle(FsmInstance& inst); // after a step fired: current state, parking
+    int  select_transition(const FsmInstance& inst, int state) const;
+    bool evaluate_transition(const FsmInstance& inst, int t) const;
+
+    // -------------------------------------------------------------------------
+    // Statecharts (composite states, orthogonal regions)
+    //
+    // Each active leaf tries its own transitions, then its ancestors' (inner
+    // first), at most one transition per leaf per step. Firing exits the
+    // source side below the least common proper ancestor of source and
+    // target, then enters down to the target; composites on the way enter
+    // their other regions at their initial states.
+    // -------------------------------------------------------------------------
+    void enter_initial(FsmInstance& inst);
+    void fire(FsmInstance& inst, int t);
+    void enter_path(FsmInstance& inst, int domain, int target, bool effects);
+    void enter_default(FsmInstance& inst, int state, bool effects);
+    void activate(FsmInstance& inst, int state, bool effects);
+    void update_current(FsmInstance& inst);
+
+    std::vector<std::pair<int, uint64_t>> leaves_;   // scratch: (state, entry)
+    std::vector<int>                      seen_;     // scratch: composites tried
+    std::vector<int>                      path_;     // scratch: entry path
+    std::vector<int>                      entered_;  // scratch: effects pending
+    std::vector<int>                      order_;    // scratch: leaves by region
+
+    // -------------------------------------------------------------------------
+    // Timers (after() guards, "_deadline" notes)
+    //
+    // Min-heaps keyed by due time; entering a state pushes only the timers
+    // that state needs, and a timer whose state has since been left is
+    // dropped when popped (no active entry matches). A deadline marks the
+    // entry it was armed for as timed out and steps that instance.
+    // -------------------------------------------------------------------------
+    struct Timer {
+        uint64_t    due;        // ns (ms heap) or tick number (tick heap)
+        uint64_t    entry;      // FsmInstance::Active::entry when armed
+        bool        deadline;   // the state's "_deadline", not an after()
+        std::string instance;
+
+        bool operator>(const Timer& o) const { return due > o.due; }
+    };
+
+    using TimerHeap =
+        std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>>;
+
+    TimerHeap ms_timers_;
+    TimerHeap tick_timers_;
+    uint64_t  ticks_      = 0;
+    uint64_t  next_entry_ = 0;
+
+    void arm_timers(FsmInstance& inst, FsmInstance::Active& a);
+    void expire(const Timer& timer, bool step_now);
+
+    // -------------------------------------------------------------------------
+    // Quiescence (terminal states)
+    // -------------------------------------------------------------------------
+    bool is_terminal(const FsmInstance& inst) const;
+    void enter_quiescence(FsmInstance& inst);   // stop polling, disable TCK
+    void wake(FsmInstance& inst);               // resume after PUT / POST
+
+    std::set<int> parked_tcks_;   // TCKs to silence at the end of the tick
 
     // -------------------------------------------------------------------------
     // Intent routing (note channels)
+    //
+    // Notes are pre-serialized per state at load (FsmNote); entering a
+    // state copies those bytes out, patching in register values if any.
     // -------------------------------------------------------------------------
-    void apply_state_note(const json& note);
+    void apply_state_note(FsmInstance& inst, int state);
+
+    void route_commit(const FsmInstance& inst, int state);             // _commit
+    void route_send(FsmInstance& inst, const FsmPayload& payload);     // _send
+    void route_tck(int tck_sba, std::string_view bytes);               // _tck
+
+    static constexpr std::string_view TCK_ENABLE  = "{\"enable\":true}\n";
+    static constexpr std::string_view TCK_DISABLE = "{\"enable\":false}\n";
 
-    void route_commit(const json& c); // _commit
-    void route_send(json payload);    // _send
-    void route_tck(const json& t);    // _tck
+    std::string send_buf_;   // reused for payloads with register holes
 
     // -------------------------------------------------------------------------
     // BLS access (read-only)
     // -------------------------------------------------------------------------
     void poll_bls();  // pulls latest belief snapshot
 
+    // Namespaces of every subject the loaded definitions mention ("NET.",
+    // "FSM.XFR."), sent as "prefix" so BLS returns only those. Empty when a
+    // subject has no namespace: then everything is fetched.
+    json   bls_prefixes_ = json::array();
+    size_t bls_prefixes_for_ = 0;   // subjects_->names.size() they cover
+    void   update_bls_prefixes();
+
     // -------------------------------------------------------------------------
     // Utilities
     // -------------------------------------------------------------------------
-    bool parse_plantuml(const std::string& text);
-    void substitute_register_refs(json& j);
-
-    void set_error(const std::string& msg,
-                   const char* file,
-                   int line,
-                   const char* func);
+    void substitute_register_refs(const FsmInstance& inst,
+                                  const FsmPayload& payload,
+                                  std::string& out);
 };
 
-#define FSM_ERROR(obj, msg) \
-    (obj).set_error((msg), __FILE__, __LINE__, __func__)
+#define FSM_ERROR(inst, msg) \
+    (inst).set_error((msg), __FILE__, __LINE__, __func__)
@@ -0,0 +1,129 @@
+#include "FsmBatch.hpp"
+#include "FsmBits.hpp"
+
+// -----------------------------------------------------------------------------
+// Construction
+// -----------------------------------------------------------------------------
+FsmBatch::FsmBatch(std::shared_ptr<const FsmDefinition> def)
+    : def_(std::move(def)),
+      words_(def_->mask_words),
+      have_(2 * words_, 0)
+{
+    for (const auto& s : def_->states) {
+        first_.push_back(s.first_transition);
+        count_.push_back(s.transition_count);
+        terminal_.push_back(s.terminal);
+    }
+
+    reads_.assign(words_, 0);
+    for (size_t t = 0; t < def_->transitions.size(); ++t)
+        for (size_t w = 0; w < words_; ++w)
+            reads_[w] |= def_->need_true(int(t))[w] | def_->need_false(int(t))[w];
+}
+
+// -----------------------------------------------------------------------------
+// Slots
+// -----------------------------------------------------------------------------
+int FsmBatch::add(FsmInstance* inst, bool own)
+{
+    const int slot = static_cast<int>(state_.size());
+
+    instance_.push_back(inst);
+    state_.push_back(def_->initial);
+    picked_.push_back(NONE);
+    tck_.push_back(0);
+    live_.push_back(0);
+    moved_.push_back(0);
+
+    own_mask_.resize(own_mask_.size() + words_, 0);
+    own_true_.resize(own_true_.size() + words_, 0);
+    own_false_.resize(own_false_.size() + words_, 0);
+    if (own)
+        owners_.push_back(slot);
+
+    return slot;
+}
+
+// -----------------------------------------------------------------------------
+// Selection
+// -----------------------------------------------------------------------------
+size_t FsmBatch::select(const uint64_t* observed_true, const uint64_t* observed_false)
+{
+    return words_ == 1 ? select_one_word(observed_true[0], observed_false[0])
+                       : select_wide(observed_true, observed_false);
+}
+
+size_t FsmBatch::select_one_word(uint64_t observed_true, uint64_t observed_false)
+{
+    const uint64_t* nt    = def_->need_true(0);
+    const uint64_t* nf    = def_->need_false(0);
+    const size_t    n     = state_.size();
+    size_t          found = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        picked_[i] = NONE;
+        if (!live_[i])
+            continue;
+
+        const int32_t s = state_[i];
+        if (terminal_[s]) {
+            picked_[i] = TERMINAL;
+            continue;
+        }
+
+        // zero mask outside owners: the snapshot as it is
+        const uint64_t m  = own_mask_[i];
+        const int32_t  at = first_[s];
+        const int k = fsm_first_match((observed_true & ~m) | own_true_[i],
+                                      (observed_false & ~m) | own_false_[i],
+                                      nt + at, nf + at, count_[s]);
+        if (k < 0)
+            continue;
+
+        picked_[i] = at + k;
+        ++found;
+    }
+
+    return found;
+}
+
+size_t FsmBatch::select_wide(const uint64_t* observed_true, const uint64_t* observed_false)
+{
+    const size_t n     = state_.size();
+    size_t       found = 0;
+
+    uint64_t* have_true  = have_.data();
+    uint64_t* have_false = have_.data() + words_;
+
+    for (size_t i = 0; i < n; ++i) {
+        picked_[i] = NONE;
+        if (!live_[i])
+            continue;
+
+        const int32_t s = state_[i];
+        if (terminal_[s]) {
+            picked_[i] = TERMINAL;
+            continue;
+        }
+
+        for (size_t w = 0; w < words_; ++w) {
+            const size_t   o = i * words_ + w;
+            const uint64_t m = own_mask_[o];
+            have_true[w]  = (observed_true[w] & ~m) | own_true_[o];
+            have_false[w] = (observed_false[w] & ~m) | own_false_[o];
+        }
+
+        const int32_t end = first_[s] + count_[s];
+        for (int32_t t = first_[s]; t < end; ++t) {
+            if (!fsm_covers(have_true, have_false,
+                            def_->need_true(t), def_->need_false(t), words_))
+                continue;
+
+            picked_[i] = t;
+            ++found;
+            break;
+        }
+    }
+
+    return found;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "FsmDefinition.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct FsmInstance;
+
+// -----------------------------------------------------------------------------
+// FsmBatch (structure-of-arrays transition selection)
+//
+// Fsm keeps one batch per definition its flat instances share. What a tick
+// reads for every instance (live or not, current state, TCK, whether the
+// last step fired) sits in parallel arrays in instance order, so select()
+// is one pass over contiguous memory against the definition's masks, four
+// transitions per test for single-word masks (FsmBits.hpp), with no map
+// walk and no belief view copied per instance.
+//
+// Every slot reads the shared snapshot (Fsm's observed bits) except where
+// its own row says otherwise: a named instance reads its FSM.<id>. copies
+// of the definition's own subjects, and a deadline subject is true only for
+// the entry that timed out (Fsm::build_view). Only slots listed in owners_
+// have such a row; the host refreshes them before select().
+//
+// select() tests masks only. A slot whose pick carries guard bytecode
+// (registers, contexts, after()) is stepped by the host as any unbatched
+// instance would be, which confirms the pick or looks further.
+// -----------------------------------------------------------------------------
+class FsmBatch
+{
+public:
+    static constexpr int32_t NONE     = -1;   // picked_: nothing enabled
+    static constexpr int32_t TERMINAL = -2;   // picked_: no way out; park it
+
+    explicit FsmBatch(std::shared_ptr<const FsmDefinition> def);
+
+    // own: the instance's view differs from the snapshot (see above)
+    int    add(FsmInstance* inst, bool own);
+    size_t size() const { return state_.size(); }
+
+    const std::shared_ptr<const FsmDefinition>& definition() const { return def_; }
+
+    // some transition's masks test subject id
+    bool reads(int id) const
+    {
+        return size_t(id / 64) < words_ && ((reads_[id / 64] >> (id % 64)) & 1);
+    }
+
+    // slot's own row: under mask, read own_true / own_false (mask_words each)
+    uint64_t* own_mask(int slot)  { return &own_mask_[size_t(slot) * words_]; }
+    uint64_t* own_true(int slot)  { return &own_true_[size_t(slot) * words_]; }
+    uint64_t* own_false(int slot) { return &own_false_[size_t(slot) * words_]; }
+
+    // fills picked_ for every live slot; returns how many have a candidate
+    size_t select(const uint64_t* observed_true, const uint64_t* observed_false);
+
+    // ---- columns (slot-indexed) ----
+    std::vector<FsmInstance*> instance_;
+    std::vector<int32_t>      state_;    // current state index
+    std::vector<int32_t>      picked_;   // first transition the masks enable, NONE, TERMINAL
+    std::vector<int32_t>      tck_;      // tck_sba
+    std::vector<uint8_t>      live_;     // running and not parked
+    std::vector<uint8_t>      moved_;    // last step fired (registers say so)
+
+    std::vector<int32_t>      owners_;   // slots with an own row
+
+private:
+    std::shared_ptr<const FsmDefinition> def_;
+    size_t words_;
+
+    std::vector<uint64_t> own_mask_;    // size() x words_, zero unless an owner
+    std::vector<uint64_t> own_true_;
+    std::vector<uint64_t> own_false_;
+    std::vector<uint64_t> have_;        // scratch: one slot's view (2 x words_)
+
+    // per-state transition ranges, copied out of the definition so the hot
+    // loop touches only flat arrays
+    std::vector<int32_t>  first_;
+    std::vector<int32_t>  count_;
+    std::vector<uint8_t>  terminal_;
+    std::vector<uint64_t> reads_;       // words_: union of every need mask
+
+    size_t select_one_word(uint64_t observed_true, uint64_t observed_false);
+    size_t select_wide(const uint64_t* observed_true, const uint64_t* observed_false);
+};
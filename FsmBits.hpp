@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// -----------------------------------------------------------------------------
+// Belief bitmask tests
+//
+// Guards are precompiled to need_true / need_false masks over interned
+// subject ids (see FsmDefinition). A transition is enabled when
+//
+//     (have_true & need_true) == need_true  &&  (have_false & need_false) == need_false
+//
+// The single-word case covers every definition with <= 64 subjects and is
+// tested four transitions at a time with GCC vector extensions, which lower
+// to SSE2 / AVX2 depending on -march.
+// -----------------------------------------------------------------------------
+typedef uint64_t fsm_u64x4 __attribute__((vector_size(32)));
+
+inline bool fsm_covers(const uint64_t* have_true,
+                       const uint64_t* have_false,
+                       const uint64_t* need_true,
+                       const uint64_t* need_false,
+                       size_t words)
+{
+    uint64_t miss = 0;
+    for (size_t w = 0; w < words; ++w) {
+        miss |= need_true[w]  & ~have_true[w];
+        miss |= need_false[w] & ~have_false[w];
+    }
+    return miss == 0;
+}
+
+// First enabled transition among n contiguous single-word masks, or -1.
+inline int fsm_first_match(uint64_t have_true,
+                           uint64_t have_false,
+                           const uint64_t* need_true,
+                           const uint64_t* need_false,
+                           int n)
+{
+    int i = 0;
+
+    if (n >= 4) {
+        const fsm_u64x4 ht = {have_true, have_true, have_true, have_true};
+        const fsm_u64x4 hf = {have_false, have_false, have_false, have_false};
+
+        for (; i + 4 <= n; i += 4) {
+            fsm_u64x4 nt, nf;
+            std::memcpy(&nt, need_true + i, sizeof(nt));
+            std::memcpy(&nf, need_false + i, sizeof(nf));
+
+            const fsm_u64x4 miss = (nt & ~ht) | (nf & ~hf);
+            for (int lane = 0; lane < 4; ++lane)
+                if (miss[lane] == 0)
+                    return i + lane;
+        }
+    }
+
+    for (; i < n; ++i)
+        if (((need_true[i] & ~have_true) | (need_false[i] & ~have_false)) == 0)
+            return i;
+
+    return -1;
+}
@@ -0,0 +1,504 @@
+#include "FsmDefinition.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <string_view>
+
+// -----------------------------------------------------------------------------
+// Utilities
+// -----------------------------------------------------------------------------
+static std::string_view trim(std::string_view s)
+{
+    while (!s.empty() && std::isspace((unsigned char)s.front()))
+        s.remove_prefix(1);
+    while (!s.empty() && std::isspace((unsigned char)s.back()))
+        s.remove_suffix(1);
+    return s;
+}
+
+// -----------------------------------------------------------------------------
+// State lookup
+// -----------------------------------------------------------------------------
+int FsmDefinition::find_state(std::string_view state) const
+{
+    auto it = state_index_.find(state);
+    return it == state_index_.end() ? -1 : it->second;
+}
+
+int FsmDefinition::intern_state(std::string_view state)
+{
+    auto it = state_index_.find(state);
+    if (it != state_index_.end())
+        return it->second;
+
+    const int id = static_cast<int>(states.size());
+    state_index_.emplace(state, id);
+
+    states.emplace_back().name = state;
+    return id;
+}
+
+bool FsmDefinition::is_descendant(int state, int ancestor) const
+{
+    for (; state >= 0; state = states[state].parent)
+        if (state == ancestor)
+            return true;
+    return false;
+}
+
+int FsmDefinition::find_subject(const std::string& subject) const
+{
+    return subjects->find(subject);
+}
+
+int FsmDefinition::intern_remote_register(const std::string& name)
+{
+    for (size_t i = 0; i < remote_registers.size(); ++i)
+        if (remote_registers[i] == name)
+            return static_cast<int>(i);
+
+    remote_registers.push_back(name);
+    return static_cast<int>(remote_registers.size()) - 1;
+}
+
+// -----------------------------------------------------------------------------
+// Subject interning
+// -----------------------------------------------------------------------------
+int SubjectTable::intern(const std::string& subject)
+{
+    auto it = index.find(subject);
+    if (it != index.end())
+        return it->second;
+
+    const int id = static_cast<int>(names.size());
+    index[subject] = id;
+    names.push_back(subject);
+    return id;
+}
+
+int SubjectTable::find(const std::string& subject) const
+{
+    auto it = index.find(subject);
+    return it == index.end() ? -1 : it->second;
+}
+
+// -----------------------------------------------------------------------------
+// Guard masks
+//
+// Every belief a transition requires becomes one bit; a transition is enabled
+// when the observed bits cover its need_true mask (and need_false for beliefs
+// that must be observed false).
+// -----------------------------------------------------------------------------
+void FsmDefinition::compile_masks()
+{
+    for (const auto& t : transitions) {
+        for (const auto& subject : t.beliefs)
+            subjects->intern(subject);
+        for (const auto& subject : t.beliefs_false)
+            subjects->intern(subject);
+    }
+
+    mask_words = subjects->words();
+    if (mask_words == 0)
+        mask_words = 1;
+
+    need_true_.assign(transitions.size() * mask_words, 0);
+    need_false_.assign(transitions.size() * mask_words, 0);
+
+    for (size_t i = 0; i < transitions.size(); ++i) {
+        uint64_t* need = &need_true_[i * mask_words];
+        for (const auto& subject : transitions[i].beliefs) {
+            const int id = subjects->find(subject);
+            need[id / 64] |= uint64_t(1) << (id % 64);
+        }
+
+        need = &need_false_[i * mask_words];
+        for (const auto& subject : transitions[i].beliefs_false) {
+            const int id = subjects->find(subject);
+            need[id / 64] |= uint64_t(1) << (id % 64);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Timers
+//
+// Collected per state so entering a state arms exactly the wake-ups its
+// outgoing after() guards and its "_deadline" note need:
+//
+//     "_deadline": { "ms": 500, "subject": "FSM.NET.rx.timeout" }
+//
+// ("ticks" instead of "ms"; subject defaults to FSM.timeout.<STATE>).
+// -----------------------------------------------------------------------------
+void FsmDefinition::compile_timers()
+{
+    auto add = [](std::vector<uint32_t>& v, uint32_t n) {
+        for (uint32_t x : v)
+            if (x == n)
+                return;
+        v.push_back(n);
+    };
+
+    for (const auto& t : transitions) {
+        for (int i = t.code_begin; i < t.code_end; ++i) {
+            const GuardOp& op = guard_code[i];
+            if (op.code == GuardOp::AfterMs)
+                add(states[t.from].after_ms, op.a);
+            if (op.code == GuardOp::AfterTicks)
+                add(states[t.from].after_ticks, op.a);
+        }
+    }
+
+    for (auto& s : states) {
+        if (!s.note.is_object() || !s.note.contains("_deadline"))
+            continue;
+
+        const json& d = s.note["_deadline"];
+        if (!d.is_object())
+            continue;
+
+        // checked by the parser (check_deadline)
+        s.deadline_ms      = d.value("ms", 0u);
+        s.deadline_ticks   = d.value("ticks", 0u);
+        s.deadline_subject = d.value("subject", "FSM.timeout." + s.name);
+    }
+}
+
+void FsmDefinition::compile_subject_ids()
+{
+    deadline_mask.assign(mask_words, 0);
+    for (auto& s : states) {
+        s.deadline_id = s.deadline_subject.empty() ? -1 : find_subject(s.deadline_subject);
+        if (s.deadline_id >= 0 && size_t(s.deadline_id / 64) < mask_words)
+            deadline_mask[s.deadline_id / 64] |= uint64_t(1) << (s.deadline_id % 64);
+    }
+
+    written_ids.clear();
+    auto written = [&](const std::string& subject) {
+        const int id = subject.empty() ? -1 : find_subject(subject);
+        if (id >= 0 && std::find(written_ids.begin(), written_ids.end(), id) == written_ids.end())
+            written_ids.push_back(id);
+    };
+    for (const auto& s : states) {
+        written(s.payloads.state_subject);
+        if (s.payloads.has_commit)
+            written(s.payloads.commit_subject);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Note channels
+//
+// Done once here so entering a state only copies bytes out (see FsmNote.hpp).
+// $REG holes are bound the way guards bind them: an FsmRegisters field, or
+// else a remote register shared with the guards' remote_registers.
+// -----------------------------------------------------------------------------
+void FsmDefinition::compile_notes()
+{
+    for (auto& s : states) {
+        s.payloads = FsmNote::compile(s.name, s.note);
+
+        for (auto& h : s.payloads.send.holes) {
+            h.local = fsm_reg_find(h.name);
+            if (h.local < 0)
+                h.remote = intern_remote_register(h.name);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// PlantUML Parser
+//
+// One pass over the text. Lines are views into it; only names, guards and
+// note bodies that end up in the definition are copied out, and a note's
+// JSON is parsed in place from the lines between "note right of" and
+// "end note".
+// -----------------------------------------------------------------------------
+namespace {
+
+// "_deadline": { "ms" | "ticks": whole number, "subject": string }; what
+// compile_timers reads without further checks
+std::string check_deadline(const json& note)
+{
+    if (!note.is_object() || !note.contains("_deadline"))
+        return "";
+
+    const json& d = note["_deadline"];
+    if (!d.is_object())
+        return "_deadline must be an object";
+
+    for (const char* key : { "ms", "ticks" }) {
+        const auto it = d.find(key);
+        if (it != d.end() && (!it->is_number_unsigned() ||
+                              it->get<uint64_t>() > UINT32_MAX))
+            return std::string("_deadline ") + key + " must be a whole number up to " +
+                   std::to_string(UINT32_MAX);
+    }
+
+    const auto subject = d.find("subject");
+    if (subject != d.end() && !subject->is_string())
+        return "_deadline subject must be a string";
+    return "";
+}
+
+struct LineReader
+{
+    std::string_view text;
+    size_t begin = 0;    // start of the current line
+    size_t next  = 0;    // start of the line after it
+    int    number = 0;
+
+    bool read(std::string_view& line)
+    {
+        if (next >= text.size())
+            return false;
+
+        begin = next;
+        size_t end = text.find('\n', begin);
+        if (end == std::string_view::npos)
+            end = text.size();
+
+        line = text.substr(begin, end - begin);
+        next = end + 1;
+        ++number;
+        return true;
+    }
+};
+
+} // namespace
+
+std::shared_ptr<FsmDefinition>
+FsmDefinition::parse_plantuml(const std::string& text,
+                              std::shared_ptr<SubjectTable> subjects,
+                              std::string* error)
+{
+    auto def = std::make_shared<FsmDefinition>();
+    def->text = text;
+    def->subjects = subjects ? std::move(subjects)
+                             : std::make_shared<SubjectTable>();
+
+    std::vector<Transition> parsed;   // declaration order
+
+    // ---- composite scopes: "state X {" ... "}", regions split by "--" ----
+    struct Scope { int state; int region; int line; };
+    std::vector<Scope> scopes;
+    std::vector<int>   region_line;   // where each region was opened
+    int top_initial = -1;
+
+    auto fail = [&](int at, const std::string& why) -> std::shared_ptr<FsmDefinition> {
+        if (error)
+            *error = "line " + std::to_string(at) + ": " + why;
+        return nullptr;
+    };
+
+    auto open_region = [&](int state, int at) {
+        const int r = static_cast<int>(def->regions.size());
+        def->regions.push_back({ state, -1 });
+        def->states[state].regions.push_back(r);
+        region_line.push_back(at);
+        return r;
+    };
+
+    // The first mention inside a composite decides where a state lives;
+    // states never mentioned inside one are top level.
+    auto place = [&](int id) {
+        if (scopes.empty() || def->states[id].region >= 0)
+            return;
+        for (const auto& sc : scopes)
+            if (sc.state == id)
+                return;   // the composite itself, or an enclosing one
+        def->states[id].parent = scopes.back().state;
+        def->states[id].region = scopes.back().region;
+    };
+
+    LineReader in{ text };
+    std::string_view raw;
+    bool any = false;
+
+    while (in.read(raw)) {
+        const int line_no = in.number;
+        const std::string_view line = trim(raw);
+
+        if (line == "}") {
+            if (!scopes.empty())
+                scopes.pop_back();
+            continue;
+        }
+
+        if (line == "--" || line == "||") {
+            if (!scopes.empty())
+                scopes.back().region = open_region(scopes.back().state, line_no);
+            continue;
+        }
+
+        const auto arrow = line.find("-->");
+        if (arrow != std::string_view::npos) {
+            const std::string_view from = trim(line.substr(0, arrow));
+            const std::string_view rest = line.substr(arrow + 3);
+
+            const auto colon = rest.find(':');
+            const std::string_view to = trim(rest.substr(0, colon));
+
+            if (from.empty() || to.empty())
+                return fail(line_no, "transition needs a source and a target");
+            if (to == "[*]")
+                return fail(line_no, "final pseudo-state [*] is not supported");
+
+            // initial pseudo-state of the enclosing region (or top level)
+            if (from == "[*]") {
+                const int id = def->intern_state(to);
+                place(id);
+                if (scopes.empty())
+                    top_initial = id;
+                else
+                    def->regions[scopes.back().region].initial = id;
+                continue;
+            }
+
+            Transition& t = parsed.emplace_back();
+            t.from = def->intern_state(from);
+            t.to   = def->intern_state(to);
+            t.line = line_no;
+            place(t.from);
+            place(t.to);
+
+            if (colon != std::string_view::npos)
+                t.guard = trim(rest.substr(colon + 1));
+            continue;
+        }
+
+        // state X | state X : text | state "Label" as X | ... {
+        if (line.starts_with("state ")) {
+            std::string_view decl = line.substr(6);
+            const bool opens = decl.ends_with('{');
+            if (opens)
+                decl.remove_suffix(1);
+
+            decl = decl.substr(0, decl.find(':'));
+            const auto as = decl.find(" as ");
+            if (as != std::string_view::npos)
+                decl = decl.substr(as + 4);
+            decl = trim(decl);
+
+            if (decl.empty())
+                return fail(line_no, "state needs a name");
+
+            const int id = def->intern_state(decl);
+            place(id);
+
+            if (opens) {
+                const auto& owned = def->states[id].regions;
+                scopes.push_back({ id,
+                                   owned.empty() ? open_region(id, line_no)
+                                                 : owned.back(),
+                                   line_no });
+            }
+            continue;
+        }
+
+        if (line.starts_with("note right of ")) {
+            const std::string_view state = trim(line.substr(14));
+
+            const int id = def->intern_state(state);
+            if (def->initial < 0)
+                def->initial = id;
+
+            // the body runs up to the line holding "end note"
+            const size_t body_begin = in.next;
+            bool closed = false;
+            while (in.read(raw))
+                if (raw.find("end note") != std::string_view::npos) {
+                    closed = true;
+                    break;
+                }
+            if (!closed)
+                return fail(line_no, "note right of " + std::string(state) +
+                                     " has no end note");
+
+            const std::string_view body =
+                std::string_view(text).substr(body_begin, in.begin - body_begin);
+
+            json note = json::parse(body.begin(), body.end(), nullptr, false);
+            if (note.is_discarded()) {
+                def->states[id].note = json{{"_raw", std::string(body)}};
+            } else {
+                const std::string why = check_deadline(note);
+                if (!why.empty())
+                    return fail(line_no, "note right of " + std::string(state) + ": " + why);
+
+                def->states[id].note = std::move(note);
+                any = true;
+            }
+        }
+    }
+
+    if (!scopes.empty())
+        return fail(scopes.back().line, "unclosed state " +
+                                        def->states[scopes.back().state].name + " {");
+
+    if (!any) {
+        if (error)
+            *error = "no state note parsed";
+        return nullptr;
+    }
+
+    // ---- group transitions by source state, in declaration order ----
+    for (const auto& t : parsed)
+        ++def->states[t.from].transition_count;
+
+    int first = 0;
+    for (auto& st : def->states) {
+        st.first_transition = first;
+        first += st.transition_count;
+    }
+
+    def->transitions.resize(parsed.size());
+    std::vector<int> filled(def->states.size(), 0);
+    for (auto& t : parsed) {
+        const auto& st = def->states[t.from];
+        def->transitions[st.first_transition + filled[t.from]++] = std::move(t);
+    }
+
+    // ---- hierarchy ----
+    for (auto& st : def->states)
+        for (int p = st.parent; p >= 0; p = def->states[p].parent)
+            ++st.depth;
+
+    // a region without "[*] -->" starts at its first child
+    for (size_t s = 0; s < def->states.size(); ++s) {
+        const int r = def->states[s].region;
+        if (r >= 0 && def->regions[r].initial < 0)
+            def->regions[r].initial = static_cast<int>(s);
+    }
+
+    for (size_t r = 0; r < def->regions.size(); ++r)
+        if (def->regions[r].initial < 0)
+            return fail(region_line[r], "empty region in state " +
+                                        def->states[def->regions[r].parent].name);
+
+    // a leaf is terminal only if nothing above it can leave either
+    for (auto& st : def->states) {
+        st.terminal = !st.composite();
+        for (const State* a = &st; st.terminal && a;
+             a = a->parent >= 0 ? &def->states[a->parent] : nullptr)
+            st.terminal = a->transition_count == 0;
+    }
+
+    if (top_initial >= 0)
+        def->initial = top_initial;
+
+    // ---- guards ----
+    for (size_t i = 0; i < def->transitions.size(); ++i) {
+        const Transition& t = def->transitions[i];
+
+        std::string why;
+        if (!fsm_compile_guard(t.guard, *def, static_cast<int>(i), why))
+            return fail(t.line, why + " in '" + t.guard + "'");
+    }
+
+    def->compile_masks();
+    def->compile_timers();
+    def->compile_notes();
+    def->compile_subject_ids();
+    return def;
+}
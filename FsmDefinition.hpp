@@ -0,0 +1,179 @@
+#pragma once
+
+#include "FsmGuard.hpp"
+#include "FsmNote.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using json = nlohmann::ordered_json;
+
+// string-keyed maps that can be searched with a string_view
+struct StringHash
+{
+    using is_transparent = void;
+    size_t operator()(std::string_view s) const
+    {
+        return std::hash<std::string_view>{}(s);
+    }
+};
+
+// -----------------------------------------------------------------------------
+// Interned belief subjects
+//
+// Ids are dense and never reused, so a bitset indexed by id can stand in for
+// a map<subject,bool>. Definitions loaded into one Fsm share a table, which
+// lets a single observed-beliefs bitset serve all of them.
+// -----------------------------------------------------------------------------
+struct SubjectTable
+{
+    std::vector<std::string>             names;   // id -> subject
+    std::unordered_map<std::string, int> index;   // subject -> id
+
+    int intern(const std::string& subject);
+    int find(const std::string& subject) const;
+
+    size_t words() const { return (names.size() + 63) / 64; }
+};
+
+// -----------------------------------------------------------------------------
+// Compiled FSM definition
+//
+// Immutable once built. Every instance running the same PlantUML text holds a
+// shared_ptr to the same definition, so the transition table and notes exist
+// once per process no matter how many instances are hosted.
+// -----------------------------------------------------------------------------
+struct FsmDefinition
+{
+    struct Transition {
+        int         from = -1;
+        int         to   = -1;
+        int         line = 0;              // source line, for errors
+        std::string guard;                 // guard text after the colon
+        std::vector<std::string> beliefs;        // must be observed true
+        std::vector<std::string> beliefs_false;  // must be observed false
+        int         code_begin = 0;        // guard bytecode range;
+        int         code_end   = 0;        // empty = masks decide alone
+    };
+
+    struct State {
+        std::string name;
+        json        note;                  // null when the state has no note
+                                           // (and for image-loaded states)
+        FsmNote     payloads;              // note channels, pre-serialized
+        bool        terminal = false;      // leaf; no outgoing transitions,
+                                           // nor any from its ancestors
+        int         first_transition = 0;  // index into transitions
+        int         transition_count = 0;
+
+        // ---- hierarchy (composite states, orthogonal regions) ----
+        int              parent = -1;       // enclosing composite, -1 = top level
+        int              region = -1;       // region of parent it sits in
+        int              depth  = 0;        // 0 = top level
+        std::vector<int> regions;           // regions it owns; empty = leaf
+
+        bool composite() const { return !regions.empty(); }
+
+        // ---- timers armed on entry ----
+        std::vector<uint32_t> after_ms;     // after(N ms) in outgoing guards
+        std::vector<uint32_t> after_ticks;  // after(N ticks)
+        uint32_t    deadline_ms    = 0;     // note "_deadline", 0 = none
+        uint32_t    deadline_ticks = 0;
+        std::string deadline_subject;       // committed on expiry
+        int         deadline_id    = -1;    // its subject id, if a guard reads it
+    };
+
+    // One concurrent region of a composite state. A composite is active
+    // together with exactly one active child per region.
+    struct Region {
+        int parent  = -1;                  // composite owning the region
+        int initial = -1;                  // "[*] -->" target, else first child
+    };
+
+    std::string             name;
+    std::string             text;
+    std::vector<State>      states;
+    std::vector<Transition> transitions;   // grouped by source state
+    std::vector<Region>     regions;       // empty for a flat machine
+    int                     initial = -1;  // top-level "[*] -->" target, else
+                                           // the first state with a note
+
+    bool hierarchical() const { return !regions.empty(); }
+    bool is_descendant(int state, int ancestor) const;   // or the same state
+
+    // ---- belief guards, precompiled to bitmasks over interned subjects ----
+    std::shared_ptr<SubjectTable> subjects;
+    size_t                   mask_words = 0;
+    std::vector<uint64_t>    need_true_;   // transitions x mask_words
+    std::vector<uint64_t>    need_false_;  // transitions x mask_words
+
+    const uint64_t* need_true(int t) const
+    {
+        return (mapped_true_ ? mapped_true_ : need_true_.data()) + t * mask_words;
+    }
+    const uint64_t* need_false(int t) const
+    {
+        return (mapped_false_ ? mapped_false_ : need_false_.data()) + t * mask_words;
+    }
+
+    // Deadline subjects guards read (mask_words): true only while the entry
+    // whose deadline expired is active, never as observed in BLS.
+    std::vector<uint64_t>    deadline_mask;
+
+    // Guard subjects the definition writes itself (state beliefs and
+    // "_commit"); a named instance reads its own copies of them.
+    std::vector<int>         written_ids;
+
+    // ---- everything a guard needs beyond the masks (see FsmGuard.hpp) ----
+    std::vector<GuardOp>         guard_code;
+    std::vector<GuardConst>      guard_consts;
+    std::vector<std::string>     remote_registers;   // $REG.x not in FsmRegisters
+    std::vector<int>             remote_slots;       // the same, as the host's mirror
+                                                     // slots (set by Fsm on install)
+    std::vector<GuardContextRef> contexts;           // ctx(SUBJECT).path
+
+    bool has_program(int t) const
+    {
+        return transitions[t].code_begin != transitions[t].code_end;
+    }
+
+    int intern_remote_register(const std::string& name);
+
+    int find_state(std::string_view state) const;
+    int find_subject(const std::string& subject) const;
+
+    // Returns nullptr when nothing runnable was found or a guard does not
+    // compile; *error then says why (with the line number).
+    static std::shared_ptr<FsmDefinition>
+    parse_plantuml(const std::string& text,
+                   std::shared_ptr<SubjectTable> subjects = nullptr,
+                   std::string* error = nullptr);
+
+    // ---- compiled image (FsmImage.hpp) ----
+    bool write_image(const std::string& path, std::string& error) const;
+
+    static std::shared_ptr<FsmDefinition>
+    load_image(const std::string& path,
+               std::shared_ptr<SubjectTable> subjects = nullptr,
+               std::string* error = nullptr);
+
+private:
+    std::unordered_map<std::string, int, StringHash, std::equal_to<>> state_index_;
+
+    // masks used in place from a mapped image (see load_image)
+    std::shared_ptr<const void> image_;
+    const uint64_t* mapped_true_  = nullptr;
+    const uint64_t* mapped_false_ = nullptr;
+
+    int  intern_state(std::string_view state);
+    void compile_masks();
+    void compile_timers();
+    void compile_subject_ids();    // after the masks, for parsed and mapped tables
+    void compile_notes();
+};
@@ -0,0 +1,562 @@
+#include "FsmGuard.hpp"
+#include "FsmDefinition.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <memory>
+
+// -----------------------------------------------------------------------------
+// Local registers
+// -----------------------------------------------------------------------------
+static const char* const kFsmRegNames[] = {
+    "sba", "target_sba", "tck_sba",
+    "run", "loaded",
+    "current_state", "next_state", "transition_fired", "quiescent",
+    "last_applied_state", "last_error",
+};
+
+int fsm_reg_find(std::string_view name)
+{
+    for (int i = 0; i < static_cast<int>(FsmReg::count); ++i)
+        if (name == kFsmRegNames[i])
+            return i;
+    return -1;
+}
+
+// -----------------------------------------------------------------------------
+// Tokenizer
+// -----------------------------------------------------------------------------
+namespace {
+
+struct Token
+{
+    enum Kind { End, Word, Quoted, LParen, RParen, Not, And, Or,
+                Eq, Ne, Lt, Le, Gt, Ge };
+
+    Kind             kind = End;
+    std::string_view text;
+};
+
+bool is_word_char(char c)
+{
+    return std::isalnum((unsigned char)c) ||
+           c == '_' || c == '.' || c == '$' || c == '-' || c == '*' || c == '/';
+}
+
+class Lexer
+{
+public:
+    explicit Lexer(std::string_view s) : s_(s) { advance(); }
+
+    const Token& peek() const { return tok_; }
+    Token next() { Token t = tok_; advance(); return t; }
+    bool  bad()  const { return bad_; }
+
+private:
+    std::string_view s_;
+    size_t           pos_ = 0;
+    Token            tok_;
+    bool             bad_ = false;
+
+    void advance()
+    {
+        while (pos_ < s_.size() && std::isspace((unsigned char)s_[pos_]))
+            ++pos_;
+
+        tok_ = Token{};
+        if (pos_ >= s_.size())
+            return;
+
+        const char c = s_[pos_];
+        const char d = pos_ + 1 < s_.size() ? s_[pos_ + 1] : '\0';
+        auto two = [&](Token::Kind k) { tok_ = {k, s_.substr(pos_, 2)}; pos_ += 2; };
+        auto one = [&](Token::Kind k) { tok_ = {k, s_.substr(pos_, 1)}; pos_ += 1; };
+
+        if (c == '(')             return one(Token::LParen);
+        if (c == ')')             return one(Token::RParen);
+        if (c == '&' && d == '&') return two(Token::And);
+        if (c == '|' && d == '|') return two(Token::Or);
+        if (c == '=' && d == '=') return two(Token::Eq);
+        if (c == '!' && d == '=') return two(Token::Ne);
+        if (c == '<' && d == '=') return two(Token::Le);
+        if (c == '>' && d == '=') return two(Token::Ge);
+        if (c == '!')             return one(Token::Not);
+        if (c == '=')             return one(Token::Eq);
+        if (c == '<')             return one(Token::Lt);
+        if (c == '>')             return one(Token::Gt);
+
+        if (c == '"') {
+            const size_t close = s_.find('"', pos_ + 1);
+            if (close == std::string_view::npos) {
+                bad_ = true;
+                pos_ = s_.size();
+                return;
+            }
+            tok_ = {Token::Quoted, s_.substr(pos_ + 1, close - pos_ - 1)};
+            pos_ = close + 1;
+            return;
+        }
+
+        if (is_word_char(c)) {
+            const size_t start = pos_;
+            while (pos_ < s_.size() && is_word_char(s_[pos_]))
+                ++pos_;
+            tok_ = {Token::Word, s_.substr(start, pos_ - start)};
+
+            if (tok_.text == "and") tok_.kind = Token::And;
+            if (tok_.text == "or")  tok_.kind = Token::Or;
+            if (tok_.text == "not") tok_.kind = Token::Not;
+            return;
+        }
+
+        bad_ = true;
+        pos_ = s_.size();
+    }
+};
+
+// -----------------------------------------------------------------------------
+// Parse tree (load time only)
+// -----------------------------------------------------------------------------
+struct Node
+{
+    GuardOp                            op;        // leaf op, or Not / And / Or
+    std::string                        subject;   // for belief leaves
+    std::vector<std::unique_ptr<Node>> kids;
+};
+
+using NodePtr = std::unique_ptr<Node>;
+
+class Parser
+{
+public:
+    Parser(std::string_view text, FsmDefinition& def, std::string& error)
+        : lex_(text), def_(def), error_(error) {}
+
+    NodePtr parse()
+    {
+        NodePtr n = parse_or();
+        if (n && lex_.peek().kind != Token::End)
+            return fail("unexpected '" + std::string(lex_.peek().text) + "'");
+        if (n && lex_.bad())
+            return fail("unterminated string or stray character");
+        return n;
+    }
+
+private:
+    Lexer          lex_;
+    FsmDefinition& def_;
+    std::string&   error_;
+
+    NodePtr fail(const std::string& msg)
+    {
+        if (error_.empty())
+            error_ = msg;
+        return nullptr;
+    }
+
+    static NodePtr make(GuardOp::Code code)
+    {
+        auto n = std::make_unique<Node>();
+        n->op.code = code;
+        return n;
+    }
+
+    NodePtr binary(GuardOp::Code code, NodePtr lhs, NodePtr rhs)
+    {
+        auto n = make(code);
+        n->kids.push_back(std::move(lhs));
+        n->kids.push_back(std::move(rhs));
+        return n;
+    }
+
+    NodePtr parse_or()
+    {
+        NodePtr lhs = parse_and();
+        while (lhs && lex_.peek().kind == Token::Or) {
+            lex_.next();
+            NodePtr rhs = parse_and();
+            if (!rhs)
+                return nullptr;
+            lhs = binary(GuardOp::Or, std::move(lhs), std::move(rhs));
+        }
+        return lhs;
+    }
+
+    NodePtr parse_and()
+    {
+        NodePtr lhs = parse_unary();
+        while (lhs && lex_.peek().kind == Token::And) {
+            lex_.next();
+            NodePtr rhs = parse_unary();
+            if (!rhs)
+                return nullptr;
+            lhs = binary(GuardOp::And, std::move(lhs), std::move(rhs));
+        }
+        return lhs;
+    }
+
+    NodePtr parse_unary()
+    {
+        const Token t = lex_.peek();
+
+        if (t.kind == Token::Not) {
+            lex_.next();
+            NodePtr inner = parse_unary();
+            if (!inner)
+                return nullptr;
+            auto n = make(GuardOp::Not);
+            n->kids.push_back(std::move(inner));
+            return n;
+        }
+
+        if (t.kind == Token::LParen) {
+            lex_.next();
+            NodePtr inner = parse_or();
+            if (!inner)
+                return nullptr;
+            if (lex_.next().kind != Token::RParen)
+                return fail("missing ')'");
+            return inner;
+        }
+
+        if (t.kind != Token::Word)
+            return fail(t.kind == Token::End ? "guard ends early"
+                                             : "unexpected '" + std::string(t.text) + "'");
+        return parse_atom();
+    }
+
+    NodePtr parse_atom()
+    {
+        const std::string_view w = lex_.next().text;
+
+        if (w == "true")  return make(GuardOp::True);
+        if (w == "false") return make(GuardOp::False);
+
+        if (w == "belief") {
+            const Token s = lex_.next();
+            if (s.kind != Token::Word)
+                return fail("'belief' needs a subject");
+            return belief(s.text, true);
+        }
+
+        if (w.rfind("$REG.", 0) == 0) {
+            const std::string name(w.substr(5));
+            if (name.empty())
+                return fail("empty register name");
+
+            auto n = make(GuardOp::LocalReg);
+            const int local = fsm_reg_find(name);
+            if (local >= 0) {
+                n->op.a = local;
+            } else {
+                n->op.code = GuardOp::RemoteReg;
+                n->op.a    = def_.intern_remote_register(name);
+            }
+            return comparison(std::move(n));
+        }
+
+        if (w == "ctx") {
+            if (lex_.next().kind != Token::LParen)
+                return fail("expected 'ctx(SUBJECT)'");
+            const Token s = lex_.next();
+            if (s.kind != Token::Word || lex_.next().kind != Token::RParen)
+                return fail("expected 'ctx(SUBJECT)'");
+
+            GuardContextRef ref;
+            ref.subject = def_.subjects->intern(std::string(s.text));
+
+            // the field path arrives as one word: ".a.b"
+            if (lex_.peek().kind == Token::Word &&
+                !lex_.peek().text.empty() && lex_.peek().text[0] == '.')
+            {
+                std::string_view path = lex_.next().text.substr(1);
+                while (!path.empty()) {
+                    const size_t dot = path.find('.');
+                    ref.path.emplace_back(path.substr(0, dot));
+                    path = dot == std::string_view::npos ? std::string_view{}
+                                                         : path.substr(dot + 1);
+                }
+            }
+
+            auto n = make(GuardOp::Context);
+            n->op.a = static_cast<int32_t>(def_.contexts.size());
+            def_.contexts.push_back(std::move(ref));
+            return comparison(std::move(n));
+        }
+
+        if (w == "after") {
+            if (lex_.next().kind != Token::LParen)
+                return fail("expected 'after(N ms|ticks)'");
+
+            // "500 ms" or "500ms"
+            std::string amount(lex_.next().text);
+            std::string unit;
+            const size_t digits = amount.find_first_not_of("0123456789");
+            if (digits != std::string::npos) {
+                unit   = amount.substr(digits);
+                amount = amount.substr(0, digits);
+            } else if (lex_.peek().kind == Token::Word) {
+                unit = std::string(lex_.next().text);
+            }
+
+            if (amount.empty() || amount.size() > 9 ||
+                (unit != "ms" && unit != "ticks") ||
+                lex_.next().kind != Token::RParen)
+                return fail("expected 'after(N ms|ticks)'");
+
+            auto n = make(unit == "ms" ? GuardOp::AfterMs : GuardOp::AfterTicks);
+            n->op.a = std::stoi(amount);
+            return n;
+        }
+
+        // SUBJECT = true|false
+        if (lex_.peek().kind == Token::Eq) {
+            lex_.next();
+            const Token v = lex_.next();
+            if (v.kind != Token::Word || (v.text != "true" && v.text != "false"))
+                return fail("expected " + std::string(w) + "=true|false");
+            return belief(w, v.text == "true");
+        }
+
+        return fail("unknown guard '" + std::string(w) + "'");
+    }
+
+    NodePtr belief(std::string_view subject, bool polarity)
+    {
+        auto n = make(polarity ? GuardOp::BeliefTrue : GuardOp::BeliefFalse);
+        n->subject = std::string(subject);
+        n->op.a    = def_.subjects->intern(n->subject);
+        return n;
+    }
+
+    NodePtr comparison(NodePtr n)
+    {
+        const Token op = lex_.next();
+        switch (op.kind) {
+            case Token::Eq: n->op.cmp = GuardOp::Eq; break;
+            case Token::Ne: n->op.cmp = GuardOp::Ne; break;
+            case Token::Lt: n->op.cmp = GuardOp::Lt; break;
+            case Token::Le: n->op.cmp = GuardOp::Le; break;
+            case Token::Gt: n->op.cmp = GuardOp::Gt; break;
+            case Token::Ge: n->op.cmp = GuardOp::Ge; break;
+            default: return fail("expected a comparison operator");
+        }
+
+        const Token lit = lex_.next();
+        GuardConst c;
+
+        if (lit.kind == Token::Quoted) {
+            c.kind = GuardValue::String;
+            c.str  = std::string(lit.text);
+        } else if (lit.kind != Token::Word) {
+            return fail("expected a literal");
+        } else if (lit.text == "true" || lit.text == "false") {
+            c.kind = GuardValue::Bool;
+            c.b    = lit.text == "true";
+        } else {
+            const std::string s(lit.text);
+            char* end = nullptr;
+            const double v = std::strtod(s.c_str(), &end);
+            if (end && *end == '\0' && !s.empty()) {
+                c.kind = GuardValue::Number;
+                c.num  = v;
+            } else {
+                c.kind = GuardValue::String;
+                c.str  = s;
+            }
+        }
+
+        n->op.b = static_cast<int32_t>(def_.guard_consts.size());
+        def_.guard_consts.push_back(std::move(c));
+        return n;
+    }
+};
+
+// -----------------------------------------------------------------------------
+// Code generation
+// -----------------------------------------------------------------------------
+void flatten_and(NodePtr n, std::vector<NodePtr>& out)
+{
+    if (n->op.code == GuardOp::And) {
+        flatten_and(std::move(n->kids[0]), out);
+        flatten_and(std::move(n->kids[1]), out);
+        return;
+    }
+    out.push_back(std::move(n));
+}
+
+// emits postfix code; returns the stack depth the subtree needs
+int emit(const Node& n, std::vector<GuardOp>& code)
+{
+    if (n.kids.empty()) {
+        code.push_back(n.op);
+        return 1;
+    }
+
+    int depth = emit(*n.kids[0], code);
+    if (n.kids.size() > 1)
+        depth = std::max(depth, 1 + emit(*n.kids[1], code));
+
+    code.push_back(n.op);
+    return depth;
+}
+
+bool test_bit(const uint64_t* bits, size_t words, int id)
+{
+    if (!bits || id < 0 || size_t(id) >= words * 64)
+        return false;
+    return (bits[id / 64] >> (id % 64)) & 1;
+}
+
+} // namespace
+
+// -----------------------------------------------------------------------------
+// Compile
+// -----------------------------------------------------------------------------
+bool fsm_compile_guard(std::string_view text,
+                       FsmDefinition& def,
+                       int transition,
+                       std::string& error)
+{
+    auto& t = def.transitions[transition];
+    t.code_begin = t.code_end = static_cast<int>(def.guard_code.size());
+
+    if (text.find_first_not_of(" \t\r") == std::string_view::npos)
+        return true;   // no guard: unconditional
+
+    NodePtr root = Parser(text, def, error).parse();
+    if (!root)
+        return false;
+
+    std::vector<NodePtr> conjuncts;
+    flatten_and(std::move(root), conjuncts);
+
+    int  depth    = 0;
+    bool residual = false;
+
+    for (auto& c : conjuncts) {
+        switch (c->op.code) {
+            case GuardOp::True:
+                continue;
+            case GuardOp::BeliefTrue:
+                t.beliefs.push_back(c->subject);
+                continue;
+            case GuardOp::BeliefFalse:
+                t.beliefs_false.push_back(c->subject);
+                continue;
+            default:
+                break;
+        }
+
+        depth = std::max(depth, (residual ? 1 : 0) + emit(*c, def.guard_code));
+        if (residual)
+            def.guard_code.push_back(GuardOp{GuardOp::And});
+        residual = true;
+    }
+
+    if (depth > 64) {
+        def.guard_code.resize(t.code_begin);
+        error = "guard nests too deeply";
+        return false;
+    }
+
+    t.code_end = static_cast<int>(def.guard_code.size());
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// Evaluate
+// -----------------------------------------------------------------------------
+bool fsm_compare(const GuardValue& v, GuardOp::Cmp cmp, const GuardConst& c)
+{
+    if (v.kind == GuardValue::None || v.kind != c.kind)
+        return cmp == GuardOp::Ne && v.kind != GuardValue::None;
+
+    int order = 0;
+    switch (v.kind) {
+        case GuardValue::Bool:
+            order = int(v.b) - int(c.b);
+            break;
+        case GuardValue::Number:
+            order = v.num < c.num ? -1 : (v.num > c.num ? 1 : 0);
+            break;
+        case GuardValue::String:
+            order = v.str.compare(c.str);
+            break;
+        default:
+            return false;
+    }
+
+    switch (cmp) {
+        case GuardOp::Eq: return order == 0;
+        case GuardOp::Ne: return order != 0;
+        case GuardOp::Lt: return order <  0;
+        case GuardOp::Le: return order <= 0;
+        case GuardOp::Gt: return order >  0;
+        case GuardOp::Ge: return order >= 0;
+    }
+    return false;
+}
+
+bool fsm_eval_guard(const FsmDefinition& def,
+                    int transition,
+                    const GuardEnv& env)
+{
+    const auto& t = def.transitions[transition];
+
+    uint64_t stack = 0;   // one bit per entry, top at bit 0
+
+    auto push = [&](bool v) { stack = (stack << 1) | uint64_t(v); };
+    auto pop  = [&]() { const bool v = stack & 1; stack >>= 1; return v; };
+
+    for (int i = t.code_begin; i < t.code_end; ++i) {
+        const GuardOp& op = def.guard_code[i];
+
+        switch (op.code) {
+            case GuardOp::True:  push(true);  break;
+            case GuardOp::False: push(false); break;
+
+            case GuardOp::BeliefTrue:
+                push(test_bit(env.observed_true, env.words, op.a));
+                break;
+            case GuardOp::BeliefFalse:
+                push(test_bit(env.observed_false, env.words, op.a));
+                break;
+
+            case GuardOp::LocalReg:
+                push(fsm_compare(env.local(static_cast<FsmReg>(op.a)),
+                                 op.cmp, def.guard_consts[op.b]));
+                break;
+            case GuardOp::RemoteReg:
+                push(fsm_compare(env.remote(op.a), op.cmp, def.guard_consts[op.b]));
+                break;
+            case GuardOp::Context:
+                push(fsm_compare(env.context(op.a), op.cmp, def.guard_consts[op.b]));
+                break;
+
+            case GuardOp::AfterMs:
+                push(env.elapsed_ms() >= uint64_t(op.a));
+                break;
+            case GuardOp::AfterTicks:
+                push(env.elapsed_ticks() >= uint64_t(op.a));
+                break;
+
+            case GuardOp::Not:
+                stack ^= 1;
+                break;
+            case GuardOp::And: {
+                const bool r = pop(), l = pop();
+                push(l && r);
+                break;
+            }
+            case GuardOp::Or: {
+                const bool r = pop(), l = pop();
+                push(l || r);
+                break;
+            }
+        }
+    }
+
+    return t.code_begin == t.code_end || (stack & 1);
+}
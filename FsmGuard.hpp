@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct FsmDefinition;
+
+// -----------------------------------------------------------------------------
+// Guard language
+//
+// Text after the colon of a transition:
+//
+//     expr    := term  { ("or"  | "||") term }
+//     term    := unary { ("and" | "&&") unary }
+//     unary   := ("not" | "!") unary | "(" expr ")" | atom
+//     atom    := "true" | "false"
+//              | "belief" SUBJECT             observed true
+//              | SUBJECT "=" ("true"|"false")  observed with that polarity
+//              | "$REG." NAME  op literal     register comparison
+//              | "ctx(" SUBJECT ")" { "." FIELD } op literal
+//              | "after(" N ("ms" | "ticks") ")"   time in current state
+//     op      := "==" | "=" | "!=" | "<" | "<=" | ">" | ">="
+//     literal := number | "quoted" | true | false | bareword
+//
+// Top-level AND-ed belief atoms are folded into the transition's bitmasks;
+// whatever is left compiles to postfix bytecode in the definition. Evaluation
+// walks the ops with a bit stack and never allocates.
+// -----------------------------------------------------------------------------
+
+// ---- a value a guard compares (views into registers / contexts) ----
+struct GuardValue
+{
+    enum Kind : uint8_t { None, Bool, Number, String };
+
+    Kind             kind = None;
+    bool             b    = false;
+    double           num  = 0;
+    std::string_view str;
+
+    static GuardValue of(bool v)             { GuardValue g; g.kind = Bool;   g.b = v;   return g; }
+    static GuardValue of(double v)           { GuardValue g; g.kind = Number; g.num = v; return g; }
+    static GuardValue of(int v)              { return of(static_cast<double>(v)); }
+    static GuardValue of(std::string_view v) { GuardValue g; g.kind = String; g.str = v; return g; }
+};
+
+// ---- a literal on the right-hand side of a comparison ----
+struct GuardConst
+{
+    GuardValue::Kind kind = GuardValue::None;
+    bool             b    = false;
+    double           num  = 0;
+    std::string      str;
+};
+
+// ---- registers every Fsm instance exposes (mirrors FsmRegisters) ----
+enum class FsmReg : uint8_t
+{
+    sba, target_sba, tck_sba,
+    run, loaded,
+    current_state, next_state, transition_fired, quiescent,
+    last_applied_state, last_error,
+    count
+};
+
+int fsm_reg_find(std::string_view name);   // -1 when not an FsmRegisters field
+
+// ---- one bytecode op ----
+struct GuardOp
+{
+    enum Code : uint8_t {
+        True, False,
+        BeliefTrue, BeliefFalse,   // a = subject id
+        LocalReg,                  // a = FsmReg,            b = const
+        RemoteReg,                 // a = remote register,   b = const
+        Context,                   // a = context slot,      b = const
+        AfterMs, AfterTicks,       // a = N
+        Not, And, Or
+    };
+    enum Cmp : uint8_t { Eq, Ne, Lt, Le, Gt, Ge };
+
+    Code    code = True;
+    Cmp     cmp  = Eq;
+    int32_t a    = 0;
+    int32_t b    = 0;
+};
+
+// ---- context field reference: ctx(SUBJECT).path ----
+struct GuardContextRef
+{
+    int                      subject = -1;
+    std::vector<std::string> path;
+};
+
+// ---- what a guard can see; implemented by the host ----
+struct GuardEnv
+{
+    const uint64_t* observed_true  = nullptr;
+    const uint64_t* observed_false = nullptr;
+    size_t          words          = 0;
+
+    virtual GuardValue local(FsmReg) const { return {}; }
+    virtual GuardValue remote(int)   const { return {}; }
+    virtual GuardValue context(int)  const { return {}; }
+
+    virtual uint64_t   elapsed_ms()    const { return 0; }   // in current state
+    virtual uint64_t   elapsed_ticks() const { return 0; }
+
+    virtual ~GuardEnv() = default;
+};
+
+// Compiles `text` into transition t of def (masks and/or bytecode).
+// Returns false and fills error on a syntax error.
+bool fsm_compile_guard(std::string_view text,
+                       FsmDefinition& def,
+                       int transition,
+                       std::string& error);
+
+bool fsm_eval_guard(const FsmDefinition& def,
+                    int transition,
+                    const GuardEnv& env);
+
+bool fsm_compare(const GuardValue& v, GuardOp::Cmp cmp, const GuardConst& c);
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// Flight recorder (transition history)
+//
+// A fixed ring of fixed-size records per instance, written on every fired
+// transition and never read on the hot path: recording is one slot index
+// and a handful of stores, no allocation, no formatting. The ring keeps
+// the last capacity() transitions; seq counts every one ever recorded, so
+// a reader can tell how many were overwritten.
+//
+// Ids refer to the definition the instance was running when the record was
+// written (a hot reload starts a fresh history). Each record also lists the
+// belief subjects the guard tested that held when it fired (the first
+// MAX_MATCHED of them), as ids in the Fsm's SubjectTable: a named instance's
+// own copies ("FSM.<id>.…"), deadlines and or-ed alternatives show up as
+// what was actually read, not as the guard's text.
+//
+// The default ring is small (DEFAULT_CAPACITY records of 72 bytes, about
+// 2 KB per instance); PUT "history": N resizes one instance's ring.
+//
+// Binary dump (GET resource=history path=...):
+//
+//     FsmHistoryHeader
+//     FsmHistoryRecord[count]     oldest first
+//     char legend[legend_bytes]   JSON: definition, instance, state names,
+//                                 guard and beliefs of recorded transitions,
+//                                 names of recorded subject ids
+// -----------------------------------------------------------------------------
+struct FsmHistoryRecord
+{
+    static constexpr uint32_t MAX_MATCHED = 6;
+
+    uint64_t ns           = 0;     // mpp::now_ns() when fired
+    uint64_t tick         = 0;     // Fsm tick number
+    uint64_t bls_revision = 0;     // revision of the snapshot that enabled it
+    uint32_t seq          = 0;     // low bits of the record number
+    int32_t  transition   = -1;    // index into the definition's transitions
+    int32_t  from         = -1;    // state ids
+    int32_t  to           = -1;
+    uint8_t  matched      = 0;     // subject ids in use, at most MAX_MATCHED
+    uint8_t  matched_true = 0;     // bit i: subject[i] held true (else false)
+    uint16_t pad          = 0;
+    int32_t  subject[MAX_MATCHED] = {};
+};
+
+static_assert(sizeof(FsmHistoryRecord) == 72);
+
+struct FsmHistoryHeader
+{
+    char     magic[8]     = { 'M', 'P', 'P', 'F', 'S', 'M', 'H', '\0' };
+    uint32_t version      = 2;
+    uint32_t record_size  = sizeof(FsmHistoryRecord);
+    uint64_t recorded     = 0;     // every transition since the ring started
+    uint32_t count        = 0;     // records that follow
+    uint32_t legend_bytes = 0;
+};
+
+class FsmHistory
+{
+public:
+    static constexpr uint32_t DEFAULT_CAPACITY = 32;
+
+    explicit FsmHistory(uint32_t capacity = DEFAULT_CAPACITY) { resize(capacity); }
+
+    // rounds up to a power of two; drops what was recorded
+    void resize(uint32_t capacity)
+    {
+        uint32_t n = 1;
+        while (n < capacity && n < (1u << 20))
+            n <<= 1;
+        ring_.assign(n, FsmHistoryRecord{});
+        mask_ = n - 1;
+        next_ = 0;
+    }
+
+    void clear() { next_ = 0; }
+
+    // the caller adds the matched subjects (add_matched) to what it returns
+    FsmHistoryRecord& record(uint64_t ns, uint64_t tick, uint64_t bls_revision,
+                             int transition, int from, int to)
+    {
+        FsmHistoryRecord& r = ring_[next_ & mask_];
+        r.ns           = ns;
+        r.tick         = tick;
+        r.bls_revision = bls_revision;
+        r.seq          = static_cast<uint32_t>(next_);
+        r.transition   = transition;
+        r.from         = from;
+        r.to           = to;
+        r.matched      = 0;
+        r.matched_true = 0;
+        ++next_;
+        return r;
+    }
+
+    static void add_matched(FsmHistoryRecord& r, int subject, bool polarity)
+    {
+        if (r.matched == FsmHistoryRecord::MAX_MATCHED)
+            return;
+        for (uint32_t i = 0; i < r.matched; ++i)
+            if (r.subject[i] == subject && ((r.matched_true >> i) & 1) == polarity)
+                return;   // tested twice (masks and bytecode)
+        r.matched_true |= uint8_t(polarity) << r.matched;
+        r.subject[r.matched++] = subject;
+    }
+
+    uint32_t capacity() const { return mask_ + 1; }
+    uint64_t recorded() const { return next_; }
+    uint32_t size()     const { return next_ < capacity() ? uint32_t(next_) : capacity(); }
+
+    // i = 0 is the oldest record still held
+    const FsmHistoryRecord& at(uint32_t i) const
+    {
+        return ring_[(next_ - size() + i) & mask_];
+    }
+
+private:
+    std::vector<FsmHistoryRecord> ring_;
+    uint64_t next_ = 0;
+    uint32_t mask_ = 0;
+};
@@ -0,0 +1,566 @@
+#include "FsmDefinition.hpp"
+#include "FsmImage.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace fsm_image;
+
+// -----------------------------------------------------------------------------
+// Writer
+// -----------------------------------------------------------------------------
+namespace {
+
+struct ImageWriter
+{
+    std::vector<char> data[Count];
+    uint64_t          count[Count]{};
+
+    template <typename T>
+    uint32_t add(Section s, const T& rec)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        const char* p = reinterpret_cast<const char*>(&rec);
+        data[s].insert(data[s].end(), p, p + sizeof(T));
+        return static_cast<uint32_t>(count[s]++);
+    }
+
+    StrRef str(std::string_view v)
+    {
+        StrRef r;
+        r.off = static_cast<uint32_t>(data[Strings].size());
+        r.len = static_cast<uint32_t>(v.size());
+        data[Strings].insert(data[Strings].end(), v.begin(), v.end());
+        count[Strings] = data[Strings].size();
+        return r;
+    }
+
+    Range strs(Section s, const std::vector<std::string>& v)
+    {
+        Range r{ static_cast<uint32_t>(count[s]), static_cast<uint32_t>(v.size()) };
+        for (const auto& x : v)
+            add(s, str(x));
+        return r;
+    }
+
+    Range u32s(const std::vector<uint32_t>& v)
+    {
+        Range r{ static_cast<uint32_t>(count[Timers]), static_cast<uint32_t>(v.size()) };
+        for (uint32_t x : v)
+            add(Timers, x);
+        return r;
+    }
+};
+
+size_t align8(size_t n) { return (n + 7) & ~size_t(7); }
+
+} // namespace
+
+bool FsmDefinition::write_image(const std::string& path, std::string& error) const
+{
+    ImageWriter w;
+
+    FsmImageHeader h;
+    std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.mask_words = static_cast<uint32_t>(mask_words);
+    h.initial    = initial;
+    h.name       = w.str(name);
+
+    // ---- subjects (the image's ids are this table's ids) ----
+    for (const auto& subject : subjects->names)
+        w.add(Subjects, w.str(subject));
+
+    // ---- states and their compiled notes ----
+    for (const auto& s : states) {
+        const FsmNote& n = s.payloads;
+
+        ImgState r;
+        r.name             = w.str(s.name);
+        r.terminal         = s.terminal;
+        r.has_note         = n.has_note;
+        r.has_commit       = n.has_commit;
+        r.commit_polarity  = n.commit_polarity;
+        r.first_transition = s.first_transition;
+        r.transition_count = s.transition_count;
+        r.after_ms         = w.u32s(s.after_ms);
+        r.after_ticks      = w.u32s(s.after_ticks);
+        r.deadline_ms      = s.deadline_ms;
+        r.deadline_ticks   = s.deadline_ticks;
+        r.deadline_subject = w.str(s.deadline_subject);
+
+        r.state_subject    = w.str(n.state_subject);
+        r.state_bytes      = w.str(n.state_bytes);
+        r.commit_subject   = w.str(n.commit_subject);
+        r.commit_context   = w.str(n.has_commit ? n.commit_context.dump() : "");
+        r.commit_bytes     = w.str(n.commit_bytes);
+        r.tck_bytes        = w.str(n.tck_bytes);
+        r.send_chunks      = w.strs(Chunks, n.send.chunks);
+        r.parent           = s.parent;
+        r.region           = s.region;
+        r.depth            = s.depth;
+
+        r.send_holes = { static_cast<uint32_t>(w.count[Holes]),
+                         static_cast<uint32_t>(n.send.holes.size()) };
+        for (const auto& hole : n.send.holes)
+            w.add(Holes, ImgHole{ w.str(hole.name), hole.local, hole.remote });
+
+        w.add(States, r);
+    }
+
+    for (const auto& g : regions)
+        w.add(Regions, ImgRegion{ g.parent, g.initial });
+
+    // ---- transitions ----
+    auto ids = [&](const std::vector<std::string>& subjects_) {
+        Range r{ static_cast<uint32_t>(w.count[BeliefIds]),
+                 static_cast<uint32_t>(subjects_.size()) };
+        for (const auto& subject : subjects_)
+            w.add(BeliefIds, static_cast<uint32_t>(find_subject(subject)));
+        return r;
+    };
+
+    for (size_t i = 0; i < transitions.size(); ++i) {
+        const Transition& t = transitions[i];
+
+        ImgTransition r;
+        r.from          = t.from;
+        r.to            = t.to;
+        r.line          = t.line;
+        r.code_begin    = t.code_begin;
+        r.code_end      = t.code_end;
+        r.guard         = w.str(t.guard);
+        r.beliefs       = ids(t.beliefs);
+        r.beliefs_false = ids(t.beliefs_false);
+        w.add(Transitions, r);
+
+        for (size_t k = 0; k < mask_words; ++k) {
+            w.add(MaskTrue,  need_true(static_cast<int>(i))[k]);
+            w.add(MaskFalse, need_false(static_cast<int>(i))[k]);
+        }
+    }
+
+    // ---- guard programs ----
+    for (const auto& op : guard_code)
+        w.add(GuardCode, op);
+
+    for (const auto& c : guard_consts) {
+        ImgConst r;
+        r.kind = c.kind;
+        r.b    = c.b;
+        r.num  = c.num;
+        r.str  = w.str(c.str);
+        w.add(GuardConsts, r);
+    }
+
+    for (const auto& reg : remote_registers)
+        w.add(RemoteRegisters, w.str(reg));
+
+    for (const auto& c : contexts)
+        w.add(Contexts, ImgContext{ c.subject, w.strs(Paths, c.path) });
+
+    // ---- lay out ----
+    size_t offset = align8(sizeof(FsmImageHeader));
+    for (uint32_t s = 0; s < Count; ++s) {
+        h.sections[s].offset = offset;
+        h.sections[s].count  = w.count[s];
+        offset = align8(offset + w.data[s].size());
+    }
+    h.file_size = offset;
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        error = path + ": " + std::strerror(errno);
+        return false;
+    }
+
+    std::vector<char> file(offset, 0);
+    std::memcpy(file.data(), &h, sizeof(h));
+    for (uint32_t s = 0; s < Count; ++s)
+        if (!w.data[s].empty())
+            std::memcpy(file.data() + h.sections[s].offset,
+                        w.data[s].data(), w.data[s].size());
+
+    out.write(file.data(), static_cast<std::streamsize>(file.size()));
+    if (!out) {
+        error = path + ": write failed";
+        return false;
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// Loader
+//
+// One read-only shared mapping; every record is bounds-checked against the
+// file before use. The masks stay in the mapping when subject ids line up,
+// so processes loading the same image share those pages.
+// -----------------------------------------------------------------------------
+namespace {
+
+struct ImageReader
+{
+    const char*           base = nullptr;
+    size_t                size = 0;
+    const FsmImageHeader* h    = nullptr;
+    bool                  bad  = false;
+
+    template <typename T>
+    const T* section(Section s, size_t& n)
+    {
+        const SectionRef& r = h->sections[s];
+        n = r.count;
+        if (r.offset > size || r.offset % alignof(T) != 0 ||
+            r.count > (size - r.offset) / sizeof(T)) {
+            bad = true;
+            n = 0;
+            return nullptr;
+        }
+        return reinterpret_cast<const T*>(base + r.offset);
+    }
+
+    std::string_view str(StrRef r)
+    {
+        const SectionRef& pool = h->sections[Strings];
+        if (uint64_t(r.off) + r.len > pool.count) {
+            bad = true;
+            return {};
+        }
+        return std::string_view(base + pool.offset + r.off, r.len);
+    }
+
+    bool in(Range r, size_t n)
+    {
+        if (uint64_t(r.begin) + r.count > n)
+            bad = true;
+        return !bad;
+    }
+};
+
+// fsm_eval_guard trusts the bytecode: every operand indexes the tables it
+// was compiled against, and a program leaves exactly one result on the
+// 64-entry bit stack.
+bool check_program(const GuardOp* code, int begin, int end,
+                   size_t n_consts, size_t n_regs, size_t n_ctx)
+{
+    int depth = 0;
+    for (int i = begin; i < end; ++i) {
+        const GuardOp& op = code[i];
+
+        bool ok   = op.cmp <= GuardOp::Ge;
+        int  pops = 0;
+        switch (op.code) {
+            case GuardOp::True:
+            case GuardOp::False:
+            case GuardOp::BeliefTrue:    // remapped (and checked) by the loader
+            case GuardOp::BeliefFalse:
+                break;
+            case GuardOp::LocalReg:
+                ok &= op.a >= 0 && op.a < int32_t(FsmReg::count);
+                break;
+            case GuardOp::RemoteReg:
+                ok &= op.a >= 0 && size_t(op.a) < n_regs;
+                break;
+            case GuardOp::Context:
+                ok &= op.a >= 0 && size_t(op.a) < n_ctx;
+                break;
+            case GuardOp::AfterMs:
+            case GuardOp::AfterTicks:
+                ok &= op.a >= 0;
+                break;
+            case GuardOp::Not:
+                pops = 1;
+                break;
+            case GuardOp::And:
+            case GuardOp::Or:
+                pops = 2;
+                break;
+            default:
+                return false;   // not an opcode
+        }
+
+        if (op.code == GuardOp::LocalReg || op.code == GuardOp::RemoteReg ||
+            op.code == GuardOp::Context)
+            ok &= op.b >= 0 && size_t(op.b) < n_consts;
+
+        if (!ok || depth < pops)
+            return false;
+        depth += 1 - pops;
+        if (depth > 64)
+            return false;
+    }
+    return begin == end || depth == 1;
+}
+
+} // namespace
+
+std::shared_ptr<FsmDefinition>
+FsmDefinition::load_image(const std::string& path,
+                          std::shared_ptr<SubjectTable> subjects,
+                          std::string* error)
+{
+    auto fail = [&](const std::string& why) -> std::shared_ptr<FsmDefinition> {
+        if (error)
+            *error = path + ": " + why;
+        return nullptr;
+    };
+
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return fail(std::strerror(errno));
+
+    struct stat st{};
+    if (fstat(fd, &st) < 0 || size_t(st.st_size) < sizeof(FsmImageHeader)) {
+        close(fd);
+        return fail("not an FSM image");
+    }
+
+    const size_t size = static_cast<size_t>(st.st_size);
+    void* base = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return fail(std::strerror(errno));
+
+    std::shared_ptr<const void> image(base, [size](const void* p) {
+        munmap(const_cast<void*>(p), size);
+    });
+
+    ImageReader rd;
+    rd.base = static_cast<const char*>(base);
+    rd.size = size;
+    rd.h    = static_cast<const FsmImageHeader*>(base);
+
+    const FsmImageHeader& h = *rd.h;
+    if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0)
+        return fail("not an FSM image");
+    if (h.version != VERSION)
+        return fail("image version " + std::to_string(h.version) +
+                    ", expected " + std::to_string(VERSION));
+    if (h.file_size != size)
+        return fail("truncated image");
+
+    size_t n_subjects, n_states, n_timers, n_transitions, n_ids, n_true,
+           n_false, n_code, n_consts, n_regs, n_ctx, n_paths, n_chunks, n_holes,
+           n_regions;
+
+    const auto* subject_refs = rd.section<StrRef>(Subjects, n_subjects);
+    const auto* img_states   = rd.section<ImgState>(States, n_states);
+    const auto* timers       = rd.section<uint32_t>(Timers, n_timers);
+    const auto* img_trans    = rd.section<ImgTransition>(Transitions, n_transitions);
+    const auto* belief_ids   = rd.section<uint32_t>(BeliefIds, n_ids);
+    const auto* mask_true    = rd.section<uint64_t>(MaskTrue, n_true);
+    const auto* mask_false   = rd.section<uint64_t>(MaskFalse, n_false);
+    const auto* code         = rd.section<GuardOp>(GuardCode, n_code);
+    const auto* consts       = rd.section<ImgConst>(GuardConsts, n_consts);
+    const auto* regs         = rd.section<StrRef>(RemoteRegisters, n_regs);
+    const auto* ctxs         = rd.section<ImgContext>(Contexts, n_ctx);
+    const auto* paths        = rd.section<StrRef>(Paths, n_paths);
+    const auto* chunks       = rd.section<StrRef>(Chunks, n_chunks);
+    const auto* holes        = rd.section<ImgHole>(Holes, n_holes);
+    const auto* img_regions  = rd.section<ImgRegion>(Regions, n_regions);
+
+    if (rd.bad || rd.h->sections[Strings].offset + rd.h->sections[Strings].count > size)
+        return fail("corrupt section table");
+    if (h.mask_words == 0 ||
+        n_true  != n_transitions * h.mask_words ||
+        n_false != n_transitions * h.mask_words)
+        return fail("corrupt masks");
+    if (h.initial < 0 || size_t(h.initial) >= n_states)
+        return fail("no initial state");
+
+    auto def = std::make_shared<FsmDefinition>();
+    def->subjects = subjects ? std::move(subjects)
+                             : std::make_shared<SubjectTable>();
+    def->name = rd.str(h.name);
+
+    // ---- subjects: image id -> host id ----
+    std::vector<int> remap(n_subjects);
+    bool aligned = true;
+    for (size_t i = 0; i < n_subjects; ++i) {
+        remap[i] = def->subjects->intern(std::string(rd.str(subject_refs[i])));
+        aligned &= (remap[i] == static_cast<int>(i));
+    }
+
+    auto subject = [&](uint32_t id) -> int {
+        if (id >= n_subjects) {
+            rd.bad = true;
+            return 0;
+        }
+        return remap[id];
+    };
+
+    // a bad id only marks the image corrupt; there is no name to look up
+    auto subject_name = [&](uint32_t id) -> std::string {
+        const int host = subject(id);
+        return rd.bad ? std::string() : def->subjects->names[host];
+    };
+
+    // ---- states ----
+    def->states.resize(n_states);
+    for (size_t i = 0; i < n_states; ++i) {
+        const ImgState& r = img_states[i];
+        State& s = def->states[i];
+
+        s.name             = rd.str(r.name);
+        s.terminal         = r.terminal;
+        s.first_transition = r.first_transition;
+        s.transition_count = r.transition_count;
+        s.deadline_ms      = r.deadline_ms;
+        s.deadline_ticks   = r.deadline_ticks;
+        s.deadline_subject = rd.str(r.deadline_subject);
+        s.parent           = r.parent;
+        s.region           = r.region;
+        s.depth            = r.depth;
+
+        if (r.parent < -1 || r.parent >= int64_t(n_states) ||
+            r.region < -1 || r.region >= int64_t(n_regions) ||
+            (r.parent < 0) != (r.region < 0) || r.depth < 0)
+            return fail("corrupt state " + std::to_string(i));
+
+        if (!rd.in(r.after_ms, n_timers) || !rd.in(r.after_ticks, n_timers) ||
+            !rd.in(r.send_chunks, n_chunks) || !rd.in(r.send_holes, n_holes))
+            return fail("corrupt state " + std::to_string(i));
+
+        s.after_ms.assign(timers + r.after_ms.begin,
+                          timers + r.after_ms.begin + r.after_ms.count);
+        s.after_ticks.assign(timers + r.after_ticks.begin,
+                             timers + r.after_ticks.begin + r.after_ticks.count);
+
+        if (r.first_transition < 0 || r.transition_count < 0 ||
+            size_t(r.first_transition) + r.transition_count > n_transitions)
+            return fail("corrupt state " + std::to_string(i));
+
+        FsmNote& n = s.payloads;
+        n.has_note        = r.has_note;
+        n.has_commit      = r.has_commit;
+        n.commit_polarity = r.commit_polarity;
+        n.state_subject   = rd.str(r.state_subject);
+        n.state_bytes     = rd.str(r.state_bytes);
+        n.commit_subject  = rd.str(r.commit_subject);
+        n.commit_bytes    = rd.str(r.commit_bytes);
+        n.tck_bytes       = rd.str(r.tck_bytes);
+        if (n.has_commit)
+            n.commit_context = nlohmann::json::parse(rd.str(r.commit_context),
+                                                     nullptr, false);
+
+        for (uint32_t k = 0; k < r.send_chunks.count; ++k)
+            n.send.chunks.emplace_back(rd.str(chunks[r.send_chunks.begin + k]));
+        for (uint32_t k = 0; k < r.send_holes.count; ++k) {
+            const ImgHole& ih = holes[r.send_holes.begin + k];
+            // an FsmRegisters field or a remote register, never both
+            if (ih.local < -1 || ih.local >= int32_t(FsmReg::count) ||
+                ih.remote < -1 || ih.remote >= int64_t(n_regs) ||
+                (ih.local < 0) == (ih.remote < 0))
+                return fail("corrupt note for state " + s.name);
+            n.send.holes.push_back({ std::string(rd.str(ih.name)), ih.local, ih.remote });
+        }
+        // no "_send": no chunks; otherwise one more chunk than holes
+        if (n.send.empty() ? !n.send.holes.empty()
+                           : n.send.chunks.size() != n.send.holes.size() + 1)
+            return fail("corrupt note for state " + s.name);
+
+        def->state_index_[s.name] = static_cast<int>(i);
+    }
+    def->initial = h.initial;
+
+    // ---- regions ----
+    for (size_t i = 0; i < n_regions; ++i) {
+        const ImgRegion& r = img_regions[i];
+        if (r.parent < 0 || size_t(r.parent) >= n_states ||
+            r.initial < 0 || size_t(r.initial) >= n_states ||
+            def->states[r.initial].region != static_cast<int>(i))
+            return fail("corrupt region " + std::to_string(i));
+
+        def->regions.push_back({ r.parent, r.initial });
+        def->states[r.parent].regions.push_back(static_cast<int>(i));
+    }
+    // depth falling by one per parent also rules out parent cycles
+    for (const auto& s : def->states)
+        if ((s.region >= 0 && def->regions[s.region].parent != s.parent) ||
+            s.depth != (s.parent < 0 ? 0 : def->states[s.parent].depth + 1))
+            return fail("corrupt state " + s.name);
+
+    // ---- transitions ----
+    def->transitions.resize(n_transitions);
+    for (size_t i = 0; i < n_transitions; ++i) {
+        const ImgTransition& r = img_trans[i];
+        Transition& t = def->transitions[i];
+
+        if (r.from < 0 || size_t(r.from) >= n_states ||
+            r.to   < 0 || size_t(r.to)   >= n_states ||
+            r.code_begin < 0 || r.code_begin > r.code_end ||
+            size_t(r.code_end) > n_code ||
+            !rd.in(r.beliefs, n_ids) || !rd.in(r.beliefs_false, n_ids))
+            return fail("corrupt transition " + std::to_string(i));
+
+        t.from       = r.from;
+        t.to         = r.to;
+        t.line       = r.line;
+        t.code_begin = r.code_begin;
+        t.code_end   = r.code_end;
+        t.guard      = rd.str(r.guard);
+
+        for (uint32_t k = 0; k < r.beliefs.count; ++k)
+            t.beliefs.push_back(subject_name(belief_ids[r.beliefs.begin + k]));
+        for (uint32_t k = 0; k < r.beliefs_false.count; ++k)
+            t.beliefs_false.push_back(subject_name(belief_ids[r.beliefs_false.begin + k]));
+    }
+
+    // ---- guard programs (subject operands follow the host's ids) ----
+    def->guard_code.assign(code, code + n_code);
+    for (auto& op : def->guard_code)
+        if (op.code == GuardOp::BeliefTrue || op.code == GuardOp::BeliefFalse)
+            op.a = subject(static_cast<uint32_t>(op.a));
+
+    for (size_t i = 0; i < n_consts; ++i) {
+        GuardConst c;
+        c.kind = static_cast<GuardValue::Kind>(consts[i].kind);
+        c.b    = consts[i].b;
+        c.num  = consts[i].num;
+        c.str  = rd.str(consts[i].str);
+        def->guard_consts.push_back(std::move(c));
+    }
+
+    for (size_t i = 0; i < n_regs; ++i)
+        def->remote_registers.emplace_back(rd.str(regs[i]));
+
+    for (size_t i = 0; i < n_ctx; ++i) {
+        if (!rd.in(ctxs[i].path, n_paths))
+            return fail("corrupt context " + std::to_string(i));
+
+        GuardContextRef c;
+        c.subject = subject(static_cast<uint32_t>(ctxs[i].subject));
+        for (uint32_t k = 0; k < ctxs[i].path.count; ++k)
+            c.path.emplace_back(rd.str(paths[ctxs[i].path.begin + k]));
+        def->contexts.push_back(std::move(c));
+    }
+
+    for (size_t i = 0; i < n_transitions; ++i) {
+        const Transition& t = def->transitions[i];
+        if (!check_program(def->guard_code.data(), t.code_begin, t.code_end,
+                           n_consts, n_regs, n_ctx))
+            return fail("corrupt guard program for transition " + std::to_string(i));
+    }
+
+    if (rd.bad)
+        return fail("corrupt image");
+
+    // ---- masks: in place when ids line up, rebuilt otherwise ----
+    if (aligned) {
+        def->mask_words    = h.mask_words;
+        def->mapped_true_  = mask_true;
+        def->mapped_false_ = mask_false;
+        def->image_        = std::move(image);
+    } else {
+        def->compile_masks();
+    }
+    def->compile_subject_ids();
+
+    return def;
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cstdint>
+
+// -----------------------------------------------------------------------------
+// Compiled FSM image (on-disk layout)
+//
+// What FsmDefinition::parse_plantuml produces, flattened into fixed-size
+// records so a definition loads with one mmap, without parsing PlantUML or
+// compiling guards:
+//
+//     FsmImageHeader
+//     section[0 .. FsmImageSection::Count)     8-byte aligned, any order
+//
+// Strings live in one pool and are referenced by (offset, length). Subject
+// ids in masks and guard bytecode are the image's own; the loader uses the
+// mapped masks in place when the host's SubjectTable hands out the same ids,
+// and rebuilds them otherwise.
+//
+// The masks are the only pages processes loading one image share. They are
+// the one table that grows with both transitions and subjects (two
+// mask_words rows per transition), and the only one the host reads as
+// stored. Everything else is copied out of the mapping into the
+// definition, because a definition is the same std::vector / std::string /
+// json tables whether parsed or loaded, and Fsm and the guard evaluator
+// index those directly: state and subject names and note bytes and
+// "_send" chunks become strings, guard code is copied after checking every
+// operand (a corrupt image must not reach the evaluator), and each
+// "_commit" context is parsed from its JSON text. Load time therefore grows
+// with note size, not only with the number of records.
+//
+// Written by tools/fsm_compile (see FsmDefinition::write_image), read by
+// FsmDefinition::load_image.
+// -----------------------------------------------------------------------------
+namespace fsm_image {
+
+constexpr char     MAGIC[8] = { 'M', 'P', 'P', 'F', 'S', 'M', 'I', '\0' };
+constexpr uint32_t VERSION  = 2;   // 2: composite states, regions
+
+enum Section : uint32_t
+{
+    Strings,          // char pool
+    Subjects,         // StrRef, by image subject id
+    States,           // ImgState
+    Timers,           // uint32 after(N) values, ranges from ImgState
+    Transitions,      // ImgTransition
+    BeliefIds,        // uint32 subject ids, ranges from ImgTransition
+    MaskTrue,         // uint64, transitions x mask_words
+    MaskFalse,        // uint64, transitions x mask_words
+    GuardCode,        // GuardOp
+    GuardConsts,      // ImgConst
+    RemoteRegisters,  // StrRef
+    Contexts,         // ImgContext
+    Paths,            // StrRef, ranges from ImgContext
+    Chunks,           // StrRef, "_send" static chunks
+    Holes,            // ImgHole
+    Regions,          // ImgRegion; states own the ones naming them parent
+    Count
+};
+
+struct SectionRef
+{
+    uint64_t offset = 0;   // from the start of the file
+    uint64_t count  = 0;   // records (bytes for Strings)
+};
+
+struct StrRef
+{
+    uint32_t off = 0;
+    uint32_t len = 0;
+};
+
+struct Range
+{
+    uint32_t begin = 0;
+    uint32_t count = 0;
+};
+
+struct FsmImageHeader
+{
+    char       magic[8];
+    uint32_t   version     = VERSION;
+    uint32_t   mask_words  = 0;
+    int32_t    initial     = -1;
+    uint32_t   reserved    = 0;
+    StrRef     name;
+    uint64_t   file_size   = 0;
+    SectionRef sections[Count];
+};
+
+struct ImgState
+{
+    StrRef   name;
+    uint8_t  terminal        = 0;
+    uint8_t  has_note        = 0;
+    uint8_t  has_commit      = 0;
+    uint8_t  commit_polarity = 1;
+    int32_t  first_transition = 0;
+    int32_t  transition_count = 0;
+
+    Range    after_ms;            // into Timers
+    Range    after_ticks;
+    uint32_t deadline_ms    = 0;
+    uint32_t deadline_ticks = 0;
+    StrRef   deadline_subject;
+
+    // ---- pre-serialized note (FsmNote) ----
+    StrRef   state_subject;
+    StrRef   state_bytes;
+    StrRef   commit_subject;
+    StrRef   commit_context;      // JSON text
+    StrRef   commit_bytes;
+    StrRef   tck_bytes;
+    Range    send_chunks;         // into Chunks
+    Range    send_holes;          // into Holes
+
+    // ---- hierarchy ----
+    int32_t  parent = -1;
+    int32_t  region = -1;
+    int32_t  depth  = 0;
+    uint32_t pad    = 0;
+};
+
+struct ImgTransition
+{
+    int32_t from = -1;
+    int32_t to   = -1;
+    int32_t line = 0;
+    int32_t code_begin = 0;
+    int32_t code_end   = 0;
+    StrRef  guard;
+    Range   beliefs;              // into BeliefIds
+    Range   beliefs_false;
+};
+
+struct ImgConst
+{
+    uint8_t  kind = 0;            // GuardValue::Kind
+    uint8_t  b    = 0;
+    uint8_t  pad[6]{};
+    double   num  = 0;
+    StrRef   str;
+};
+
+struct ImgContext
+{
+    int32_t subject = -1;
+    Range   path;                 // into Paths
+};
+
+struct ImgHole
+{
+    StrRef  name;
+    int32_t local  = -1;
+    int32_t remote = -1;
+};
+
+struct ImgRegion
+{
+    int32_t parent  = -1;
+    int32_t initial = -1;
+};
+
+} // namespace fsm_image
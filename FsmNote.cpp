@@ -0,0 +1,111 @@
+#include "FsmNote.hpp"
+
+using json = nlohmann::ordered_json;
+
+// -----------------------------------------------------------------------------
+// Belief datagram (same shape as mpp::Component::commit)
+// -----------------------------------------------------------------------------
+std::string fsm_belief_bytes(const std::string& component,
+                             const std::string& subject,
+                             bool polarity,
+                             const nlohmann::json& context)
+{
+    json msg;
+    msg["belief"] = {
+        {"component", component},
+        {"subject",   subject},
+        {"polarity",  polarity},
+        {"context",   context}
+    };
+    return msg.dump() + "\n";
+}
+
+// -----------------------------------------------------------------------------
+// Payload with patch points
+//
+// Each "$REG.<name>" string is swapped for a marker ("\x01" + hole index),
+// the body is dumped once, and the dump is cut at the escaped markers. The
+// walk below is pre-order like dump(), so holes come out in index order.
+// -----------------------------------------------------------------------------
+static void mark_holes(json& j, std::vector<FsmPayload::Hole>& holes)
+{
+    if (j.is_structured()) {
+        for (auto& v : j)
+            mark_holes(v, holes);
+        return;
+    }
+
+    if (!j.is_string())
+        return;
+
+    const std::string& s = j.get_ref<const std::string&>();
+    if (s.rfind("$REG.", 0) != 0)
+        return;
+
+    FsmPayload::Hole h;
+    h.name = s.substr(5);
+    j = "\x01" + std::to_string(holes.size());
+    holes.push_back(std::move(h));
+}
+
+FsmPayload FsmPayload::compile(const json& body)
+{
+    FsmPayload p;
+
+    json marked = body;
+    mark_holes(marked, p.holes);
+
+    const std::string dump = marked.dump() + "\n";
+
+    size_t pos = 0;
+    for (size_t i = 0; i < p.holes.size(); ++i) {
+        const std::string token = "\"\\u0001" + std::to_string(i) + "\"";
+        const size_t at = dump.find(token, pos);
+
+        p.chunks.push_back(dump.substr(pos, at - pos));
+        pos = at + token.size();
+    }
+    p.chunks.push_back(dump.substr(pos));
+    return p;
+}
+
+// -----------------------------------------------------------------------------
+// Note channels, compiled once per state
+// -----------------------------------------------------------------------------
+FsmNote FsmNote::compile(const std::string& state, const json& note)
+{
+    // The notes are the Fsm component's: its beliefs carry "FSM"
+    static const std::string component = "FSM";
+
+    FsmNote n;
+
+    n.state_subject = "FSM.state." + state;
+    n.state_bytes   = fsm_belief_bytes(component, n.state_subject,
+                                       true, nlohmann::json::object());
+
+    n.has_note = !note.is_null();
+    if (!note.is_object())
+        return n;
+
+    if (note.contains("_commit") && note["_commit"].is_object()) {
+        const json& c = note["_commit"];
+
+        n.commit_subject  = c.value("subject", "");
+        n.commit_polarity = c.value("polarity", true);
+        n.commit_context  = c.value("context", json::object());
+        n.has_commit      = !n.commit_subject.empty();
+
+        if (n.has_commit)
+            n.commit_bytes = fsm_belief_bytes(component, n.commit_subject,
+                                              n.commit_polarity,
+                                              n.commit_context);
+    }
+
+    if (note.contains("_send"))
+        n.send = FsmPayload::compile(note["_send"]);
+
+    if (note.contains("_tck"))
+        n.tck_bytes = note["_tck"].dump() + "\n";
+
+    return n;
+}
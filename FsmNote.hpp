@@ -0,0 +1,77 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+#include <string>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// Pre-serialized datagram with patch points
+//
+// A note's "_send" body is dumped once at load time. Every "$REG.<name>"
+// string, at any depth, becomes a hole; the bytes between holes are kept
+// verbatim, so sending is a copy of the static chunks plus the serialized
+// register values. A payload without holes is sent straight from chunks[0].
+// -----------------------------------------------------------------------------
+struct FsmPayload
+{
+    struct Hole {
+        std::string name;          // without "$REG."
+        int         local  = -1;   // FsmReg, when an FsmRegisters field
+        int         remote = -1;   // FsmDefinition::remote_registers index
+    };
+
+    std::vector<std::string> chunks;   // static bytes; holes.size() + 1 of them
+    std::vector<Hole>        holes;
+
+    bool empty()    const { return chunks.empty(); }
+    bool constant() const { return holes.empty(); }
+
+    // value(out, hole) appends the serialized JSON value of a hole
+    template <typename Resolve>
+    void render(std::string& out, Resolve&& value) const
+    {
+        out.clear();
+        out += chunks[0];
+        for (size_t i = 0; i < holes.size(); ++i) {
+            value(out, holes[i]);
+            out += chunks[i + 1];
+        }
+    }
+
+    static FsmPayload compile(const nlohmann::ordered_json& body);
+};
+
+// -----------------------------------------------------------------------------
+// A state's note, compiled
+// -----------------------------------------------------------------------------
+struct FsmNote
+{
+    bool           has_note = false;    // the state had a note at all
+
+    // ---- _commit ----
+    bool           has_commit = false;
+    std::string    commit_subject;
+    bool           commit_polarity = true;
+    nlohmann::json commit_context;
+    std::string    commit_bytes;        // the belief datagram, ready to send
+
+    // ---- _send ----
+    FsmPayload     send;
+
+    // ---- _tck ----
+    std::string    tck_bytes;           // empty = no _tck channel
+
+    // ---- FSM.state.<STATE>, committed on every entry ----
+    std::string    state_subject;
+    std::string    state_bytes;
+
+    static FsmNote compile(const std::string& state,
+                           const nlohmann::ordered_json& note);
+};
+
+// the datagram Component::commit() would build for this belief
+std::string fsm_belief_bytes(const std::string& component,
+                             const std::string& subject,
+                             bool polarity,
+                             const nlohmann::json& context);
@@ -0,0 +1,232 @@
+// Metrics.hpp
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mpp {
+
+// -----------------------------------------------------------------------------
+// Metrics (counters, gauges, latency histograms)
+//
+// Single-threaded like the component that owns them: updating one is a plain
+// add on memory the caller already holds a reference to. Registration
+// (by name and labels, once) returns that reference; expose() renders
+// everything in the Prometheus text format for GET metrics, series of one
+// name together.
+// -----------------------------------------------------------------------------
+struct Counter
+{
+    uint64_t value = 0;
+    void add(uint64_t n = 1) { value += n; }
+};
+
+struct Gauge
+{
+    int64_t value = 0;
+    void set(int64_t v) { value = v; }
+};
+
+// HDR-style log-linear histogram: values below 16 are exact, above that each
+// power of two is split into 16 buckets, so any value is reported within
+// 1/16 (6.25%) of itself, from 1 up to 2^64, in fixed memory.
+class Histogram
+{
+public:
+    static constexpr int SUB_BITS = 4;
+    static constexpr int SUB      = 1 << SUB_BITS;
+    static constexpr int BUCKETS  = (64 - SUB_BITS + 1) * SUB;
+
+    void record(uint64_t v)
+    {
+        ++buckets_[index(v)];
+        ++count_;
+        sum_ += v;
+        max_ = std::max(max_, v);
+    }
+
+    uint64_t count() const { return count_; }
+    uint64_t sum()   const { return sum_; }
+    uint64_t max()   const { return max_; }
+
+    // smallest bucket bound at or above fraction q of the values (q in 0..1)
+    uint64_t quantile(double q) const
+    {
+        if (count_ == 0)
+            return 0;
+
+        const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * count_ + 0.5));
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; ++i) {
+            seen += buckets_[i];
+            if (seen >= rank)
+                return std::min(upper(i), max_);
+        }
+        return max_;
+    }
+
+private:
+    std::vector<uint64_t> buckets_ = std::vector<uint64_t>(BUCKETS, 0);
+    uint64_t count_ = 0;
+    uint64_t sum_   = 0;
+    uint64_t max_   = 0;
+
+    static int index(uint64_t v)
+    {
+        if (v < SUB)
+            return static_cast<int>(v);
+        const int shift = (63 - __builtin_clzll(v)) - SUB_BITS;
+        return (shift + 1) * SUB + static_cast<int>((v >> shift) - SUB);
+    }
+
+    // largest value that lands in bucket i
+    static uint64_t upper(int i)
+    {
+        if (i < SUB)
+            return static_cast<uint64_t>(i);
+        const int shift = i / SUB - 1;
+        const uint64_t low = (uint64_t(SUB) + i % SUB) << shift;
+        return low + ((uint64_t(1) << shift) - 1);
+    }
+};
+
+class Metrics
+{
+public:
+    Counter& counter(const std::string& name, const std::string& help)
+    {
+        return find_or_add(counters_, Kind::CounterKind, name, help);
+    }
+
+    Gauge& gauge(const std::string& name, const std::string& help)
+    {
+        return find_or_add(gauges_, Kind::GaugeKind, name, help);
+    }
+
+    // labels: this series' own, formatted like expose()'s, e.g. type="tick"
+    Histogram& histogram(const std::string& name, const std::string& help,
+                         const std::string& labels = "")
+    {
+        return find_or_add(histograms_, Kind::HistogramKind, name, help, labels);
+    }
+
+    // labels: already formatted, e.g. component="FSM",sba="7002"
+    std::string expose(std::string_view labels) const
+    {
+        std::string out;
+        char num[32];
+
+        auto line = [&](const std::string& name, const Entry& e, std::string_view extra,
+                        uint64_t v) {
+            out += name;
+            out += '{';
+            out += labels;
+            for (std::string_view more : { std::string_view(e.labels), extra })
+                if (!more.empty()) {
+                    out += ',';
+                    out += more;
+                }
+            out += "} ";
+            std::snprintf(num, sizeof(num), "%llu", static_cast<unsigned long long>(v));
+            out += num;
+            out += '\n';
+        };
+
+        for (size_t first = 0; first < entries_.size(); ++first) {
+            const Entry& f = entries_[first];
+            if (!is_first(first))
+                continue;
+
+            static constexpr const char* type[] = { "counter", "gauge", "summary" };
+            out += "# HELP " + f.name + " " + f.help + "\n";
+            out += "# TYPE " + f.name + " " + type[static_cast<int>(f.kind)] + "\n";
+
+            for (size_t i = first; i < entries_.size(); ++i) {
+                const Entry& e = entries_[i];
+                if (e.name != f.name)
+                    continue;
+
+                switch (e.kind) {
+                case Kind::CounterKind:
+                    line(e.name, e, "", counters_[e.slot].value);
+                    break;
+
+                case Kind::GaugeKind: {
+                    // gauges may go negative
+                    const int64_t v = gauges_[e.slot].value;
+                    out += e.name + "{" + std::string(labels) + "} " + std::to_string(v) + "\n";
+                    break;
+                }
+
+                case Kind::HistogramKind: {
+                    const Histogram& h = histograms_[e.slot];
+                    line(e.name, e, "quantile=\"0.5\"",   h.quantile(0.5));
+                    line(e.name, e, "quantile=\"0.9\"",   h.quantile(0.9));
+                    line(e.name, e, "quantile=\"0.99\"",  h.quantile(0.99));
+                    line(e.name, e, "quantile=\"0.999\"", h.quantile(0.999));
+                    line(e.name + "_sum",   e, "", h.sum());
+                    line(e.name + "_count", e, "", h.count());
+                    break;
+                }
+                }
+            }
+
+            // a summary has no max series; it is a gauge family of its own
+            if (f.kind == Kind::HistogramKind) {
+                out += "# HELP " + f.name + "_max Largest value recorded: " + f.help + "\n";
+                out += "# TYPE " + f.name + "_max gauge\n";
+                for (size_t i = first; i < entries_.size(); ++i)
+                    if (entries_[i].name == f.name)
+                        line(f.name + "_max", entries_[i], "",
+                             histograms_[entries_[i].slot].max());
+            }
+        }
+        return out;
+    }
+
+private:
+    enum class Kind { CounterKind, GaugeKind, HistogramKind };
+
+    struct Entry {
+        std::string name;
+        std::string help;
+        Kind        kind;
+        size_t      slot;
+        std::string labels;
+    };
+
+    // deques: references handed out stay valid as more are registered
+    std::vector<Entry>    entries_;
+    std::deque<Counter>   counters_;
+    std::deque<Gauge>     gauges_;
+    std::deque<Histogram> histograms_;
+
+    template <typename T>
+    T& find_or_add(std::deque<T>& pool, Kind kind,
+                   const std::string& name, const std::string& help,
+                   const std::string& labels = "")
+    {
+        for (const Entry& e : entries_)
+            if (e.name == name && e.kind == kind && e.labels == labels)
+                return pool[e.slot];
+
+        entries_.push_back({ name, help, kind, pool.size(), labels });
+        return pool.emplace_back();
+    }
+
+    // entry i is the first series of its name
+    bool is_first(size_t i) const
+    {
+        for (size_t k = 0; k < i; ++k)
+            if (entries_[k].name == entries_[i].name)
+                return false;
+        return true;
+    }
+};
+
+} // namespace mpp
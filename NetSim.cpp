@@ -0,0 +1,174 @@
+#include "NetSim.hpp"
+
+#include <algorithm>
+
+using json = nlohmann::ordered_json;
+
+// Ethernet + IPv4 + ICMP headers, counted against the bandwidth
+static constexpr uint64_t FRAME_OVERHEAD = 14 + 20 + 8;
+
+NetSim::NetSim(int sba)
+    : mpp::Component<NetSim>(sba),
+      regs_(json::object()),
+      tx_frames_(metrics_.counter("net_tx_frames_total", "Frames put on the simulated wire")),
+      rx_frames_(metrics_.counter("net_rx_frames_total", "Frames received from the peer")),
+      dropped_(metrics_.counter("net_dropped_frames_total", "Frames lost to sim_loss")),
+      wire_ns_(metrics_.histogram("net_wire_ns", "Queueing + serialization + delay per frame (ns)"))
+{
+}
+
+// -----------------------------------------------------------------------------
+// Register writes (an Fsm's _send)
+// -----------------------------------------------------------------------------
+void NetSim::apply_snapshot(const json& j)
+{
+    if (!j.is_object() || j.contains("verb") || j.contains("tick") || j.contains("frame"))
+        return;
+
+    for (auto it = j.begin(); it != j.end(); ++it)
+        regs_[it.key()] = it.value();
+    registers_changed();
+
+    cfg_.peer_sba      = j.value("sim_peer_sba",      cfg_.peer_sba);
+    cfg_.delay_us      = j.value("sim_delay_us",      cfg_.delay_us);
+    cfg_.jitter_us     = j.value("sim_jitter_us",     cfg_.jitter_us);
+    cfg_.loss          = j.value("sim_loss",          cfg_.loss);
+    cfg_.bandwidth_bps = j.value("sim_bandwidth_bps", cfg_.bandwidth_bps);
+    cfg_.echo          = j.value("sim_echo",          cfg_.echo);
+    cfg_.tx_on_payload = j.value("sim_tx_on_payload", cfg_.tx_on_payload);
+    if (j.contains("sim_seed")) {
+        cfg_.seed = j.value("sim_seed", cfg_.seed);
+        rng_.seed(cfg_.seed);
+    }
+
+    const bool fire = j.value("tx_fire", false) ||
+                      (cfg_.tx_on_payload && j.contains("icmp4_payload"));
+    if (fire)
+        transmit(regs_.value("icmp4_payload", ""), false);
+
+    if (j.contains("rx_fire")) {
+        rx_armed_ = j.value("rx_fire", false);
+        try_receive();
+    }
+}
+
+void NetSim::on_message(const json& j)
+{
+    if (j.contains("frame") && j["frame"].is_object())
+        receive(j["frame"]);
+}
+
+// -----------------------------------------------------------------------------
+// The wire
+// -----------------------------------------------------------------------------
+void NetSim::transmit(const std::string& payload, bool reply)
+{
+    const uint64_t now = mpp::now_ns();
+
+    // serialization behind whatever is still on the link
+    const uint64_t bits  = (payload.size() + FRAME_OVERHEAD) * 8;
+    const uint64_t ser   = cfg_.bandwidth_bps ? bits * 1000000000ull / cfg_.bandwidth_bps : 0;
+    const uint64_t start = std::max(now, wire_free_ns_);
+    wire_free_ns_ = start + ser;
+
+    uint64_t delay = cfg_.delay_us * 1000;
+    if (cfg_.jitter_us)
+        delay += rng_() % (cfg_.jitter_us * 1000);
+
+    Frame f;
+    f.sent_ns = wire_free_ns_;
+    f.due_ns  = wire_free_ns_ + delay;
+    f.seq     = next_seq_++;
+    f.payload = payload;
+    f.reply   = reply;
+
+    tx_frames_.add();
+    regs_["tx_count"] = regs_.value("tx_count", uint64_t(0)) + 1;
+    registers_changed();
+
+    // the frame has left either way; only the peer misses it
+    if (!reply)
+        tx_pending_ns_ = std::max(tx_pending_ns_, f.sent_ns);
+
+    if (cfg_.loss > 0 &&
+        std::uniform_real_distribution<double>(0.0, 1.0)(rng_) < cfg_.loss) {
+        dropped_.add();
+        return;
+    }
+
+    wire_ns_.record(f.due_ns - now);
+    wire_.push(std::move(f));
+}
+
+void NetSim::receive(const json& frame)
+{
+    rx_frames_.add();
+
+    const std::string payload = frame.value("payload", "");
+    if (cfg_.echo && !frame.value("reply", false))
+        transmit(payload, true);
+
+    if (rx_buffer_.size() == RX_BUFFER)
+        rx_buffer_.pop_front();   // pcap's ring would drop too
+    rx_buffer_.push_back(payload);
+
+    try_receive();
+}
+
+void NetSim::try_receive()
+{
+    if (!rx_armed_ || rx_buffer_.empty())
+        return;
+
+    regs_["rx_payload"] = rx_buffer_.front();
+    regs_["rx_count"]   = regs_.value("rx_count", uint64_t(0)) + 1;
+    rx_buffer_.pop_front();
+    rx_armed_ = false;
+    registers_changed();
+
+    commit_done("NET.rx_done");
+}
+
+void NetSim::commit_done(const char* subject)
+{
+    json context;
+    context["tx_count"] = regs_.value("tx_count", uint64_t(0));
+    context["rx_count"] = regs_.value("rx_count", uint64_t(0));
+    commit(subject, true, context);
+}
+
+void NetSim::on_idle()
+{
+    const uint64_t now = mpp::now_ns();
+
+    while (!wire_.empty() && wire_.top().due_ns <= now) {
+        const Frame& f = wire_.top();
+
+        json msg;
+        msg["frame"] = {
+            {"seq",     f.seq},
+            {"payload", f.payload},
+            {"reply",   f.reply}
+        };
+        send_json(msg, cfg_.peer_sba ? cfg_.peer_sba : sba_);
+        wire_.pop();
+    }
+
+    if (tx_pending_ns_ && tx_pending_ns_ <= now) {
+        tx_pending_ns_ = 0;
+        commit_done("NET.tx_done");
+    }
+
+    publish_registers();
+}
+
+// -----------------------------------------------------------------------------
+// Registers, as published (Component.hpp)
+// -----------------------------------------------------------------------------
+json NetSim::serialize_registers() const
+{
+    json j = regs_;
+    j["component"] = "NET";
+    j["sba"]       = sba_;
+    return j;
+}
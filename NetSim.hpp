@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Component.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+using json = nlohmann::ordered_json;
+
+// -----------------------------------------------------------------------------
+// NET simulator
+//
+// Stands in for the libnet/pcap NET component on one box: takes the same
+// register writes (libnet_*, eth_*, ip4_*, icmp4_*, pcap_*, tx_fire,
+// rx_fire, net_rx_enable) and, instead of a NIC, moves frames over
+// loopback UDP to a peer NET simulator (or back to itself).
+//
+//   tx_fire: true            queue icmp4_payload as a frame; NET.tx_done once
+//                            it has left the (shaped) wire
+//   rx_fire: true            NET.rx_done on the next frame received (or one
+//                            already buffered); its payload in rx_payload
+//
+// Shaping, set like any other register:
+//
+//   sim_peer_sba       peer NET simulator (0: frames loop back here)
+//   sim_delay_us       one-way propagation delay
+//   sim_jitter_us      + uniform [0, jitter)
+//   sim_loss           drop probability per frame
+//   sim_bandwidth_bps  serialization rate, 0 = unlimited
+//   sim_echo           answer every frame received, like an ICMP echo peer
+//   sim_tx_on_payload  writing icmp4_payload fires too (fsm-net.puml)
+//   sim_seed           loss / jitter generator
+//
+// Frames are released from on_idle(), so delays resolve to the component
+// loop's 1 ms poll. Registers are published to subscribers (Component.hpp).
+// -----------------------------------------------------------------------------
+struct NetSimConfig
+{
+    int      peer_sba      = 0;
+    uint64_t delay_us      = 0;
+    uint64_t jitter_us     = 0;
+    double   loss          = 0.0;
+    uint64_t bandwidth_bps = 0;
+    bool     echo          = false;
+    bool     tx_on_payload = false;
+    uint64_t seed          = 1;
+};
+
+class NetSim : public mpp::Component<NetSim>
+{
+public:
+    explicit NetSim(int sba);
+
+    // MPP interface
+    const char* component_name() const override { return "NET"; }
+    void apply_snapshot(const mpp::json& j);
+    void on_message(const mpp::json& j);
+    void on_idle();
+    json serialize_registers() const;
+
+private:
+    json            regs_;          // NET registers, as written
+    NetSimConfig    cfg_;
+    std::mt19937_64 rng_{1};
+
+    // -------------------------------------------------------------------------
+    // The wire: frames in flight, released in due order from on_idle()
+    // -------------------------------------------------------------------------
+    struct Frame {
+        uint64_t    due_ns  = 0;      // arrival at the peer
+        uint64_t    sent_ns = 0;      // last bit on the wire (tx done)
+        uint64_t    seq     = 0;
+        std::string payload;
+        bool        reply   = false;  // an echo going back
+        bool operator>(const Frame& o) const
+        {
+            return due_ns != o.due_ns ? due_ns > o.due_ns : seq > o.seq;
+        }
+    };
+
+    std::priority_queue<Frame, std::vector<Frame>, std::greater<Frame>> wire_;
+    uint64_t wire_free_ns_ = 0;       // when the link finishes the last frame
+    uint64_t next_seq_     = 0;
+    uint64_t tx_pending_ns_ = 0;      // NET.tx_done due (0: none)
+
+    std::deque<std::string> rx_buffer_;     // received, not yet consumed
+    static constexpr size_t RX_BUFFER = 1024;
+    bool rx_armed_ = false;
+
+    void transmit(const std::string& payload, bool reply);
+    void receive(const json& frame);
+    void try_receive();
+    void commit_done(const char* subject);
+
+    mpp::Counter&   tx_frames_;
+    mpp::Counter&   rx_frames_;
+    mpp::Counter&   dropped_;
+    mpp::Histogram& wire_ns_;
+};
@@ -0,0 +1,440 @@
+// Sim.hpp
+#pragma once
+
+#include "Component.hpp"
+
+#include <arpa/inet.h>
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mpp {
+
+// -----------------------------------------------------------------------------
+// Deterministic simulation
+//
+// Every component of a deployment in one process, on one thread. The
+// sockets are replaced by an in-memory network (Component::set_outbox /
+// inject) and mpp::now_ns() by a virtual clock that jumps from one event to
+// the next, so a scenario that takes seconds on real hosts runs in
+// milliseconds, and the same seed replays it exactly: every random choice
+// (loss, latency jitter, reordering) comes from the simulation's own
+// generator, and events due at the same time run in the order they were
+// scheduled.
+//
+// Each node's idle hook (on_idle: timers, register publication) runs every
+// idle_period_ns of virtual time, as Component::run() would between polls.
+//
+//     Simulation sim(seed);
+//     Fsm& fsm = sim.add<Fsm>(6002);
+//     sim.add_node<SimTck>(6001, sim);
+//     auto& bls = sim.add_node<SimBls>(BLS_PORT, sim);
+//     ...
+//     bool done = sim.run_until([&] { return bls.believes("FSM.XFR.complete"); },
+//                               sim.clock() + 5'000'000'000);
+// -----------------------------------------------------------------------------
+
+// Per-datagram delivery model, for all traffic or one (from, to) pair
+struct SimLink
+{
+    uint64_t latency_ns = 50'000;   // base one-way delay
+    uint64_t jitter_ns  = 0;        // + uniform [0, jitter_ns)
+    double   loss       = 0.0;      // drop probability
+    double   reorder    = 0.0;      // probability of an extra reorder_ns delay
+    uint64_t reorder_ns = 1'000'000;
+};
+
+class Simulation
+{
+public:
+    using Deliver = std::function<void(std::string_view payload, int from)>;
+    using Idle    = std::function<void()>;
+
+    explicit Simulation(uint64_t seed, uint64_t start_ns = 1'000'000'000)
+        : clock_(start_ns), rng_(seed ? seed : 1)
+    {
+        virtual_clock_ns = &clock_;
+    }
+
+    ~Simulation()
+    {
+        nodes_.clear();   // components first, while the clock is still theirs
+        virtual_clock_ns = nullptr;
+    }
+
+    Simulation(const Simulation&) = delete;
+    Simulation& operator=(const Simulation&) = delete;
+
+    uint64_t clock() const { return clock_; }
+
+    SimLink link;                                  // default for every pair
+    std::map<std::pair<int, int>, SimLink> links;  // overrides by (from, to)
+    uint64_t idle_period_ns = 1'000'000;
+
+    // ---- nodes ----
+
+    // an mpp::Component (Fsm, Xfr, ...) on port sba
+    template <typename C, typename... Args>
+    C& add(int sba, Args&&... args)
+    {
+        auto owned = std::make_shared<C>(sba, std::forward<Args>(args)...);
+        C& comp = *owned;
+
+        comp.set_outbox([this, sba](std::string_view payload, const sockaddr_in& dest) {
+            send(sba, ntohs(dest.sin_port), payload);
+        });
+
+        Idle idle;
+        if constexpr (requires(C& c) { c.on_idle(); })
+            idle = [&comp] { comp.on_idle(); };
+
+        attach(sba, owned,
+               [&comp](std::string_view payload, int from) {
+                   sockaddr_in sender{};
+                   sender.sin_family      = AF_INET;
+                   sender.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                   sender.sin_port        = htons(static_cast<uint16_t>(from));
+                   comp.inject(payload, sender);
+               },
+               std::move(idle));
+        return comp;
+    }
+
+    // a stand-in with deliver(payload, from) and, optionally, idle()
+    template <typename N, typename... Args>
+    N& add_node(int sba, Args&&... args)
+    {
+        auto owned = std::make_shared<N>(sba, std::forward<Args>(args)...);
+        N& node = *owned;
+
+        Idle idle;
+        if constexpr (requires(N& n) { n.idle(); })
+            idle = [&node] { node.idle(); };
+
+        attach(sba, owned,
+               [&node](std::string_view payload, int from) { node.deliver(payload, from); },
+               std::move(idle));
+        return node;
+    }
+
+    // ---- network ----
+
+    // queues a datagram from -> to through the link model
+    void send(int from, int to, std::string_view payload)
+    {
+        ++stats.sent;
+        auto it = links.find({ from, to });
+        const SimLink& l = it != links.end() ? it->second : link;
+
+        if (l.loss > 0 && uniform() < l.loss) {
+            ++stats.lost;
+            return;
+        }
+
+        uint64_t delay = l.latency_ns;
+        if (l.jitter_ns)
+            delay += next() % l.jitter_ns;
+        if (l.reorder > 0 && uniform() < l.reorder) {
+            delay += l.reorder_ns;
+            ++stats.reordered;
+        }
+
+        schedule(clock_ + delay, [this, from, to, p = std::string(payload)] {
+            auto node = nodes_.find(to);
+            if (node == nodes_.end()) {
+                ++stats.unroutable;
+                return;
+            }
+            ++stats.delivered;
+            if (tap)
+                tap(clock_, from, to, p);
+            node->second.deliver(p, from);
+        });
+    }
+
+    // sees every delivered datagram (logging, digests, assertions)
+    std::function<void(uint64_t ns, int from, int to, const std::string& payload)> tap;
+
+    struct Stats {
+        uint64_t sent = 0, delivered = 0, lost = 0, reordered = 0, unroutable = 0;
+        uint64_t events = 0;
+    } stats;
+
+    // ---- time ----
+
+    void at(uint64_t ns, std::function<void()> fn)
+    {
+        schedule(ns < clock_ ? clock_ : ns, std::move(fn));
+    }
+
+    void after(uint64_t delay_ns, std::function<void()> fn)
+    {
+        schedule(clock_ + delay_ns, std::move(fn));
+    }
+
+    // Runs events in time order until done() holds after one (true) or
+    // the clock would pass limit_ns (false).
+    bool run_until(const std::function<bool()>& done, uint64_t limit_ns)
+    {
+        while (!queue_.empty()) {
+            Event e = queue_.top();
+            if (e.ns > limit_ns)
+                break;
+            queue_.pop();
+
+            clock_ = e.ns;
+            ++stats.events;
+            e.fn();
+
+            if (done())
+                return true;
+        }
+        if (clock_ < limit_ns)
+            clock_ = limit_ns;
+        return false;
+    }
+
+    // ---- randomness (the only source a scenario should use) ----
+
+    uint64_t next()   // xorshift64*
+    {
+        rng_ ^= rng_ >> 12;
+        rng_ ^= rng_ << 25;
+        rng_ ^= rng_ >> 27;
+        return rng_ * 0x2545F4914F6CDD1Dull;
+    }
+
+    double uniform() { return (next() >> 11) * 0x1.0p-53; }
+
+private:
+    struct Node {
+        std::shared_ptr<void> owner;
+        Deliver deliver;
+        Idle    idle;
+    };
+
+    struct Event {
+        uint64_t ns;
+        uint64_t seq;
+        std::function<void()> fn;
+        bool operator>(const Event& o) const
+        {
+            return ns != o.ns ? ns > o.ns : seq > o.seq;
+        }
+    };
+
+    uint64_t clock_;
+    uint64_t rng_;
+    uint64_t seq_ = 0;
+    std::map<int, Node> nodes_;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> queue_;
+
+    void schedule(uint64_t ns, std::function<void()> fn)
+    {
+        queue_.push(Event{ ns, seq_++, std::move(fn) });
+    }
+
+    void attach(int sba, std::shared_ptr<void> owner, Deliver deliver, Idle idle)
+    {
+        const bool has_idle = static_cast<bool>(idle);
+        nodes_[sba] = Node{ std::move(owner), std::move(deliver), std::move(idle) };
+        if (has_idle)
+            schedule_idle(sba);
+    }
+
+    void schedule_idle(int sba)
+    {
+        after(idle_period_ns, [this, sba] {
+            auto it = nodes_.find(sba);
+            if (it == nodes_.end())
+                return;
+            it->second.idle();
+            schedule_idle(sba);
+        });
+    }
+};
+
+// -----------------------------------------------------------------------------
+// Stand-ins for the components that are not in this tree
+// -----------------------------------------------------------------------------
+
+// BLS: keeps the latest polarity and context per subject and answers
+// GET beliefs the way Fsm expects ({"beliefs", "contexts", "revision"}).
+class SimBls
+{
+public:
+    SimBls(int sba, Simulation& sim) : sba_(sba), sim_(sim) {}
+
+    void deliver(std::string_view payload, int from)
+    {
+        const json j = json::parse(payload, nullptr, false);
+        if (!j.is_object())
+            return;
+
+        if (j.contains("belief") && j["belief"].is_object()) {
+            const json& b = j["belief"];
+            const std::string subject = b.value("subject", "");
+            if (subject.empty())
+                return;
+            beliefs_[subject]  = b.value("polarity", true);
+            contexts_[subject] = b.value("context", json::object());
+            ++revision_;
+            return;
+        }
+
+        if (j.value("verb", "") == "GET" && j.value("resource", "") == "beliefs") {
+            json r;
+            r["beliefs"] = beliefs_;
+            if (j.value("contexts", false))
+                r["contexts"] = contexts_;
+            r["revision"] = revision_;
+            sim_.send(sba_, from, r.dump() + "\n");
+        }
+    }
+
+    // scenario input (an operator's belief)
+    void set(const std::string& subject, bool polarity)
+    {
+        beliefs_[subject] = polarity;
+        ++revision_;
+    }
+
+    bool believes(const std::string& subject) const
+    {
+        auto it = beliefs_.find(subject);
+        return it != beliefs_.end() && it.value().get<bool>();
+    }
+
+    uint64_t revision() const { return revision_; }
+
+private:
+    int         sba_;
+    Simulation& sim_;
+    json        beliefs_  = json::object();
+    json        contexts_ = json::object();
+    uint64_t    revision_ = 0;
+};
+
+// TCK: {"enable":true[,"target_sba":N][,"period_ms":P]} starts ticking the
+// target every period; {"enable":false} stops.
+class SimTck
+{
+public:
+    SimTck(int sba, Simulation& sim, int target_sba = 0, uint64_t period_ns = 10'000'000)
+        : sba_(sba), sim_(sim), target_(target_sba), period_ns_(period_ns) {}
+
+    void deliver(std::string_view payload, int)
+    {
+        const json j = json::parse(payload, nullptr, false);
+        if (!j.is_object() || !j.contains("enable"))
+            return;
+
+        target_ = j.value("target_sba", target_);
+        if (j.contains("period_ms"))
+            period_ns_ = j.value("period_ms", uint64_t(10)) * 1'000'000;
+        enable(j.value("enable", false));
+    }
+
+    void enable(bool on)
+    {
+        if (on == enabled_)
+            return;
+        enabled_ = on;
+        if (on)
+            tick(++generation_);
+    }
+
+    uint64_t ticks() const { return ticks_; }
+
+private:
+    int         sba_;
+    Simulation& sim_;
+    int         target_;
+    uint64_t    period_ns_;
+    bool        enabled_    = false;
+    uint64_t    generation_ = 0;   // a disable + enable restarts the chain
+    uint64_t    ticks_      = 0;
+
+    void tick(uint64_t generation)
+    {
+        if (!enabled_ || generation != generation_)
+            return;
+        if (target_) {
+            sim_.send(sba_, target_, "{\"tick\":true}\n");
+            ++ticks_;
+        }
+        sim_.after(period_ns_, [this, generation] { tick(generation); });
+    }
+};
+
+// NET: a frame "sent" (tx_fire or an icmp4_payload) commits NET.tx_done
+// after tx_ns, rx_fire commits NET.rx_done after rx_ns. Registers are
+// published to subscribers like Xfr does, as a full snapshot.
+class SimNet
+{
+public:
+    SimNet(int sba, Simulation& sim, uint64_t tx_ns = 200'000, uint64_t rx_ns = 2'000'000)
+        : sba_(sba), sim_(sim), tx_ns_(tx_ns), rx_ns_(rx_ns) {}
+
+    void deliver(std::string_view payload, int from)
+    {
+        const json j = json::parse(payload, nullptr, false);
+        if (!j.is_object())
+            return;
+
+        if (j.value("verb", "") == "POST" && j.value("resource", "") == "registers") {
+            if (j.value("action", "") == "subscribe")
+                publish(j.value("sba", from));
+            return;
+        }
+
+        for (auto it = j.begin(); it != j.end(); ++it)
+            registers_[it.key()] = it.value();
+
+        if (j.value("tx_fire", false) || j.contains("icmp4_payload")) {
+            ++frames_;
+            sim_.after(tx_ns_, [this] { commit("NET.tx_done"); });
+        }
+        if (j.value("rx_fire", false))
+            sim_.after(rx_ns_, [this] { commit("NET.rx_done"); });
+    }
+
+    uint64_t frames() const { return frames_; }
+
+private:
+    int         sba_;
+    Simulation& sim_;
+    uint64_t    tx_ns_;
+    uint64_t    rx_ns_;
+    json        registers_ = json::object();
+    uint64_t    frames_    = 0;
+
+    void commit(const char* subject)
+    {
+        json msg;
+        msg["belief"] = {
+            {"component", "NET"},
+            {"subject",   subject},
+            {"polarity",  true},
+            {"context",   json::object()}
+        };
+        sim_.send(sba_, BLS_PORT, msg.dump() + "\n");
+    }
+
+    void publish(int to)
+    {
+        json msg;
+        msg["sba"]       = sba_;
+        msg["full"]      = true;
+        msg["registers"] = registers_;
+        sim_.send(sba_, to, msg.dump() + "\n");
+    }
+};
+
+} // namespace mpp
@@ -0,0 +1,277 @@
+#pragma once
+
+#include "Component.hpp"
+
+#include <array>
+#include <concepts>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// -----------------------------------------------------------------------------
+// Compile-time FSM (generated definitions)
+//
+// tools/fsm_codegen turns a .puml into a header holding one definition type:
+//
+//     struct PingFsm {
+//         enum class State : uint8_t { INIT, CONFIGURE, ... };
+//         static constexpr std::array<Transition, N> transitions = { ... };
+//         static constexpr std::array<Note, M>       notes       = { ... };
+//         static constexpr std::array<Outgoing, M>   outgoing    = { ... };
+//         static constexpr int select(State, uint64_t have_true,
+//                                     uint64_t have_false);
+//     };
+//
+// select() tests the state's outgoing guards as single-word bit tests over
+// constant masks, in declaration order. Notes are the bytes FsmNote
+// would have built at load, as string literals. The generator only accepts
+// what that covers: flat machines, belief guards, <= 64 subjects, no
+// register holes or timers; anything else stays on the dynamic Fsm.
+// -----------------------------------------------------------------------------
+template <typename Def>
+concept StaticFsmDefinition = requires(typename Def::State s, uint64_t bits) {
+    { Def::name }        -> std::convertible_to<std::string_view>;
+    { Def::initial }     -> std::convertible_to<typename Def::State>;
+    { Def::state_names[0] } -> std::convertible_to<std::string_view>;
+    { Def::subjects.size() } -> std::convertible_to<size_t>;
+    { Def::transitions[0].to } -> std::convertible_to<typename Def::State>;
+    { Def::notes[0].terminal } -> std::convertible_to<bool>;
+    { Def::select(s, bits, bits) } -> std::same_as<int>;
+};
+
+// -----------------------------------------------------------------------------
+// StaticMachine (state + observed beliefs; no sockets)
+// -----------------------------------------------------------------------------
+template <StaticFsmDefinition Def>
+struct StaticMachine
+{
+    using State = typename Def::State;
+
+    State    state      = Def::initial;
+    uint64_t have_true  = 0;
+    uint64_t have_false = 0;
+
+    static constexpr int find_subject(std::string_view subject)
+    {
+        for (size_t i = 0; i < Def::subjects.size(); ++i)
+            if (Def::subjects[i] == subject)
+                return static_cast<int>(i);
+        return -1;
+    }
+
+    void clear_beliefs() { have_true = have_false = 0; }
+
+    void observe(std::string_view subject, bool polarity)
+    {
+        const int id = find_subject(subject);
+        if (id < 0)
+            return;   // no guard mentions it
+        (polarity ? have_true : have_false) |= uint64_t(1) << id;
+    }
+
+    // Fires at most one transition; returns its index or -1.
+    int step()
+    {
+        const int t = Def::select(state, have_true, have_false);
+        if (t >= 0)
+            state = Def::transitions[t].to;
+        return t;
+    }
+
+    bool terminal() const { return Def::notes[index()].terminal; }
+
+    size_t           index() const { return static_cast<size_t>(state); }
+    std::string_view name()  const { return Def::state_names[index()]; }
+};
+
+// -----------------------------------------------------------------------------
+// StaticFsm (mpp::Component driving one StaticMachine)
+//
+// Speaks the Fsm control protocol for the default instance: ticks, GET,
+// PUT resource=fsm (target_sba, tck_sba; restarts at the initial state),
+// POST run / stop, and BLS belief snapshots. fsm_text / fsm_image are
+// refused: the definition is the one compiled in.
+// -----------------------------------------------------------------------------
+template <StaticFsmDefinition Def>
+class StaticFsm : public mpp::Component<StaticFsm<Def>>
+{
+    using Base = mpp::Component<StaticFsm<Def>>;
+    using json = nlohmann::ordered_json;
+
+public:
+    explicit StaticFsm(int sba)
+        : Base(sba)
+    {
+        // commit contexts are only kept for the committed_ record
+        for (size_t i = 0; i < Def::notes.size(); ++i)
+            if (!Def::notes[i].commit_subject.empty())
+                commit_context_[i] = json::parse(Def::notes[i].commit_context);
+    }
+
+    void apply_snapshot(const json& j)
+    {
+        if (j.value("tick", false)) {
+            on_tick();
+            return;
+        }
+
+        if (!j.contains("verb"))
+            return;
+
+        const std::string verb = j["verb"];
+
+        if (verb == "GET") {
+            this->reply_json(describe());
+            return;
+        }
+
+        if (verb == "PUT" && j.value("resource", "") == "fsm") {
+            put_fsm(j.value("body", json::object()));
+            return;
+        }
+
+        if (verb == "POST") {
+            const std::string action = j.value("action", "");
+            if (action == "run")  run_ = true;
+            if (action == "stop") run_ = false;
+
+            if (quiescent_)
+                wake();
+        }
+    }
+
+    void on_message(const json& j)
+    {
+        if (!j.is_object() || !j.contains("beliefs"))
+            return;
+
+        machine_.clear_beliefs();
+        for (auto it = j["beliefs"].begin(); it != j["beliefs"].end(); ++it)
+            if (it.value().is_boolean())
+                machine_.observe(it.key(), it.value().template get<bool>());
+    }
+
+    void on_tick()
+    {
+        if (!run_ || quiescent_)
+            return;
+
+        poll_bls();
+        step();
+    }
+
+protected:
+    const char* component_name() const override { return "FSM"; }
+
+private:
+    StaticMachine<Def> machine_;
+
+    int  target_sba_ = 0;
+    int  tck_sba_    = 0;
+    bool run_        = false;
+    bool quiescent_  = false;
+    int  fired_      = -1;   // transition fired by the last step
+    std::string last_error_;
+
+    std::array<json, Def::notes.size()> commit_context_;
+
+    static constexpr std::string_view TCK_ENABLE  = "{\"enable\":true}\n";
+    static constexpr std::string_view TCK_DISABLE = "{\"enable\":false}\n";
+
+    json describe() const
+    {
+        json r;
+        r["component"]        = "FSM";
+        r["sba"]              = this->sba_;
+        r["instance"]         = "";
+        r["definition"]       = std::string(Def::name);
+        r["static"]           = true;
+        r["target_sba"]       = target_sba_;
+        r["tck_sba"]          = tck_sba_;
+        r["run"]              = run_;
+        r["loaded"]           = true;
+        r["current_state"]    = std::string(machine_.name());
+        r["next_state"]       = fired_ >= 0 ? std::string(machine_.name()) : "";
+        r["transition_fired"] = fired_ >= 0;
+        r["quiescent"]        = quiescent_;
+        r["last_error"]       = last_error_;
+        return r;
+    }
+
+    void put_fsm(const json& body)
+    {
+        if (body.contains("target_sba"))
+            target_sba_ = body["target_sba"].template get<int>();
+
+        if (body.contains("tck_sba"))
+            tck_sba_ = body["tck_sba"].template get<int>();
+
+        if (body.contains("fsm_text") || body.contains("fsm_image")) {
+            last_error_ = "static definition " + std::string(Def::name) +
+                          " cannot be replaced";
+            return;
+        }
+
+        machine_.state = Def::initial;
+        fired_         = -1;
+        run_           = true;
+        last_error_.clear();
+
+        if (quiescent_)
+            wake();
+    }
+
+    void step()
+    {
+        fired_ = machine_.step();
+        if (fired_ < 0)
+            return;
+
+        enter(machine_.index());
+
+        if (machine_.terminal()) {
+            quiescent_ = true;
+            route(TCK_DISABLE, tck_sba_);
+        }
+    }
+
+    void enter(size_t state)
+    {
+        const auto& note = Def::notes[state];
+
+        // State belief
+        this->commit_prepared(std::string(note.state_subject), true,
+                              json::object(), note.state_bytes);
+
+        if (!note.commit_subject.empty())
+            this->commit_prepared(std::string(note.commit_subject),
+                                  note.commit_polarity,
+                                  commit_context_[state],
+                                  note.commit_bytes);
+
+        route(note.send_bytes, target_sba_);
+        route(note.tck_bytes, tck_sba_);
+    }
+
+    void wake()
+    {
+        if (machine_.terminal())
+            return;   // still nothing to evaluate; stay parked
+
+        quiescent_ = false;
+        route(TCK_ENABLE, tck_sba_);
+    }
+
+    void route(std::string_view bytes, int sba)
+    {
+        if (!bytes.empty() && sba != 0)
+            this->send_bytes(bytes, sba);
+    }
+
+    void poll_bls()
+    {
+        static constexpr std::string_view GET_BELIEFS =
+            "{\"verb\":\"GET\",\"resource\":\"beliefs\"}\n";
+        this->send_bytes(GET_BELIEFS, mpp::BLS_PORT);
+    }
+};
@@ -0,0 +1,199 @@
+// Trace.hpp
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <unistd.h>
+
+namespace mpp {
+
+// -----------------------------------------------------------------------------
+// Causal tracing
+//
+// A traced datagram carries one extra member, stamped by the sender:
+//
+//     "_trace": { "trace": <id>, "parent": <span id>, "ts": <send ns> }
+//
+// The receiver handles it as a span whose parent is the sender's span, and
+// whatever it sends while handling it carries the context on. Spans land in
+// one lock-free ring per process; GET resource=trace path=... dumps it and
+// tools/trace_merge joins the dumps of every process into a Chrome / Perfetto
+// trace. Timestamps are mpp::now_ns() (CLOCK_MONOTONIC), so dumps taken on
+// one host line up.
+//
+// Dump file:
+//
+//     TraceDumpHeader
+//     TraceSpan[count]      in record order
+// -----------------------------------------------------------------------------
+struct TraceSpan
+{
+    uint64_t trace     = 0;
+    uint64_t span      = 0;
+    uint64_t parent    = 0;    // 0: root
+    uint64_t sent_ns   = 0;    // parent's send time (0: root)
+    uint64_t start_ns  = 0;    // datagram received
+    uint64_t end_ns    = 0;    // handler returned
+    uint32_t sba       = 0;
+    char component[8]  = {};
+    char name[20]      = {};   // verb + resource, or the first member
+};
+
+struct TraceDumpHeader
+{
+    char     magic[8]    = { 'M', 'P', 'P', 'T', 'R', 'A', 'C', 'E' };
+    uint32_t version     = 1;
+    uint32_t record_size = sizeof(TraceSpan);
+    uint64_t recorded    = 0;      // every span since the process started
+    uint32_t count       = 0;      // spans that follow
+    uint32_t pid         = 0;
+};
+
+// Fixed ring shared by every component in the process. Writers claim a
+// slot with one fetch_add and publish it with a release store of its
+// sequence number; a reader keeps a slot only if that number is the same
+// before and after copying it.
+class SpanBuffer
+{
+public:
+    explicit SpanBuffer(uint32_t capacity)
+    {
+        uint32_t n = 1;
+        while (n < capacity && n < (1u << 24))
+            n <<= 1;
+        slots_ = std::make_unique<Slot[]>(n);
+        mask_ = n - 1;
+    }
+
+    // MPP_TRACE_SPANS sets the capacity (default 65536)
+    static SpanBuffer& process()
+    {
+        static SpanBuffer buffer([] {
+            const char* env = std::getenv("MPP_TRACE_SPANS");
+            const long n = env ? std::atol(env) : 0;
+            return n > 0 ? uint32_t(n) : 65536u;
+        }());
+        return buffer;
+    }
+
+    void record(const TraceSpan& s)
+    {
+        const uint64_t i = next_.fetch_add(1, std::memory_order_relaxed);
+        Slot& slot = slots_[i & mask_];
+        slot.seq.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.span = s;
+        slot.seq.store(i + 1, std::memory_order_release);
+    }
+
+    uint64_t recorded() const { return next_.load(std::memory_order_acquire); }
+
+    // oldest first; spans being overwritten while copied are skipped
+    std::vector<TraceSpan> snapshot() const
+    {
+        const uint64_t end   = recorded();
+        const uint64_t begin = end > mask_ + 1 ? end - (mask_ + 1) : 0;
+
+        std::vector<TraceSpan> out;
+        out.reserve(end - begin);
+        for (uint64_t i = begin; i < end; ++i) {
+            const Slot& slot = slots_[i & mask_];
+            if (slot.seq.load(std::memory_order_acquire) != i + 1)
+                continue;
+            const TraceSpan copy = slot.span;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) == i + 1)
+                out.push_back(copy);
+        }
+        return out;
+    }
+
+    bool dump(const std::string& path, size_t& count, std::string& error) const
+    {
+        const std::vector<TraceSpan> spans = snapshot();
+
+        TraceDumpHeader h;
+        h.recorded = recorded();
+        h.count    = static_cast<uint32_t>(spans.size());
+        h.pid      = static_cast<uint32_t>(getpid());
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (out) {
+            out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+            out.write(reinterpret_cast<const char*>(spans.data()),
+                      static_cast<std::streamsize>(spans.size() * sizeof(TraceSpan)));
+        }
+        if (!out) {
+            error = path + ": " + std::strerror(errno);
+            return false;
+        }
+        count = spans.size();
+        return true;
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> seq{0};
+        TraceSpan span;
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+    uint64_t mask_ = 0;
+    std::atomic<uint64_t> next_{0};
+};
+
+// Per-component tracing state: the span being handled, if any, and ids.
+class Tracer
+{
+public:
+    Tracer()
+    {
+        const char* env = std::getenv("MPP_TRACE");
+        enabled = env && *env && *env != '0';
+
+        // distinct per process and per component within one
+        state_ = (uint64_t(getpid()) << 32) ^ reinterpret_cast<uintptr_t>(this) ^
+                 static_cast<uint64_t>(
+                     std::chrono::steady_clock::now().time_since_epoch().count());
+    }
+
+    bool enabled = false;
+
+    // the span a handler is running in (trace == 0: none)
+    TraceSpan current;
+    bool      sent = false;   // current span sent something
+
+    // a fresh nonzero id (splitmix64)
+    uint64_t next_id()
+    {
+        uint64_t z = (state_ += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        z ^= z >> 31;
+        return z ? z : 1;
+    }
+
+private:
+    uint64_t state_ = 0;
+};
+
+// copies up to sizeof(dst) - 1 characters, always terminated
+template <size_t N>
+inline void trace_copy(char (&dst)[N], std::string_view src)
+{
+    const size_t n = src.size() < N - 1 ? src.size() : N - 1;
+    std::memcpy(dst, src.data(), n);
+    dst[n] = '\0';
+}
+
+} // namespace mpp
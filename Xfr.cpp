@@ -39,10 +39,10 @@ json Xfr::serialize_registers() const
 
 void Xfr::apply_snapshot(const json& j)
 {
-    if (j.contains("mode")) regs_.mode = j["mode"];
-    if (j.contains("advance")) regs_.advance = j["advance"];
+    if (j.contains("mode"))    { regs_.mode = j["mode"];       registers_changed(); }
+    if (j.contains("advance")) { regs_.advance = j["advance"]; registers_changed(); }
 }
 
-void Xfr::on_message(const json& j)
+void Xfr::on_message(const json&)
 {
 }
@@ -51,7 +51,7 @@ public:
     json serialize_registers() const;
     void apply_snapshot(const mpp::json& j);
     void on_message(const mpp::json& j);
-    void publish_snapshot() {}
+    void on_idle() { publish_registers(); }
 
 
 private:
@@ -0,0 +1,154 @@
+// bench_bls.cpp
+//
+// BeliefStore under load: `subjects` namespaced subjects (NET.*, FSM.*,
+// XFR.*, ...), then `commits` beliefs to random subjects with a small
+// context. Reports commits/s, and the latency of the snapshots BLS serves:
+// full (with and without contexts), since_revision deltas of a few sizes,
+// a prefix, and history: as_of_revision at a few depths and diffs (whole
+// store and a prefix), and how soon BLS refuses those that cannot fit a
+// datagram.
+// Best of `runs`.
+//
+//   g++ -std=c++20 -O2 -o bench_bls bench_bls.cpp ../BeliefStore.cpp
+//   ./bench_bls [subjects] [commits] [runs]
+
+#include "../BeliefStore.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+static const char* const NAMESPACES[] = {
+    "NET.", "FSM.XFR.", "FSM.NET.", "XFR.", "TCK.", "HUD.", "FSM.PING.", "APP."
+};
+
+static std::vector<std::string> make_subjects(int n)
+{
+    std::vector<std::string> out;
+    out.reserve(n);
+    for (int i = 0; i < n; ++i)
+        out.push_back(std::string(NAMESPACES[i % 8]) + "s" + std::to_string(i) + ".done");
+    return out;
+}
+
+template <typename F>
+static double best_of(int runs, F&& f)
+{
+    double best = 1e30;
+    for (int r = 0; r < runs; ++r) {
+        const auto t0 = std::chrono::steady_clock::now();
+        f();
+        const double s = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - t0).count();
+        if (s < best)
+            best = s;
+    }
+    return best;
+}
+
+int main(int argc, char** argv)
+{
+    const int subjects = argc > 1 ? std::atoi(argv[1]) : 100000;
+    const int commits  = argc > 2 ? std::atoi(argv[2]) : 1000000;
+    const int runs     = argc > 3 ? std::atoi(argv[3]) : 5;
+
+    const std::vector<std::string> names = make_subjects(subjects);
+
+    std::mt19937_64 rng(1);
+    std::vector<uint32_t> order(commits);
+    for (auto& o : order)
+        o = static_cast<uint32_t>(rng() % subjects);
+
+    BeliefStore store;
+    for (const auto& s : names)
+        store.commit("BENCH", s, true, std::string());
+
+    const double commit_s = best_of(1, [&] {
+        for (int i = 0; i < commits; ++i)
+            store.commit("BENCH", names[order[i]], i & 1,
+                         "{\"n\":" + std::to_string(i) + "}");
+    });
+
+    std::printf("subjects=%zu revision=%llu\n", store.size(),
+                static_cast<unsigned long long>(store.revision()));
+    std::printf("  commit                 %10.0f commits/s  %8.0f ns/commit\n",
+                commits / commit_s, commit_s * 1e9 / commits);
+
+    std::string out;
+    auto query = [&](const char* label, BeliefStore::Query q) {
+        size_t n = 0;
+        const double s = best_of(runs, [&] { out.clear(); n = store.snapshot(q, out); });
+        std::printf("  %-22s %10.3f ms  %8zu subjects  %8.2f MB\n",
+                    label, s * 1e3, n, out.size() / 1e6);
+    };
+
+    const uint64_t rev = store.revision();
+
+    BeliefStore::Query q;
+    query("full", q);
+
+    q.contexts = true;
+    query("full + contexts", q);
+
+    q = {};
+    q.since = rev - 10;
+    query("since rev-10", q);
+    q.since = rev - 1000;
+    query("since rev-1000", q);
+    q.since = rev - 100000;
+    query("since rev-100000", q);
+
+    q = {};
+    q.prefixes = { "FSM.XFR." };
+    query("prefix FSM.XFR.", q);
+
+    q.since = rev - 1000;
+    query("prefix + since rev-1000", q);
+
+    // history (the default keeps the last 1M revisions)
+    for (uint64_t back : { uint64_t(1000), uint64_t(100000), uint64_t(900000) }) {
+        if (!store.in_history(rev - back))
+            continue;
+        q = {};
+        q.as_of = rev - back;
+        query(("as_of rev-" + std::to_string(back)).c_str(), q);
+        q.prefixes = { "FSM.XFR." };
+        query(("as_of rev-" + std::to_string(back) + " prefix").c_str(), q);
+    }
+
+    for (uint64_t span : { uint64_t(1000), uint64_t(100000) }) {
+        const uint64_t from = rev - 500000;
+        size_t n = 0;
+        double s = best_of(runs, [&] { out.clear(); n = store.diff(from, from + span, {}, out); });
+        std::printf("  %-22s %10.3f ms  %8zu subjects  %8.2f MB\n",
+                    ("diff " + std::to_string(span) + " revisions").c_str(), s * 1e3, n,
+                    out.size() / 1e6);
+        s = best_of(runs, [&] { out.clear(); n = store.diff(from, from + span, { "FSM.XFR." }, out); });
+        std::printf("  %-22s %10.3f ms  %8zu subjects  %8.2f MB\n",
+                    ("diff " + std::to_string(span) + " prefix").c_str(), s * 1e3, n,
+                    out.size() / 1e6);
+    }
+
+    // what BLS does with them: refused, as a reply must fit one datagram
+    auto refused = [&](const char* label, auto&& f) {
+        size_t n = 0;
+        const double s = best_of(runs, [&] { out.clear(); n = f(); });
+        std::printf("  %-22s %10.3f ms  %s\n", label, s * 1e3,
+                    n == BeliefStore::TOO_LARGE ? "refused" : "answered");
+    };
+    const size_t datagram = 65506;
+
+    q = {};
+    q.as_of = rev - 100000;
+    q.max_bytes = datagram;
+    refused("as_of rev-100000 64K", [&] { return store.snapshot(q, out); });
+    q.since = rev - 200000;
+    refused("as_of + since 64K", [&] { return store.snapshot(q, out); });
+    refused("diff 100000 64K", [&] {
+        return store.diff(rev - 500000, rev - 400000, {}, out, datagram);
+    });
+    return 0;
+}
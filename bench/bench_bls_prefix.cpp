@@ -0,0 +1,96 @@
+// bench_bls_prefix.cpp
+//
+// Prefix queries against total belief count. For each store size, the
+// namespaces an Fsm would ask for (FSM.XFR.*, NET.*: `wanted` subjects
+// each) sit among everything else (APP.n<k>.*, a thousand namespaces).
+// Reports, best of `runs`:
+//
+//   indexed   BeliefStore::snapshot with the prefixes (namespace index)
+//   scan      the same reply built by testing every subject, as before
+//   full      the whole store, what Fsm::poll_bls fetched before prefixes
+//
+//   g++ -std=c++20 -O2 -o bench_bls_prefix bench_bls_prefix.cpp ../BeliefStore.cpp
+//   ./bench_bls_prefix [wanted] [runs]
+
+#include "../BeliefStore.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+template <typename F>
+static double best_of(int runs, F&& f)
+{
+    double best = 1e30;
+    for (int r = 0; r < runs; ++r) {
+        const auto t0 = std::chrono::steady_clock::now();
+        f();
+        const double s = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - t0).count();
+        if (s < best)
+            best = s;
+    }
+    return best;
+}
+
+// what the store did before the namespace index: every subject tested
+static size_t scan(const BeliefStore& store, const std::vector<std::string_view>& prefixes,
+                   std::string& out)
+{
+    out += "{\"component\":\"BLS\",\"revision\":";
+    out += std::to_string(store.revision());
+    out += ",\"beliefs\":{";
+    size_t n = 0;
+    for (uint32_t id = 0; id < store.size(); ++id) {
+        const std::string& s = store.subject(id);
+        for (std::string_view p : prefixes)
+            if (std::string_view(s).starts_with(p)) {
+                if (n++)
+                    out += ',';
+                out += '"';
+                out += s;
+                out += store.entry(id).polarity ? "\":true" : "\":false";
+                break;
+            }
+    }
+    out += "}}";
+    return n;
+}
+
+int main(int argc, char** argv)
+{
+    const int wanted = argc > 1 ? std::atoi(argv[1]) : 64;
+    const int runs   = argc > 2 ? std::atoi(argv[2]) : 20;
+
+    const std::vector<std::string_view> prefixes = { "FSM.XFR.", "NET." };
+
+    std::printf("%10s %12s %12s %12s %10s\n", "beliefs", "indexed ms", "scan ms", "full ms", "matched");
+    for (int total : { 1000, 10000, 100000, 1000000 }) {
+        BeliefStore store;
+        store.options.history = 1;   // not measured here
+
+        for (int i = 0; i < wanted; ++i) {
+            store.commit("FSM", "FSM.XFR.s" + std::to_string(i), true, std::string());
+            store.commit("NET", "NET.s" + std::to_string(i), i & 1, std::string());
+        }
+        for (int i = 2 * wanted; i < total; ++i)
+            store.commit("APP", "APP.n" + std::to_string(i % 1000) + ".s" + std::to_string(i),
+                         true, std::string());
+
+        std::string out;
+        size_t matched = 0;
+
+        BeliefStore::Query q;
+        q.prefixes = prefixes;
+        const double indexed = best_of(runs, [&] { out.clear(); matched = store.snapshot(q, out); });
+        const double scanned = best_of(runs, [&] { out.clear(); scan(store, prefixes, out); });
+        const double full    = best_of(runs, [&] { out.clear(); store.snapshot({}, out); });
+
+        std::printf("%10zu %12.4f %12.4f %12.4f %10zu\n",
+                    store.size(), indexed * 1e3, scanned * 1e3, full * 1e3, matched);
+    }
+    return 0;
+}
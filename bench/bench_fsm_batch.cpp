@@ -0,0 +1,140 @@
+// bench_fsm_batch.cpp
+//
+// Instances stepped per second through Fsm::on_tick when most steps fire
+// nothing: `instances` named instances of one flat definition (so one
+// FsmBatch), a BLS snapshot and a tick per round, injected as the socket
+// would deliver them (Component::inject), everything sent dropped. Only the
+// ticks are timed. bench_static_fsm covers the opposite case, where most
+// steps fire.
+//
+// The definition is a ring of `states` states, each with `fanout`
+// transitions gated on distinct beliefs B.<n>; each round every subject is
+// true with probability 1 / `one_in`.
+//
+//   g++ -std=c++20 -O2 -march=native -pthread -o bench_fsm_batch
+//       bench_fsm_batch.cpp ../Fsm.cpp ../FsmBatch.cpp ../FsmDefinition.cpp
+//       ../FsmGuard.cpp ../FsmNote.cpp ../FsmImage.cpp
+//   ./bench_fsm_batch [instances] [states] [fanout] [ticks] [subjects] [one_in]
+
+#include "../Fsm.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static constexpr int FSM_SBA = 7002;
+
+// -----------------------------------------------------------------------------
+// Synthetic definition: a ring of states, each with `fanout` outgoing
+// transitions gated on distinct beliefs.
+// -----------------------------------------------------------------------------
+static std::string make_definition(int states, int fanout, int subjects)
+{
+    std::ostringstream oss;
+    oss << "@startuml\n";
+    oss << "[*] --> S0\n";
+
+    for (int s = 0; s < states; ++s)
+        for (int k = 0; k < fanout; ++k)
+            oss << "S" << s << " --> S" << (s + 1 + k) % states
+                << " : belief B." << (s * fanout + k) % subjects << "\n";
+
+    oss << "note right of S0\n{ \"_tck\": { \"enable\": true } }\nend note\n";
+    oss << "@enduml\n";
+    return oss.str();
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point t0)
+{
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char** argv)
+{
+    const int instances = argc > 1 ? std::atoi(argv[1]) : 10000;
+    const int states    = argc > 2 ? std::atoi(argv[2]) : 16;
+    const int fanout    = argc > 3 ? std::atoi(argv[3]) : 4;
+    const int ticks     = argc > 4 ? std::atoi(argv[4]) : 1000;
+    const int subjects  = argc > 5 ? std::atoi(argv[5]) : 48;
+    const int one_in    = argc > 6 ? std::atoi(argv[6]) : 64;
+
+    if (instances < 1 || states < 1 || fanout < 1 || subjects < 1 || one_in < 1) {
+        std::fprintf(stderr, "usage: %s [instances] [states] [fanout] [ticks] "
+                             "[subjects] [one_in]\n", argv[0]);
+        return 1;
+    }
+
+    // ---- a belief snapshot per round ----
+    std::mt19937 rng(42);
+    std::vector<std::string> snapshots(64);
+    for (size_t r = 0; r < snapshots.size(); ++r) {
+        json snap;
+        snap["component"] = "BLS";
+        snap["beliefs"]   = json::object();
+        for (int b = 0; b < subjects; ++b)
+            if (rng() % one_in == 0)
+                snap["beliefs"]["B." + std::to_string(b)] = true;
+        snapshots[r] = snap.dump();
+    }
+
+    // ---- a real Fsm, no socket ----
+    uint64_t clock_ns = 1;
+    mpp::virtual_clock_ns = &clock_ns;
+
+    std::string reply;   // sent back to us
+    Fsm fsm(FSM_SBA);
+    fsm.set_outbox([&](std::string_view payload, const sockaddr_in& dest) {
+        if (ntohs(dest.sin_port) == 7100)
+            reply.append(payload);
+    });
+
+    sockaddr_in sender{};
+    sender.sin_family = AF_INET;
+    sender.sin_port   = htons(7100);
+    sender.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    const std::string text = make_definition(states, fanout, subjects);
+    for (int i = 0; i < instances; ++i) {
+        json req;
+        req["verb"]     = "PUT";
+        req["resource"] = "fsm";
+        req["instance"] = "i" + std::to_string(i);
+        req["body"]     = { {"definition", "ring"} };
+        if (i == 0)
+            req["body"]["fsm_text"] = text;
+        fsm.inject(req.dump(), sender);
+    }
+
+    double tick_s = 0;
+    for (int tick = 0; tick < ticks; ++tick) {
+        fsm.inject(snapshots[tick % snapshots.size()], sender);
+
+        const auto t0 = std::chrono::steady_clock::now();
+        fsm.inject("{\"tick\":true}", sender);
+        tick_s += seconds_since(t0);
+
+        clock_ns += 1000000;
+    }
+
+    // transitions as Fsm counted them
+    reply.clear();
+    fsm.inject("{\"verb\":\"GET\",\"resource\":\"metrics\"}", sender);
+    size_t fired = 0;
+    const size_t at = reply.find("fsm_transitions_total{");
+    if (at != std::string::npos)
+        fired = std::strtoull(reply.c_str() + reply.find("} ", at) + 2, nullptr, 10);
+
+    mpp::virtual_clock_ns = nullptr;
+
+    const double steps = double(instances) * ticks;
+    std::printf("ring: instances=%d states=%d fanout=%d subjects=%d one_in=%d ticks=%d\n",
+                instances, states, fanout, subjects, one_in, ticks);
+    std::printf("  Fsm      %10.3f Minst-steps/s  (%zu transitions, %.1f%% of steps)\n",
+                steps / tick_s / 1e6, fired, 100.0 * fired / steps);
+    return 0;
+}
@@ -0,0 +1,86 @@
+// bench_fsm_parse.cpp
+//
+// FsmDefinition::parse_plantuml on a generated definition: `states` states in
+// a ring, each with `fanout` outgoing transitions gated on beliefs, a note
+// on every 8th state, and a composite with two regions around the first
+// few. Reports parse time and throughput, best of `runs`.
+//
+//   g++ -std=c++20 -O2 -o bench_fsm_parse
+//       bench_fsm_parse.cpp ../FsmDefinition.cpp ../FsmGuard.cpp ../FsmNote.cpp
+//   ./bench_fsm_parse [states] [fanout] [subjects] [runs]
+
+#include "../FsmDefinition.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+
+static std::string make_definition(int states, int fanout, int subjects)
+{
+    std::ostringstream oss;
+    oss << "@startuml\n\n[*] --> S0\n\n";
+
+    // a composite with two regions, so the scope handling is exercised too
+    oss << "state S1 {\n  [*] --> S2\n  S2 --> S3 : belief B.0\n"
+        << "  --\n  [*] --> S4\n  S4 --> S5 : not belief B.1\n}\n\n";
+
+    for (int s = 0; s < states; ++s)
+        for (int k = 0; k < fanout; ++k) {
+            oss << "S" << s << " --> S" << (s + 1 + k) % states << " : ";
+            switch (k % 4) {
+            case 0:  oss << "belief B." << (s * fanout + k) % subjects; break;
+            case 1:  oss << "belief B." << (s + k) % subjects
+                         << " and not belief B." << (s * 7 + k) % subjects; break;
+            case 2:  oss << "B." << (s * 3 + k) % subjects << "=true"; break;
+            default: oss << "true"; break;
+            }
+            oss << "\n";
+        }
+
+    for (int s = 0; s < states; s += 8)
+        oss << "\nnote right of S" << s << "\n{\n"
+            << "  \"_commit\": { \"subject\": \"FSM.S" << s << ".entered\" },\n"
+            << "  \"_send\": { \"n\": " << s << ", \"state\": \"$REG.current_state\" },\n"
+            << "  \"_tck\": { \"enable\": true }\n"
+            << "}\nend note\n";
+
+    oss << "\n@enduml\n";
+    return oss.str();
+}
+
+int main(int argc, char** argv)
+{
+    const int states   = argc > 1 ? std::atoi(argv[1]) : 10000;
+    const int fanout   = argc > 2 ? std::atoi(argv[2]) : 10;
+    const int subjects = argc > 3 ? std::atoi(argv[3]) : 256;
+    const int runs     = argc > 4 ? std::atoi(argv[4]) : 5;
+
+    const std::string text = make_definition(states, fanout, subjects);
+
+    double best = 1e30;
+    std::shared_ptr<FsmDefinition> def;
+    for (int r = 0; r < runs; ++r) {
+        std::string error;
+        const auto t0 = std::chrono::steady_clock::now();
+        def = FsmDefinition::parse_plantuml(text, nullptr, &error);
+        const double s = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - t0).count();
+
+        if (!def) {
+            std::fprintf(stderr, "parse failed: %s\n", error.c_str());
+            return 1;
+        }
+        if (s < best)
+            best = s;
+    }
+
+    std::printf("states=%zu transitions=%zu subjects=%zu text=%.1f MB\n",
+                def->states.size(), def->transitions.size(),
+                def->subjects->names.size(), text.size() / 1e6);
+    std::printf("  parse  %10.1f ms  %8.1f MB/s  %8.2f Mtransitions/s\n",
+                best * 1e3, text.size() / best / 1e6,
+                def->transitions.size() / best / 1e6);
+    return 0;
+}
@@ -0,0 +1,187 @@
+// bench_static_fsm.cpp
+//
+// Instances stepped per second on the xfr protocol: XfrFsm (generated by
+// tools/fsm_codegen; StaticMachine's step, guards as inlined bit tests)
+// against the runtime Fsm hosting the same number of named instances of
+// the loaded definition, driven as a deployment drives it: a BLS belief
+// snapshot and a TCK tick per round, each handled by Fsm exactly as if the
+// socket had delivered it (Component::inject). What it sends (BLS polls,
+// state beliefs, "_send" payloads to the target, TCK enables) goes to an
+// outbox that drops it, noting only which TCKs were disabled. Both sides
+// must fire the same number of transitions (exit status 2 otherwise).
+//
+// Each round every instance sees the same beliefs (BLS state is process
+// wide); instance i starts at round i % 16 so they do not all move in
+// step. An instance that parks in DONE disables its own TCK; the bench
+// restarts it with a PUT, outside the timed part, as the static side
+// restarts at the initial state.
+//
+//   g++ -std=c++20 -O2 -march=native -pthread -o bench_static_fsm
+//       bench_static_fsm.cpp ../Fsm.cpp ../FsmDefinition.cpp ../FsmGuard.cpp
+//       ../FsmNote.cpp ../FsmImage.cpp
+//   ./bench_static_fsm <xfr.puml> [instances] [ticks]
+
+#include "../Fsm.hpp"
+#include "../StaticFsm.hpp"
+#include "../gen/xfr_fsm.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static constexpr int FSM_SBA    = 7002;
+static constexpr int TARGET_SBA = 4005;
+static constexpr int TCK_BASE   = 20000;   // instance i ticks from TCK_BASE + i
+static constexpr int STAGGER    = 16;
+
+static double seconds_since(std::chrono::steady_clock::time_point t0)
+{
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <xfr.puml> [instances] [ticks]\n", argv[0]);
+        return 1;
+    }
+    const char* path    = argv[1];
+    const int instances = argc > 2 ? std::atoi(argv[2]) : 10000;
+    const int ticks     = argc > 3 ? std::atoi(argv[3]) : 1000;
+
+    if (instances < 1 || instances > 65535 - TCK_BASE) {
+        std::fprintf(stderr, "instances: 1 .. %d\n", 65535 - TCK_BASE);
+        return 1;
+    }
+
+    std::ifstream file(path);
+    if (!file) {
+        std::fprintf(stderr, "%s: cannot read\n", path);
+        return 1;
+    }
+    std::ostringstream text;
+    text << file.rdbuf();
+
+    // ---- beliefs per round: both NET subjects, each true about half the
+    //      time ----
+    std::mt19937 rng(42);
+    std::vector<uint8_t> coin(64);
+    for (auto& c : coin)
+        c = rng() & 3;
+
+    const int st = StaticMachine<XfrFsm>::find_subject("NET.tx_done");
+    const int sr = StaticMachine<XfrFsm>::find_subject("NET.rx_done");
+
+    // ---- static (one byte of state per instance) ----
+    std::vector<XfrFsm::State> states(instances, XfrFsm::initial);
+    size_t fired = 0;
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (int tick = 0; tick < ticks; ++tick) {
+        const uint8_t c = coin[tick % 64];
+        const uint64_t have_true = ((c & 1) ? uint64_t(1) << st : 0) |
+                                   ((c & 2) ? uint64_t(1) << sr : 0);
+
+        for (int i = 0; i < instances; ++i) {
+            if (tick < i % STAGGER)
+                continue;
+
+            const int t = XfrFsm::select(states[i], have_true, 0);
+            if (t < 0)
+                continue;
+
+            const XfrFsm::State to = XfrFsm::transitions[t].to;
+            ++fired;
+            states[i] = XfrFsm::notes[static_cast<size_t>(to)].terminal
+                ? XfrFsm::initial : to;   // next exchange
+        }
+    }
+    const double static_s = seconds_since(t0);
+
+    // ---- dynamic: a real Fsm, no socket ----
+    uint64_t clock_ns = 1;
+    mpp::virtual_clock_ns = &clock_ns;
+
+    std::vector<int> parked;           // instances whose TCK was disabled
+    std::string reply;                 // sent back to us
+
+    Fsm fsm(FSM_SBA);
+    fsm.set_outbox([&](std::string_view payload, const sockaddr_in& dest) {
+        const int port = ntohs(dest.sin_port);
+        if (port >= TCK_BASE && payload == "{\"enable\":false}\n")
+            parked.push_back(port - TCK_BASE);
+        else if (port == 7100)
+            reply.append(payload);
+    });
+
+    sockaddr_in sender{};
+    sender.sin_family = AF_INET;
+    sender.sin_port   = htons(7100);
+    sender.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    auto put = [&](int i) {
+        json req;
+        req["verb"]     = "PUT";
+        req["resource"] = "fsm";
+        req["instance"] = "i" + std::to_string(i);
+        req["body"]     = { {"definition", "xfr"}, {"target_sba", TARGET_SBA},
+                            {"tck_sba", TCK_BASE + i} };
+        if (i == 0)
+            req["body"]["fsm_text"] = text.str();
+        fsm.inject(req.dump(), sender);
+    };
+
+    double dynamic_s = 0;
+    for (int tick = 0; tick < ticks; ++tick) {
+        // joining this round, or restarted after parking in the last one
+        if (tick < STAGGER)
+            for (int i = tick; i < instances; i += STAGGER)
+                put(i);
+        for (int i : parked)
+            put(i);
+        parked.clear();
+
+        const uint8_t c = coin[tick % 64];
+        json snapshot;
+        snapshot["component"] = "BLS";
+        snapshot["revision"]  = tick + 1;
+        snapshot["beliefs"]   = json::object();
+        if (c & 1)
+            snapshot["beliefs"]["NET.tx_done"] = true;
+        if (c & 2)
+            snapshot["beliefs"]["NET.rx_done"] = true;
+        const std::string beliefs = snapshot.dump();
+
+        t0 = std::chrono::steady_clock::now();
+        fsm.inject(beliefs, sender);
+        fsm.inject("{\"tick\":true}", sender);
+        dynamic_s += seconds_since(t0);
+
+        clock_ns += 1000000;
+    }
+
+    // transitions as Fsm counted them
+    reply.clear();
+    fsm.inject("{\"verb\":\"GET\",\"resource\":\"metrics\"}", sender);
+    size_t fired_dynamic = 0;
+    const size_t at = reply.find("fsm_transitions_total{");
+    if (at != std::string::npos)
+        fired_dynamic = std::strtoull(reply.c_str() + reply.find("} ", at) + 2, nullptr, 10);
+
+    mpp::virtual_clock_ns = nullptr;
+
+    const double steps = double(instances) * ticks;
+    std::printf("xfr: instances=%d ticks=%d\n", instances, ticks);
+    std::printf("  static   %10.3f Minst-steps/s  (%zu transitions)\n",
+                steps / static_s / 1e6, fired);
+    std::printf("  Fsm      %10.3f Minst-steps/s  (%zu transitions)\n",
+                steps / dynamic_s / 1e6, fired_dynamic);
+    std::printf("  speedup  %10.2fx\n", dynamic_s / static_s);
+    return fired == fired_dynamic ? 0 : 2;
+}
@@ -0,0 +1,4 @@
+#include "Component.hpp"
+#include "Bls.hpp"
+
+MPP_MAIN(Bls)
@@ -0,0 +1,181 @@
+// Generated by tools/fsm_codegen from ping.puml - do not edit.
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+struct PingFsm
+{
+    static constexpr std::string_view name = "ping";
+
+    enum class State : uint8_t
+    {
+        INIT,
+        CONFIGURE,
+        TX,
+        WAIT_TX,
+        OBSERVE_TX,
+        WAIT_REPLY,
+        GOT_REPLY,
+        DONE,
+    };
+
+    static constexpr State initial = State::INIT;
+
+    static constexpr std::array<std::string_view, 8> state_names = {
+        "INIT",
+        "CONFIGURE",
+        "TX",
+        "WAIT_TX",
+        "OBSERVE_TX",
+        "WAIT_REPLY",
+        "GOT_REPLY",
+        "DONE",
+    };
+
+    static constexpr std::array<std::string_view, 2> subjects = {
+        "NET.tx_done",
+        "NET.rx_done",
+    };
+
+    struct Transition {
+        State    from;
+        State    to;
+        uint64_t need_true;
+        uint64_t need_false;
+        int      line;
+    };
+
+    static constexpr std::array<Transition, 8> transitions = {{
+        { State::INIT, State::CONFIGURE, 0x0ull, 0x0ull, 12 },   // true
+        { State::CONFIGURE, State::TX, 0x0ull, 0x0ull, 13 },   // true
+        { State::TX, State::WAIT_TX, 0x0ull, 0x0ull, 14 },   // true
+        { State::WAIT_TX, State::OBSERVE_TX, 0x0ull, 0x0ull, 15 },   // true
+        { State::OBSERVE_TX, State::WAIT_REPLY, 0x1ull, 0x0ull, 16 },   // NET.tx_done=true
+        { State::WAIT_REPLY, State::WAIT_REPLY, 0x0ull, 0x2ull, 17 },   // NET.rx_done=false
+        { State::WAIT_REPLY, State::GOT_REPLY, 0x2ull, 0x0ull, 18 },   // NET.rx_done=true
+        { State::GOT_REPLY, State::DONE, 0x0ull, 0x0ull, 19 },   // true
+    }};
+
+    struct Note {
+        std::string_view state_subject;
+        std::string_view state_bytes;
+        std::string_view commit_subject;   // empty = no _commit
+        bool             commit_polarity;
+        std::string_view commit_context;   // JSON text
+        std::string_view commit_bytes;
+        std::string_view send_bytes;
+        std::string_view tck_bytes;
+        bool             terminal;
+    };
+
+    static constexpr std::array<Note, 8> notes = {{
+        { // INIT
+          "FSM.state.INIT",
+          "{\"belief\":{\"component\":\"FSM\",\"subject\":\"FSM.state.INIT\",\"polarity\":true,\"context\":{}}}\n",
+          "",
+          true,
+          "",
+          "",
+          "",
+          "",
+          false },
+        { // CONFIGURE
+          "FSM.state.CONFIGURE",
+          "{\"belief\":{\"component\":\"FSM\",\"subject\":\"FSM.state.CONFIGURE\",\"polarity\":true,\"context\":{}}}\n",
+          "",
+          true,
+          "",
+          "",
+          "",
+          "",
+          false },
+        { // TX
+          "FSM.state.TX",
+          "{\"belief\":{\"component\":\"FSM\",\"subject\":\"FSM.state.TX\",\"polarity\":true,\"context\":{}}}\n",
+          "",
+          true,
+          "",
+          "",
+          "",
+          "",
+          false },
+        { // WAIT_TX
+          "FSM.state.WAIT_TX",
+          "{\"belief\":{\"component\":\"FSM\",\"subject\":\"FSM.state.WAIT_TX\",\"polarity\":true,\"context\":{}}}\n",
+          "",
+          true,
+          "",
+          "",
+          "",
+          "",
+          false },
+        { // OBSERVE_TX
+          "FSM.state.OBSERVE_TX",
+          "{\"belief\":{\"component\":\"FSM\",\"subject\":\"FSM.state.OBSERVE_TX\",\"polarity\":true,\"context\":{}}}\n",
+          "",
+          true,
+          "",
+          "",
+          "",
+          "",
+          false },
+        { // WAIT_REPLY
+          "FSM.state.WAIT_REPLY",
+          "{\"belief\":{\"component\":\"FSM\",\"subject\":\"FSM.state.WAIT_REPLY\",\"polarity\":true,\"context\":{}}}\n",
+          "",
+          true,
+          "",
+          "",
+          "",
+          "",
+          false },
+        { // GOT_REPLY
+          "FSM.state.GOT_REPLY",
+          "{\"belief\":{\"component\":\"FSM\",\"subject\":\"FSM.state.GOT_REPLY\",\"polarity\":true,\"context\":{}}}\n",
+          "",
+          true,
+          "",
+          "",
+          "",
+          "",
+          false },
+        { // DONE
+          "FSM.state.DONE",
+          "{\"belief\":{\"component\":\"FSM\",\"subject\":\"FSM.state.DONE\",\"polarity\":true,\"context\":{}}}\n",
+          "",
+          true,
+          "",
+          "",
+          "",
+          "",
+          true },
+    }};
+
+    struct Outgoing {
+        uint16_t first;
+        uint16_t count;
+    };
+
+    static constexpr std::array<Outgoing, 8> outgoing = {{
+        { 0, 1 },   // INIT
+        { 1, 1 },   // CONFIGURE
+        { 2, 1 },   // TX
+        { 3, 1 },   // WAIT_TX
+        { 4, 1 },   // OBSERVE_TX
+        { 5, 2 },   // WAIT_REPLY
+        { 7, 1 },   // GOT_REPLY
+        { 8, 0 },   // DONE
+    }};
+
+    static constexpr int select(State s, uint64_t have_true, uint64_t have_false)
+    {
+        const Outgoing out = outgoing[static_cast<size_t>(s)];
+        for (int t = out.first; t < out.first + out.count; ++t)
+            if (((transitions[t].need_true  & ~have_true) |
+                 (transitions[t].need_false & ~have_false)) == 0)
+                return t;
+        return -1;
+    }
+};
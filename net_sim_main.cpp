@@ -0,0 +1,4 @@
+#include "Component.hpp"
+#include "NetSim.hpp"
+
+MPP_MAIN(NetSim)
@@ -0,0 +1,13 @@
+#include "Component.hpp"
+#include "StaticFsm.hpp"
+#include "gen/ping_fsm.hpp"
+#include "gen/xfr_fsm.hpp"
+
+// One binary per compiled-in protocol: -DMPP_STATIC_FSM=XfrFsm
+#ifndef MPP_STATIC_FSM
+#define MPP_STATIC_FSM PingFsm
+#endif
+
+using StaticComponent = StaticFsm<MPP_STATIC_FSM>;
+
+MPP_MAIN(StaticComponent)
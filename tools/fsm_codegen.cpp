@@ -0,0 +1,276 @@
+// fsm_codegen.cpp
+//
+// Code generator: PlantUML FSM text -> header with a constexpr definition
+// for StaticFsm<Def> (StaticFsm.hpp). For fixed protocols that never load
+// a definition at runtime:
+//
+//   g++ -std=c++20 -O2 -o fsm_codegen fsm_codegen.cpp
+//       ../FsmDefinition.cpp ../FsmGuard.cpp ../FsmNote.cpp
+//   ./fsm_codegen <in.puml> <out.hpp> [TypeName]
+//
+// The default type name is the file stem in CamelCase plus "Fsm"
+// (ping.puml -> PingFsm). The output depends on nothing but the standard
+// library; StaticFsm.hpp checks its shape.
+
+#include "../FsmDefinition.hpp"
+
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+// -----------------------------------------------------------------------------
+// What a static machine can express (see StaticFsm.hpp)
+// -----------------------------------------------------------------------------
+static std::string unsupported(const FsmDefinition& def)
+{
+    if (def.hierarchical())
+        return "composite states are not supported";
+    if (def.subjects->names.size() > 64)
+        return "more than 64 belief subjects";
+    if (def.states.size() > 255)
+        return "more than 255 states";
+    if (def.transitions.size() > 65535)
+        return "more than 65535 transitions";
+
+    for (size_t t = 0; t < def.transitions.size(); ++t)
+        if (def.has_program(t))
+            return "line " + std::to_string(def.transitions[t].line) +
+                   ": guard '" + def.transitions[t].guard +
+                   "' is not a belief conjunction";
+
+    for (const auto& s : def.states) {
+        if (s.deadline_ms || s.deadline_ticks)
+            return "state " + s.name + ": _deadline is not supported";
+        if (!s.payloads.send.holes.empty())
+            return "state " + s.name + ": $REG in _send is not supported";
+    }
+    return "";
+}
+
+static bool identifier(const std::string& s)
+{
+    if (s.empty() || std::isdigit(static_cast<unsigned char>(s[0])))
+        return false;
+    for (char c : s)
+        if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_')
+            return false;
+    return true;
+}
+
+// C++ string literal; octal escapes are never longer than three digits,
+// so a following digit cannot run into them
+static std::string literal(const std::string& s)
+{
+    std::string out = "\"";
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += static_cast<char>(c);
+        } else if (c == '\n') {
+            out += "\\n";
+        } else if (c < 0x20 || c >= 0x7f) {
+            char esc[5];
+            std::snprintf(esc, sizeof(esc), "\\%03o", c);
+            out += esc;
+        } else {
+            out += static_cast<char>(c);
+        }
+    }
+    return out + "\"";
+}
+
+static std::string mask(const FsmDefinition& def, const std::vector<std::string>& subjects)
+{
+    uint64_t bits = 0;
+    for (const auto& subject : subjects)
+        bits |= uint64_t(1) << def.find_subject(subject);
+
+    char hex[32];
+    std::snprintf(hex, sizeof(hex), "0x%llxull", static_cast<unsigned long long>(bits));
+    return hex;
+}
+
+// -----------------------------------------------------------------------------
+// Emit
+// -----------------------------------------------------------------------------
+static std::string generate(const FsmDefinition& def,
+                            const std::string& type,
+                            const std::string& source)
+{
+    std::ostringstream o;
+    const auto& states = def.states;
+
+    o << "// Generated by tools/fsm_codegen from " << source << " - do not edit.\n"
+      << "#pragma once\n\n"
+      << "#include <array>\n"
+      << "#include <cstdint>\n"
+      << "#include <string_view>\n\n"
+      << "struct " << type << "\n{\n"
+      << "    static constexpr std::string_view name = " << literal(def.name) << ";\n\n";
+
+    // ---- states ----
+    o << "    enum class State : uint8_t\n    {\n";
+    for (const auto& s : states)
+        o << "        " << s.name << ",\n";
+    o << "    };\n\n"
+      << "    static constexpr State initial = State::" << states[def.initial].name << ";\n\n"
+      << "    static constexpr std::array<std::string_view, " << states.size()
+      << "> state_names = {\n";
+    for (const auto& s : states)
+        o << "        " << literal(s.name) << ",\n";
+    o << "    };\n\n";
+
+    // ---- subjects (bit i of a mask) ----
+    o << "    static constexpr std::array<std::string_view, " << def.subjects->names.size()
+      << "> subjects = {\n";
+    for (const auto& subject : def.subjects->names)
+        o << "        " << literal(subject) << ",\n";
+    o << "    };\n\n";
+
+    // ---- transitions ----
+    o << "    struct Transition {\n"
+      << "        State    from;\n"
+      << "        State    to;\n"
+      << "        uint64_t need_true;\n"
+      << "        uint64_t need_false;\n"
+      << "        int      line;\n"
+      << "    };\n\n"
+      << "    static constexpr std::array<Transition, " << def.transitions.size()
+      << "> transitions = {{\n";
+    for (const auto& t : def.transitions)
+        o << "        { State::" << states[t.from].name << ", State::" << states[t.to].name
+          << ", " << mask(def, t.beliefs) << ", " << mask(def, t.beliefs_false)
+          << ", " << t.line << " },   // " << t.guard << "\n";
+    o << "    }};\n\n";
+
+    // ---- notes, pre-serialized as FsmNote does ----
+    o << "    struct Note {\n"
+      << "        std::string_view state_subject;\n"
+      << "        std::string_view state_bytes;\n"
+      << "        std::string_view commit_subject;   // empty = no _commit\n"
+      << "        bool             commit_polarity;\n"
+      << "        std::string_view commit_context;   // JSON text\n"
+      << "        std::string_view commit_bytes;\n"
+      << "        std::string_view send_bytes;\n"
+      << "        std::string_view tck_bytes;\n"
+      << "        bool             terminal;\n"
+      << "    };\n\n"
+      << "    static constexpr std::array<Note, " << states.size() << "> notes = {{\n";
+    for (const auto& s : states) {
+        const FsmNote& n = s.payloads;
+        o << "        { // " << s.name << "\n"
+          << "          " << literal(n.state_subject) << ",\n"
+          << "          " << literal(n.state_bytes) << ",\n"
+          << "          " << literal(n.has_commit ? n.commit_subject : "") << ",\n"
+          << "          " << (n.commit_polarity ? "true" : "false") << ",\n"
+          << "          " << literal(n.has_commit ? n.commit_context.dump() : "") << ",\n"
+          << "          " << literal(n.commit_bytes) << ",\n"
+          << "          " << literal(n.send.empty() ? "" : n.send.chunks[0]) << ",\n"
+          << "          " << literal(n.tck_bytes) << ",\n"
+          << "          " << (s.terminal ? "true" : "false") << " },\n";
+    }
+    o << "    }};\n\n";
+
+    // ---- outgoing ranges; guards as bit tests, first match in declaration
+    //      order. A loop over constant masks rather than a switch on the
+    //      state: instances spread over many states make a switch's indirect
+    //      jump mispredict on nearly every step. ----
+    o << "    struct Outgoing {\n"
+      << "        uint16_t first;\n"
+      << "        uint16_t count;\n"
+      << "    };\n\n"
+      << "    static constexpr std::array<Outgoing, " << states.size() << "> outgoing = {{\n";
+    for (const auto& s : states)
+        o << "        { " << s.first_transition << ", " << s.transition_count
+          << " },   // " << s.name << "\n";
+    o << "    }};\n\n"
+      << "    static constexpr int select(State s, uint64_t have_true, uint64_t have_false)\n"
+      << "    {\n"
+      << "        const Outgoing out = outgoing[static_cast<size_t>(s)];\n"
+      << "        for (int t = out.first; t < out.first + out.count; ++t)\n"
+      << "            if (((transitions[t].need_true  & ~have_true) |\n"
+      << "                 (transitions[t].need_false & ~have_false)) == 0)\n"
+      << "                return t;\n"
+      << "        return -1;\n"
+      << "    }\n"
+      << "};\n";
+
+    return o.str();
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        std::fprintf(stderr, "usage: %s <in.puml> <out.hpp> [TypeName]\n", argv[0]);
+        return 1;
+    }
+
+    const std::string in  = argv[1];
+    const std::string out = argv[2];
+
+    std::ifstream file(in);
+    if (!file) {
+        std::fprintf(stderr, "%s: cannot open\n", in.c_str());
+        return 1;
+    }
+    std::ostringstream text;
+    text << file.rdbuf();
+
+    std::string error;
+    auto def = FsmDefinition::parse_plantuml(text.str(), nullptr, &error);
+    if (!def) {
+        std::fprintf(stderr, "%s: %s\n", in.c_str(), error.c_str());
+        return 1;
+    }
+
+    std::string source = in.substr(in.find_last_of('/') + 1);
+    def->name = source.substr(0, source.find_last_of('.'));
+
+    // default type name: ping -> PingFsm, fsm-net-tx -> FsmNetTxFsm
+    std::string type;
+    if (argc > 3) {
+        type = argv[3];
+    } else {
+        bool upper = true;
+        for (char c : def->name) {
+            if (!std::isalnum(static_cast<unsigned char>(c))) {
+                upper = true;
+                continue;
+            }
+            type += upper ? static_cast<char>(std::toupper(static_cast<unsigned char>(c))) : c;
+            upper = false;
+        }
+        type += "Fsm";
+    }
+
+    if (!identifier(type)) {
+        std::fprintf(stderr, "%s: '%s' is not a C++ identifier\n", in.c_str(), type.c_str());
+        return 1;
+    }
+    for (const auto& s : def->states)
+        if (!identifier(s.name)) {
+            std::fprintf(stderr, "%s: state '%s' is not a C++ identifier\n",
+                         in.c_str(), s.name.c_str());
+            return 1;
+        }
+
+    error = unsupported(*def);
+    if (!error.empty()) {
+        std::fprintf(stderr, "%s: %s\n", in.c_str(), error.c_str());
+        return 1;
+    }
+
+    std::ofstream header(out);
+    header << generate(*def, type, source);
+    if (!header) {
+        std::fprintf(stderr, "%s: cannot write\n", out.c_str());
+        return 1;
+    }
+
+    std::printf("%s: %zu states, %zu transitions, %zu subjects -> %s (%s)\n",
+                def->name.c_str(), def->states.size(), def->transitions.size(),
+                def->subjects->names.size(), out.c_str(), type.c_str());
+    return 0;
+}
@@ -0,0 +1,61 @@
+// fsm_compile.cpp
+//
+// Offline compiler: PlantUML FSM text -> binary image (FsmImage.hpp) that an
+// Fsm maps by path instead of parsing the PlantUML:
+//
+//   {"verb":"PUT","resource":"fsm","body":{"fsm_image":"/usr/local/mpp/fsm/fsm-xfr.fsmi",...}}
+//
+//   g++ -std=c++20 -O2 -o fsm_compile fsm_compile.cpp
+//       ../FsmDefinition.cpp ../FsmGuard.cpp ../FsmNote.cpp ../FsmImage.cpp
+//   ./fsm_compile <in.puml> <out.fsmi> [definition-name]
+
+#include "../FsmDefinition.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        std::fprintf(stderr, "usage: %s <in.puml> <out.fsmi> [name]\n", argv[0]);
+        return 1;
+    }
+
+    const std::string in  = argv[1];
+    const std::string out = argv[2];
+
+    std::ifstream file(in);
+    if (!file) {
+        std::fprintf(stderr, "%s: cannot open\n", in.c_str());
+        return 1;
+    }
+    std::ostringstream text;
+    text << file.rdbuf();
+
+    std::string error;
+    auto def = FsmDefinition::parse_plantuml(text.str(), nullptr, &error);
+    if (!def) {
+        std::fprintf(stderr, "%s: %s\n", in.c_str(), error.c_str());
+        return 1;
+    }
+
+    // default name: file name without directory and extension
+    if (argc > 3) {
+        def->name = argv[3];
+    } else {
+        std::string stem = in.substr(in.find_last_of('/') + 1);
+        def->name = stem.substr(0, stem.find_last_of('.'));
+    }
+
+    if (!def->write_image(out, error)) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    std::printf("%s: %zu states, %zu transitions, %zu subjects -> %s\n",
+                def->name.c_str(), def->states.size(), def->transitions.size(),
+                def->subjects->names.size(), out.c_str());
+    return 0;
+}
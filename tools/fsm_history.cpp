@@ -0,0 +1,89 @@
+// fsm_history.cpp
+//
+// Prints a flight-recorder dump (FsmHistory.hpp), oldest transition first:
+//
+//   {"verb":"GET","resource":"history","instance":"s7","path":"/tmp/s7.fsmh"}
+//
+//   g++ -std=c++20 -O2 -o fsm_history fsm_history.cpp
+//   ./fsm_history <dump.fsmh>
+
+#include "../FsmHistory.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <dump.fsmh>\n", argv[0]);
+        return 1;
+    }
+
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+        std::fprintf(stderr, "%s: cannot open\n", argv[1]);
+        return 1;
+    }
+
+    FsmHistoryHeader h;
+    in.read(reinterpret_cast<char*>(&h), sizeof(h));
+    if (!in || std::memcmp(h.magic, FsmHistoryHeader{}.magic, sizeof(h.magic)) != 0 ||
+        h.version != FsmHistoryHeader{}.version || h.record_size != sizeof(FsmHistoryRecord)) {
+        std::fprintf(stderr, "%s: not a history dump\n", argv[1]);
+        return 1;
+    }
+
+    std::vector<FsmHistoryRecord> records(h.count);
+    in.read(reinterpret_cast<char*>(records.data()),
+            static_cast<std::streamsize>(records.size() * sizeof(FsmHistoryRecord)));
+
+    std::string text(h.legend_bytes, '\0');
+    in.read(text.data(), static_cast<std::streamsize>(text.size()));
+    if (!in) {
+        std::fprintf(stderr, "%s: truncated\n", argv[1]);
+        return 1;
+    }
+
+    const auto legend = nlohmann::ordered_json::parse(text, nullptr, false);
+    if (legend.is_discarded()) {
+        std::fprintf(stderr, "%s: bad legend\n", argv[1]);
+        return 1;
+    }
+
+    const auto& states   = legend["states"];
+    const auto& subjects = legend.value("subjects", nlohmann::ordered_json::object());
+    auto name = [&](int32_t id) -> std::string {
+        return id >= 0 && size_t(id) < states.size() ? states[id].get<std::string>()
+                                                     : "#" + std::to_string(id);
+    };
+
+    std::printf("definition %s, instance \"%s\": %u of %" PRIu64 " transitions\n",
+                legend.value("definition", "").c_str(),
+                legend.value("instance", "").c_str(), h.count, h.recorded);
+
+    const uint64_t t0 = records.empty() ? 0 : records.front().ns;
+    for (const auto& r : records) {
+        const auto& tr = legend["transitions"].value(std::to_string(r.transition),
+                                                     nlohmann::ordered_json::object());
+        // what held when it fired; "!" = observed false
+        std::string matched;
+        for (uint32_t k = 0; k < r.matched && k < FsmHistoryRecord::MAX_MATCHED; ++k) {
+            matched += k ? ", " : "  on ";
+            matched += (r.matched_true >> k) & 1 ? "" : "!";
+            matched += subjects.value(std::to_string(r.subject[k]),
+                                      "#" + std::to_string(r.subject[k]));
+        }
+
+        std::printf("%10u  +%10.3f ms  tick %-8" PRIu64 " rev %-8" PRIu64 " %s -> %s  [%s]%s\n",
+                    r.seq, (r.ns - t0) / 1e6, r.tick, r.bls_revision,
+                    name(r.from).c_str(), name(r.to).c_str(),
+                    tr.value("guard", "").c_str(), matched.c_str());
+    }
+    return 0;
+}
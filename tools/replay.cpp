@@ -0,0 +1,137 @@
+// replay.cpp
+//
+// Feeds a capture log (Capture.hpp) back into a component, through the
+// same dispatch path the socket uses, and reports throughput. Nothing is
+// sent: outgoing datagrams are counted, and with --out written to another
+// capture log (addr/port = destination) so two runs can be compared.
+//
+//   {"verb":"PUT","resource":"capture","path":"/tmp/fsm.mppcap"}   (or MPP_CAPTURE=<dir>)
+//
+//   g++ -std=c++20 -O2 -pthread -o replay replay.cpp
+//       ../Fsm.cpp ../FsmDefinition.cpp ../FsmGuard.cpp ../FsmNote.cpp ../FsmImage.cpp
+//   g++ -std=c++20 -O2 -pthread -DMPP_REPLAY_XFR -o replay_xfr replay.cpp ../Xfr.cpp
+//
+//   ./replay <sba> <log.mppcap> [--fast] [--loops N] [--out out.mppcap]
+//
+// By default records are fed at their original spacing, with on_idle()
+// between them as the component's own loop would; --fast feeds them back
+// to back; --loops repeats the log into the same component, whose state
+// carries over. <sba> should be a free port: the component binds it but
+// never reads from it.
+
+#include "../Component.hpp"
+
+#ifdef MPP_REPLAY_XFR
+#include "../Xfr.hpp"
+using Replayed = Xfr;
+#else
+#include "../Fsm.hpp"
+using Replayed = Fsm;
+#endif
+
+#include <arpa/inet.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        std::fprintf(stderr, "usage: %s <sba> <log.mppcap> [--fast] [--loops N] [--out out.mppcap]\n",
+                     argv[0]);
+        return 1;
+    }
+
+    const int   sba  = std::atoi(argv[1]);
+    const char* path = argv[2];
+    bool        fast = false;
+    int         loops = 1;
+    const char* out_path = nullptr;
+
+    for (int i = 3; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--fast"))
+            fast = true;
+        else if (!std::strcmp(argv[i], "--loops") && i + 1 < argc)
+            loops = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--out") && i + 1 < argc)
+            out_path = argv[++i];
+        else {
+            std::fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    std::string error;
+    mpp::CaptureReader in;
+    if (!in.open(path, error)) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    mpp::CaptureWriter out;
+    if (out_path && !out.open(out_path, error)) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    Replayed comp(sba);
+
+    uint64_t sent = 0, sent_bytes = 0;
+    comp.set_outbox([&](std::string_view payload, const sockaddr_in& dest) {
+        ++sent;
+        sent_bytes += payload.size();
+        if (out.is_open())
+            out.append(mpp::now_ns(), ntohl(dest.sin_addr.s_addr), ntohs(dest.sin_port),
+                       static_cast<uint16_t>(sba), payload);
+    });
+
+    mpp::CaptureRecord r;
+    std::string payload;
+    uint64_t records = 0, bytes = 0;
+
+    const uint64_t t0 = mpp::now_ns();
+    for (int loop = 0; loop < loops; ++loop) {
+        in.rewind();
+
+        uint64_t first_ns = 0;
+        const uint64_t loop_start = mpp::now_ns();
+        while (in.next(r, payload)) {
+            if (!first_ns)
+                first_ns = r.ns;
+
+            // original spacing: wait (running the idle hook) until due
+            while (!fast && mpp::now_ns() - loop_start < r.ns - first_ns) {
+                if constexpr (requires(Replayed& c) { c.on_idle(); })
+                    comp.on_idle();
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+
+            sockaddr_in sender{};
+            sender.sin_family      = AF_INET;
+            sender.sin_addr.s_addr = htonl(r.addr);
+            sender.sin_port        = htons(r.port);
+            comp.inject(payload, sender);
+
+            if constexpr (requires(Replayed& c) { c.on_idle(); })
+                comp.on_idle();
+
+            ++records;
+            bytes += payload.size();
+        }
+    }
+    const double s = (mpp::now_ns() - t0) / 1e9;
+
+    std::printf("%s: %llu datagrams (%.1f MB) in %.3f s, %d loop(s)%s\n", path,
+                static_cast<unsigned long long>(records), bytes / 1e6, s, loops,
+                fast ? ", fast" : "");
+    std::printf("  in   %12.0f datagrams/s  %8.1f MB/s  %8.0f ns/datagram\n",
+                records / s, bytes / s / 1e6, records ? s * 1e9 / records : 0.0);
+    std::printf("  out  %12llu datagrams     %8.1f MB%s%s\n",
+                static_cast<unsigned long long>(sent), sent_bytes / 1e6,
+                out_path ? " -> " : "", out_path ? out_path : "");
+    return 0;
+}
@@ -0,0 +1,192 @@
+// sim_xfr.cpp
+//
+// The XFR send scenario of start105.sh / start109.sh in one process
+// (Sim.hpp): FSM-XFR driving an Xfr, FSM-NET driving a NET stand-in,
+// their TCKs and a BLS stand-in, on a simulated network. An operator
+// loads both definitions, enables the TCKs and, after a short while,
+// commits FSM.XFR.start; the run ends when FSM.XFR.complete is believed.
+//
+//   g++ -std=c++20 -O2 -pthread -o sim_xfr sim_xfr.cpp ../Xfr.cpp
+//       ../Fsm.cpp ../FsmDefinition.cpp ../FsmGuard.cpp ../FsmNote.cpp ../FsmImage.cpp
+//   ./sim_xfr [--seed N] [--latency-us U] [--jitter-us U] [--loss P] [--reorder P]
+//             [--runs N] [--dir <puml dir>] [--log]
+//
+// Prints virtual and wall time and a digest of every delivered datagram:
+// the same seed and options give the same digest.
+
+#include "../Sim.hpp"
+#include "../Fsm.hpp"
+#include "../Xfr.hpp"
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+using mpp::Simulation;
+
+namespace
+{
+    constexpr int OPERATOR = 7100;
+
+    constexpr int NET      = 5000;
+    constexpr int NET_TCK  = 5001;
+    constexpr int FSM_NET  = 5002;
+
+    constexpr int XFR      = 6000;
+    constexpr int XFR_TCK  = 6001;
+    constexpr int FSM_XFR  = 6002;
+
+    struct Options {
+        uint64_t    seed  = 1;
+        int         runs  = 1;
+        bool        log   = false;
+        std::string dir   = "..";
+        mpp::SimLink link;
+    };
+
+    // replies to the operator land here
+    struct Operator {
+        Operator(int, bool log) : log_(log) {}
+        void deliver(std::string_view payload, int from)
+        {
+            if (log_)
+                std::printf("  operator <- %d %.*s", from, int(payload.size()), payload.data());
+        }
+        bool log_;
+    };
+
+    std::string read_file(const std::string& path)
+    {
+        std::ifstream in(path);
+        if (!in) {
+            std::fprintf(stderr, "%s: cannot open\n", path.c_str());
+            std::exit(1);
+        }
+        std::ostringstream oss;
+        oss << in.rdbuf();
+        return oss.str();
+    }
+
+    void load(Simulation& sim, int fsm, const std::string& text, int target, int tck)
+    {
+        json put;
+        put["verb"]     = "PUT";
+        put["resource"] = "fsm";
+        put["body"]     = { {"fsm_text", text}, {"target_sba", target},
+                            {"tck_sba", tck}, {"run", true} };
+        sim.send(OPERATOR, fsm, put.dump() + "\n");
+    }
+
+    struct Result {
+        bool     done = false;
+        uint64_t virtual_ns = 0;
+        double   wall_ms = 0;
+        uint64_t digest = 0;
+        Simulation::Stats stats;
+        uint64_t ticks = 0;
+        uint64_t frames = 0;
+    };
+
+    Result run(const Options& o, const std::string& xfr_text, const std::string& net_text)
+    {
+        const auto wall0 = std::chrono::steady_clock::now();
+
+        Simulation sim(o.seed);
+        sim.link = o.link;
+
+        uint64_t digest = 0xcbf29ce484222325ull;   // FNV-1a over the delivery log
+        auto mix = [&](const void* p, size_t n) {
+            for (size_t i = 0; i < n; ++i) {
+                digest ^= static_cast<const unsigned char*>(p)[i];
+                digest *= 0x100000001b3ull;
+            }
+        };
+        const uint64_t t0 = sim.clock();
+        sim.tap = [&](uint64_t ns, int from, int to, const std::string& payload) {
+            mix(&ns, sizeof(ns));
+            mix(&from, sizeof(from));
+            mix(&to, sizeof(to));
+            mix(payload.data(), payload.size());
+            if (o.log)
+                std::printf("%10.3f ms  %d -> %d  %s", (ns - t0) / 1e6, from, to, payload.c_str());
+        };
+
+        auto& bls     = sim.add_node<mpp::SimBls>(mpp::BLS_PORT, sim);
+        auto& net     = sim.add_node<mpp::SimNet>(NET, sim);
+        auto& net_tck = sim.add_node<mpp::SimTck>(NET_TCK, sim);
+        auto& xfr_tck = sim.add_node<mpp::SimTck>(XFR_TCK, sim);
+        sim.add_node<Operator>(OPERATOR, o.log);
+        sim.add<Xfr>(XFR);
+        sim.add<Fsm>(FSM_NET);
+        sim.add<Fsm>(FSM_XFR);
+
+        load(sim, FSM_NET, net_text, NET, NET_TCK);
+        load(sim, FSM_XFR, xfr_text, XFR, XFR_TCK);
+        sim.send(OPERATOR, NET_TCK, "{\"enable\":true,\"target_sba\":5002}\n");
+        sim.send(OPERATOR, XFR_TCK, "{\"enable\":true,\"target_sba\":6002}\n");
+        sim.after(50'000'000, [&] { bls.set("FSM.XFR.start", true); });
+
+        Result r;
+        r.done = sim.run_until([&] { return bls.believes("FSM.XFR.complete"); },
+                               sim.clock() + 60'000'000'000ull);
+        r.virtual_ns = sim.clock() - t0;
+        r.wall_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - wall0).count();
+        r.digest = digest;
+        r.stats  = sim.stats;
+        r.ticks  = net_tck.ticks() + xfr_tck.ticks();
+        r.frames = net.frames();
+        return r;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options o;
+    for (int i = 1; i < argc; ++i) {
+        auto arg = [&](const char* name) { return !std::strcmp(argv[i], name) && i + 1 < argc; };
+        if      (arg("--seed"))       o.seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg("--latency-us")) o.link.latency_ns = std::strtoull(argv[++i], nullptr, 10) * 1000;
+        else if (arg("--jitter-us"))  o.link.jitter_ns  = std::strtoull(argv[++i], nullptr, 10) * 1000;
+        else if (arg("--loss"))       o.link.loss       = std::atof(argv[++i]);
+        else if (arg("--reorder"))    o.link.reorder    = std::atof(argv[++i]);
+        else if (arg("--runs"))       o.runs = std::atoi(argv[++i]);
+        else if (arg("--dir"))        o.dir  = argv[++i];
+        else if (!std::strcmp(argv[i], "--log")) o.log = true;
+        else {
+            std::fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    const std::string xfr_text = read_file(o.dir + "/fsm-xfr-send.puml");
+    const std::string net_text = read_file(o.dir + "/fsm-net.puml");
+
+    uint64_t first = 0;
+    bool same = true;
+    for (int n = 0; n < o.runs; ++n) {
+        const Result r = run(o, xfr_text, net_text);
+        std::printf("seed %" PRIu64 ": %s at %.3f ms virtual, %.2f ms wall, "
+                    "%" PRIu64 " events, %" PRIu64 " delivered, %" PRIu64 " lost, "
+                    "%" PRIu64 " reordered, %" PRIu64 " ticks, %" PRIu64 " frames, "
+                    "digest %016" PRIx64 "\n",
+                    o.seed, r.done ? "complete" : "NOT complete", r.virtual_ns / 1e6, r.wall_ms,
+                    r.stats.events, r.stats.delivered, r.stats.lost, r.stats.reordered,
+                    r.ticks, r.frames, r.digest);
+        if (n == 0)
+            first = r.digest;
+        else if (r.digest != first)
+            same = false;
+    }
+
+    if (!same) {
+        std::printf("runs diverged\n");
+        return 2;
+    }
+    return 0;
+}
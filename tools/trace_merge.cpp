@@ -0,0 +1,138 @@
+// trace_merge.cpp
+//
+// Joins span dumps (Trace.hpp) from any number of processes into one
+// Chrome / Perfetto trace (chrome://tracing, ui.perfetto.dev). Each
+// component is a process track named COMPONENT:sba; a hop between two
+// components is a flow arrow from the sender's span to the receiver's.
+//
+//   {"verb":"GET","resource":"trace","path":"/tmp/fsm.trace"}   (each component)
+//
+//   g++ -std=c++20 -O2 -o trace_merge trace_merge.cpp
+//   ./trace_merge <out.json> <dump.trace>...
+
+#include "../Trace.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using json = nlohmann::ordered_json;
+using mpp::TraceDumpHeader;
+using mpp::TraceSpan;
+
+static bool read_dump(const char* path, std::vector<TraceSpan>& spans)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::fprintf(stderr, "%s: cannot open\n", path);
+        return false;
+    }
+
+    TraceDumpHeader h;
+    in.read(reinterpret_cast<char*>(&h), sizeof(h));
+    if (!in || std::memcmp(h.magic, TraceDumpHeader{}.magic, sizeof(h.magic)) != 0 ||
+        h.version != 1 || h.record_size != sizeof(TraceSpan)) {
+        std::fprintf(stderr, "%s: not a trace dump\n", path);
+        return false;
+    }
+
+    const size_t first = spans.size();
+    spans.resize(first + h.count);
+    in.read(reinterpret_cast<char*>(spans.data() + first),
+            static_cast<std::streamsize>(h.count * sizeof(TraceSpan)));
+    if (!in) {
+        std::fprintf(stderr, "%s: truncated\n", path);
+        return false;
+    }
+
+    std::fprintf(stderr, "%s: pid %u, %u of %llu spans\n", path, h.pid, h.count,
+                 static_cast<unsigned long long>(h.recorded));
+    return true;
+}
+
+static std::string hex(uint64_t v)
+{
+    char buf[17];
+    std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(v));
+    return buf;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        std::fprintf(stderr, "usage: %s <out.json> <dump.trace>...\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<TraceSpan> spans;
+    for (int i = 2; i < argc; ++i)
+        if (!read_dump(argv[i], spans))
+            return 1;
+
+    std::sort(spans.begin(), spans.end(),
+              [](const TraceSpan& a, const TraceSpan& b) { return a.start_ns < b.start_ns; });
+
+    // Chrome wants microseconds; count from the first span so they stay small
+    uint64_t t0 = UINT64_MAX;
+    for (const auto& s : spans)
+        t0 = std::min(t0, s.sent_ns ? s.sent_ns : s.start_ns);
+    auto us = [&](uint64_t ns) { return (static_cast<double>(ns) - static_cast<double>(t0)) / 1e3; };
+
+    std::unordered_map<uint64_t, const TraceSpan*> by_id;
+    for (const auto& s : spans)
+        by_id[s.span] = &s;
+
+    json events = json::array();
+
+    std::map<uint32_t, std::string> tracks;
+    for (const auto& s : spans)
+        tracks.emplace(s.sba, std::string(s.component) + ":" + std::to_string(s.sba));
+    for (const auto& [sba, name] : tracks)
+        events.push_back({ {"ph", "M"}, {"name", "process_name"}, {"pid", sba},
+                           {"args", { {"name", name} }} });
+
+    size_t flows = 0;
+    for (const auto& s : spans) {
+        json args = { {"trace", hex(s.trace)}, {"span", hex(s.span)} };
+        if (s.parent) {
+            args["parent"] = hex(s.parent);
+            if (s.sent_ns)
+                args["hop_us"] = (static_cast<double>(s.start_ns) - static_cast<double>(s.sent_ns)) / 1e3;
+        }
+
+        events.push_back({ {"ph", "X"}, {"cat", "mpp"}, {"name", s.name},
+                           {"pid", s.sba}, {"tid", 0},
+                           {"ts", us(s.start_ns)}, {"dur", (s.end_ns - s.start_ns) / 1e3},
+                           {"args", args} });
+
+        // the hop, when the sender's dump is here too
+        auto parent = s.parent ? by_id.find(s.parent) : by_id.end();
+        if (parent == by_id.end() || !s.sent_ns)
+            continue;
+
+        const std::string id = hex(s.span);
+        events.push_back({ {"ph", "s"}, {"cat", "hop"}, {"name", "udp"}, {"id", id},
+                           {"pid", parent->second->sba}, {"tid", 0}, {"ts", us(s.sent_ns)} });
+        events.push_back({ {"ph", "f"}, {"bp", "e"}, {"cat", "hop"}, {"name", "udp"}, {"id", id},
+                           {"pid", s.sba}, {"tid", 0}, {"ts", us(s.start_ns)} });
+        ++flows;
+    }
+
+    std::ofstream out(argv[1]);
+    out << json{ {"traceEvents", events}, {"displayTimeUnit", "ns"} }.dump() << "\n";
+    if (!out) {
+        std::fprintf(stderr, "%s: cannot write\n", argv[1]);
+        return 1;
+    }
+
+    std::printf("%zu spans, %zu hops, %zu components -> %s\n",
+                spans.size(), flows, tracks.size(), argv[1]);
+    return 0;
+}